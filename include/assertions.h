@@ -6,12 +6,17 @@ extern "C" {
 #endif
 
 #include <libxml/tree.h>
+#include "gates.h"
+#include "symbols.h"
+#include "truthtable.h"
     
 typedef struct {
     xmlNode** inputTpNodes;
     int nInputs;
+    SymbolTable* inputIds;
     xmlNode** nodes;
     int n;
+    SymbolTable* ids;
 } NodeIdMap;
     
 typedef struct {
@@ -19,29 +24,56 @@ typedef struct {
     int valveNo;
     int isIndex;
     float min, max;
-    int* truth;
 } TestPoint;
     
+/*
+ * The TPs are ordered so that each comes after every TP it refers to. They
+ * are grouped into nLevels levels, level l holding the TPs from
+ * levelStarts[l] up to levelStarts[l + 1]. Level 0 is the nInputs inputs.
+ */
 typedef struct {
     TestPoint** tps;
     int nTp;
     int nInputs;
+    int* levelStarts;
+    int nLevels;
+    TruthTable* table;
+    GateProgram* program;
+    TruthWord* slots;
+    SymbolTable* symbols;
 } AssertionsSet;
 
-typedef struct LinkedListSortingNode LinkedListSortingNode;
-
-struct LinkedListSortingNode {
-    TestPoint* tp;
-    int depth;
-    LinkedListSortingNode* prev;
-    LinkedListSortingNode* next;
-};
+/*
+ * What checkSampleChanges carries from one sample of a stream to the next:
+ * the last sample checked, its outputs and error mask, and the values the
+ * gate program computed for it, one sample in every lane of slots. primed
+ * is 0 until slots hold a sample.
+ */
+typedef struct {
+    TruthWord* lastSample;
+    TruthWord* lastOutputs;
+    TruthWord* lastErrors;
+    TruthWord* outputs;
+    TruthWord* slots;
+    TruthWord* pending;
+    int primed;
+} SampleChecker;
 
 int getIndexOfTPByName(AssertionsSet* set, const char* name);
 int getIndexOfTPNodeInSet(AssertionsSet* set, xmlNode* node);
 AssertionsSet* createAssertionSetFromXMLNode(xmlNode* circuitNode);
+void completeAssertionSet(AssertionsSet* set);
 void freeAssertionSet(AssertionsSet* set);
+int findTableRowForInputs(AssertionsSet* set, int* samples);
 void checkTruthTable(AssertionsSet* set, int* samples, int* dest, int* n);
+int getErrorMaskWords(AssertionsSet* set);
+int getSampleWords(AssertionsSet* set);
+void checkTruthTableBatch(AssertionsSet* set, const TruthWord* const* samples, int n, TruthWord* results);
+void checkSamplesAtOnce(AssertionsSet* set, TruthWord* slots, const TruthWord* const* samples, int n, TruthWord* results);
+SampleChecker* createSampleChecker(AssertionsSet* set);
+void checkSampleChanges(AssertionsSet* set, SampleChecker* checker, const TruthWord* const* samples, int n, TruthWord* results);
+void freeSampleChecker(SampleChecker* checker);
+int getErrorIndicesFromMask(AssertionsSet* set, const TruthWord* mask, int* dest);
 void printTruthTable(AssertionsSet* set);
 void printTPs(AssertionsSet* set);
 
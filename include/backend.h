@@ -0,0 +1,59 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define PIN_LOW 0
+#define PIN_HIGH 1
+#define PIN_INPUT 0
+#define PIN_OUTPUT 1
+
+#define BACKEND_NAME_WIRINGPI "wiringpi"
+#define BACKEND_NAME_SIMULATOR "simulator"
+#ifndef BACKEND_DEFAULT
+#ifdef NO_WIRINGPI
+#define BACKEND_DEFAULT BACKEND_NAME_SIMULATOR
+#else
+#define BACKEND_DEFAULT BACKEND_NAME_WIRINGPI
+#endif
+#endif
+
+/*
+ * The hardware the monitor samples through: mapping physical header pins to
+ * GPIO numbers, setting and reading GPIO pins and writing to the SPI bus of
+ * the resistor chips. Each backend fills in the functions and keeps its own
+ * state, so the sampling code runs unchanged on a Raspberry Pi or against
+ * the simulator.
+ *
+ * A backend that can read the level of every GPIO pin at once sets
+ * nLevelWords to the number of 32 bit level registers and readLevels to
+ * read the first nWords of them, GPIO pin p being bit p % 32 of register
+ * p / 32. Others set nLevelWords to 0 and are read pin by pin.
+ */
+typedef struct SamplingBackend {
+    const char* name;
+    int (*physPinToGpio)(struct SamplingBackend* backend, int physPin);
+    void (*setPinMode)(struct SamplingBackend* backend, int pin, int mode);
+    void (*writePin)(struct SamplingBackend* backend, int pin, int value);
+    int (*readPin)(struct SamplingBackend* backend, int pin);
+    int nLevelWords;
+    void (*readLevels)(struct SamplingBackend* backend, uint32_t* levels, int nWords);
+    int (*setupSPI)(struct SamplingBackend* backend, int channel, int speed);
+    int (*writeSPI)(struct SamplingBackend* backend, int channel, unsigned char* data, int n);
+    void (*free)(struct SamplingBackend* backend);
+    void* state;
+} SamplingBackend;
+
+SamplingBackend* createSamplingBackend(const char* name);
+SamplingBackend* createWiringPiBackend(void);
+void freeSamplingBackend(SamplingBackend* backend);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BACKEND_H */
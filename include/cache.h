@@ -0,0 +1,38 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "assertions.h"
+#include "circuit.h"
+#include "resistors.h"
+
+#define CONFIG_CACHE_MAGIC 0x45445343u
+#define CONFIG_CACHE_VERSION 1
+
+/*
+ * Start of a compiled configuration cache file. The key is a hash of the
+ * configuration files the cache was compiled from, a cache whose key,
+ * version or word size differ from the running program's is ignored.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t key;
+    uint32_t wordSize;
+    uint32_t headerSize;
+    uint64_t fileSize;
+} ConfigCacheHeader;
+
+int hashConfigFiles(const char** filenames, int n, const char* backendName, uint64_t* key);
+int loadConfigCache(const char* filename, uint64_t key, AssertionsSet** set, Wiring** wiring, Calibration** calibration);
+int writeConfigCache(const char* filename, uint64_t key, AssertionsSet* set, Wiring* wiring, Calibration* calibration);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CACHE_H */
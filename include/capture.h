@@ -0,0 +1,60 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "truthtable.h"
+
+#define CAPTURE_MAGIC "EDSACSMP"
+#define CAPTURE_MAGIC_LEN 8
+#define CAPTURE_VERSION 1
+
+#define CAPTURE_RECORD_END 0
+#define CAPTURE_RECORD_FULL 1
+#define CAPTURE_RECORD_DELTA 2
+#define CAPTURE_RECORD_REPEAT 3
+#define CAPTURE_RECORD_TIME 4
+
+/*
+ * Writes samples in the binary capture format. The file starts with
+ * CAPTURE_MAGIC, the version, the number of columns and the TP name of each
+ * column. Each sample is then a record: the whole row packed one bit per
+ * column, the columns that changed since the previous sample, or a count of
+ * times the previous sample repeats. Whichever of the first two is smaller
+ * is written and runs of repeated samples become one record. A time record
+ * carries the monotonic time of the samples after it as the nanoseconds
+ * since the previous time record, or since 0 for the first.
+ */
+typedef struct {
+    FILE* file;
+    int nColumns;
+    int nRowBytes;
+    unsigned char* previous;
+    unsigned char* row;
+    unsigned char* record;
+    long nRepeats;
+    long nSamples;
+    long nBytes;
+    uint64_t timestamp;
+} CaptureWriter;
+
+CaptureWriter* createCaptureWriter(const char* filename, char* const* names, int nColumns);
+CaptureWriter* createCaptureWriterForFile(FILE* file, const char* filename, char* const* names, int nColumns);
+int captureWriterAppend(CaptureWriter* writer, const TruthWord* sample);
+int captureWriterAppendTime(CaptureWriter* writer, uint64_t timestamp);
+int captureWriterSync(CaptureWriter* writer);
+int closeCaptureWriter(CaptureWriter* writer);
+long readCaptureHeader(const unsigned char* p, size_t n, char*** names, int* nColumns);
+long decodeCaptureRecord(const unsigned char* p, size_t n, int nColumns, const int* indices, TruthWord* sample, long* nSamples, uint64_t* time);
+size_t captureMaxRecordSize(int nColumns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAPTURE_H */
@@ -6,8 +6,10 @@ extern "C"
 {
 #endif
 
+#include <stdint.h>
 #include <libxml/tree.h>
 #include "assertions.h"
+#include "backend.h"
 
 #define STREAM_A 1
 #define STREAM_B 2
@@ -22,19 +24,42 @@ typedef struct {
     float attenuation;
     ResitorLocation resistor;
 } Wire;
+/*
+ * Consecutive GPIO pins wired to consecutive TPs, copied from a level
+ * register to a packed sample with one shift and mask: the bits of mask
+ * shifted up by levelBit in register levelWord go to the bits from
+ * sampleBit of word sampleWord of the sample.
+ */
+typedef struct {
+    int levelWord;
+    int levelBit;
+    uint32_t mask;
+    int sampleWord;
+    int sampleBit;
+} WireRun;
 typedef struct {
     Wire** wires;
     int nWires;
+    int* tpWireIndices;
+    int nTp;
     int nResistorChips;
     int holdGpioPin;
+    WireRun* runs;
+    int nRuns;
+    uint32_t* levels;
+    int nLevelWords;
 } Wiring;
     
-void setupWiring();
-void teardownWiring();
+Wire* createWire(int tpIndex, int pin, float attenuation, int resistorChip, int resistorOnChip);
 int getIndexOfTPIndexInWiring(Wiring* wiring, int tpIndex);
-Wiring* createWiringFromXMLNode(AssertionsSet* assertionsSet, xmlNode* wiringNode);
+Wiring* createWiringFromXMLNode(SamplingBackend* backend, AssertionsSet* assertionsSet, xmlNode* wiringNode);
 void freeWiring(Wiring* wiring);
-void readInTPValues(Wiring* wiring, int* dest);
+int compareWirePins(const void* a, const void* b);
+void planWiringRuns(SamplingBackend* backend, Wiring* wiring);
+void setupWiringPins(SamplingBackend* backend, Wiring* wiring);
+void readInPackedTPValues(SamplingBackend* backend, Wiring* wiring, TruthWord* dest);
+void readInTPValuesByPin(SamplingBackend* backend, Wiring* wiring, int* dest);
+void readInTPValues(SamplingBackend* backend, Wiring* wiring, int* dest);
 void printWiring(AssertionsSet* assertionsSet, Wiring* wiring);
 
 #ifdef __cplusplus
@@ -0,0 +1,86 @@
+#ifndef FAULTS_H
+#define FAULTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "assertions.h"
+
+#ifndef FAULT_RENOTIFY_SECONDS
+#define FAULT_RENOTIFY_SECONDS 60
+#endif
+#ifndef FAULT_SUPPRESS_MS
+#define FAULT_SUPPRESS_MS 1000
+#endif
+
+#define FAULT_RAISED 0
+#define FAULT_CLEARED 1
+#define FAULT_RENOTIFIED 2
+
+/*
+ * The fault state of one valve: whether any of its TPs failed in the last
+ * sample, whether it was last reported failed and the TP it was registered
+ * on, when it was last reported and how often it changed since.
+ */
+typedef struct {
+    int valveNo;
+    int failing;
+    int reported;
+    int tp;
+    int seen;
+    int active;
+    uint64_t lastSent;
+    int sent;
+    long nChanges;
+} ValveFault;
+
+/*
+ * A message to send about a valve, with the number of changes of its state
+ * that were not sent since the last message about it.
+ */
+typedef struct {
+    int type;
+    int valveNo;
+    int tp;
+    long nSuppressed;
+} FaultEvent;
+
+/*
+ * Turns the failed TPs of each sample into raise and clear events per valve.
+ * A valve is raised when any TP of it fails and cleared when none do, and a
+ * valve that stays failed is reported again every renotifyNs, or never if
+ * it is 0. A change less than suppressNs after the last message about the
+ * valve is held back and counted, and the valve's state is sent once the
+ * window has passed if it still differs from what was last sent. Only the
+ * nActive valves listed in active, those failing or not yet reported clear,
+ * are looked at for each sample.
+ */
+typedef struct {
+    ValveFault* valves;
+    int nValves;
+    int* tpValves;
+    int* active;
+    int nActive;
+    FaultEvent* events;
+    uint64_t renotifyNs;
+    uint64_t suppressNs;
+    long nRaised;
+    long nCleared;
+    long nRenotified;
+    long nSuppressed;
+    long nFailures;
+} FaultTracker;
+
+FaultTracker* createFaultTracker(AssertionsSet* set, uint64_t renotifyNs, uint64_t suppressNs);
+int updateFaultTracker(FaultTracker* tracker, const int* errorIndices, int nErrors, uint64_t now);
+int pollFaultTracker(FaultTracker* tracker, uint64_t now);
+int flushFaultTracker(FaultTracker* tracker, uint64_t now);
+void freeFaultTracker(FaultTracker* tracker);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FAULTS_H */
@@ -0,0 +1,74 @@
+#ifndef GATES_H
+#define GATES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "truthtable.h"
+
+#define GATE_OP_AND 1
+#define GATE_OP_OR 2
+#define GATE_OP_NOT 3
+
+#ifndef GATE_CONE_MAX_ENTRIES
+#define GATE_CONE_MAX_ENTRIES (4L * 1024 * 1024)
+#endif
+
+/*
+ * One gate of a compiled circuit. Every instruction writes its own slot so a
+ * slot is only ever written once per evaluation. Slots 0 to nInputs - 1 hold
+ * the inputs.
+ */
+typedef struct {
+    int op;
+    int dst;
+    int a;
+    int b;
+} GateInstruction;
+
+/*
+ * A circuit compiled to a flat instruction stream. Instructions are ordered
+ * by level, the instructions from levelStarts[l] up to levelStarts[l + 1]
+ * only read inputs and slots written by earlier levels. Each slot is a
+ * TruthWord so 64 independent samples can be evaluated at once.
+ *
+ * The cone of input i, the instructions that depend on it in the order they
+ * run, is cones[coneStarts[i]] up to cones[coneStarts[i + 1]], and the
+ * outputs that depend on it are outputCones[outputConeStarts[i]] up to
+ * outputCones[outputConeStarts[i + 1]]. The cones are only built while they
+ * hold at most GATE_CONE_MAX_ENTRIES instructions and outputs in all,
+ * otherwise cones is NULL.
+ */
+typedef struct {
+    int nInputs;
+    int nOutputs;
+    int nSlots;
+    GateInstruction* code;
+    int nCode;
+    int* levelStarts;
+    int nLevels;
+    int* outputSlots;
+    int* coneStarts;
+    int* cones;
+    int* outputConeStarts;
+    int* outputCones;
+} GateProgram;
+
+GateProgram* createGateProgram(int nInputs, int nOutputs);
+void freeGateProgram(GateProgram* program);
+int gateProgramEmit(GateProgram* program, int op, int a, int b);
+void gateProgramLevelize(GateProgram* program);
+int gateProgramBuildCones(GateProgram* program);
+void gateProgramRun(GateProgram* program, TruthWord* slots);
+long gateProgramChangedConeSize(GateProgram* program, const TruthWord* last, const TruthWord* sample);
+void gateProgramCheckChanges(GateProgram* program, TruthWord* slots, TruthWord* pending, const TruthWord* last, const TruthWord* sample, const TruthWord* outputs, TruthWord* errors);
+int gateProgramCheck(GateProgram* program, TruthWord* slots, const int* samples, int* dest);
+void gateProgramCheckBatch(GateProgram* program, TruthWord* slots, const TruthWord* const* samples, int nSamples, TruthWord* errors);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GATES_H */
+
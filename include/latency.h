@@ -0,0 +1,81 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+#ifndef LATENCY_STALL_NS
+#define LATENCY_STALL_NS 1000000
+#endif
+#ifndef LATENCY_REPORT_SECONDS
+#define LATENCY_REPORT_SECONDS 60
+#endif
+
+/*
+ * A histogram of latencies in nanoseconds with the buckets of an HDR
+ * histogram: values below LATENCY_SUB_BUCKETS have a bucket each and every
+ * power of two above is split into LATENCY_SUB_BUCKETS buckets, so any value
+ * is known to within 1 part in LATENCY_SUB_BUCKETS. Values of at least
+ * stallNs are also counted as stalls.
+ */
+typedef struct {
+    const char* name;
+    uint64_t* counts;
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+    uint64_t stallNs;
+    uint64_t nStalls;
+} LatencyHistogram;
+
+/*
+ * The latencies of the stages of a loop run by one thread. Each stage has a
+ * histogram of the current period, which is added to the histogram of the
+ * whole run and cleared when it is reported every periodNs, and a histogram
+ * of the whole run, which is reported when the process receives SIGUSR1.
+ * Several threads may each have their own, and the reports of one with a
+ * name are headed with it.
+ */
+typedef struct {
+    const char* name;
+    int nStages;
+    LatencyHistogram** period;
+    LatencyHistogram** total;
+    LatencyHistogram* merged;
+    uint64_t periodNs;
+    uint64_t periodStart;
+    uint64_t start;
+    int dumpGeneration;
+} StageLatencies;
+
+uint64_t monotonicNanoseconds(void);
+
+LatencyHistogram* createLatencyHistogram(const char* name, uint64_t stallNs);
+void recordLatency(LatencyHistogram* histogram, uint64_t ns);
+void addLatencyHistogram(LatencyHistogram* dest, const LatencyHistogram* src);
+void clearLatencyHistogram(LatencyHistogram* histogram);
+uint64_t getLatencyPercentile(const LatencyHistogram* histogram, double percentile);
+void printLatencyHistogram(FILE* stream, const LatencyHistogram* histogram);
+void freeLatencyHistogram(LatencyHistogram* histogram);
+
+StageLatencies* createStageLatencies(const char** names, int nStages, uint64_t stallNs, long periodSeconds);
+void recordStageLatency(StageLatencies* latencies, int stage, uint64_t ns);
+void pollStageLatencies(StageLatencies* latencies, FILE* stream, uint64_t now);
+void printStageLatencies(StageLatencies* latencies, FILE* stream, uint64_t now);
+void freeStageLatencies(StageLatencies* latencies);
+int setupLatencySignal(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LATENCY_H */
@@ -0,0 +1,115 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+#include <libxml/tree.h>
+#include "assertions.h"
+#include "backend.h"
+#include "circuit.h"
+#include "faults.h"
+#include "latency.h"
+#include "network.h"
+#include "output.h"
+#include "recorder.h"
+#include "resistors.h"
+#include "ring.h"
+
+#ifndef MONITOR_BATCH_SIZE
+#define MONITOR_BATCH_SIZE 256
+#endif
+
+#define MONITOR_OVERRUN_REPORT_NS 1000000000L
+
+#define MONITOR_STAGE_QUEUEING 0
+#define MONITOR_STAGE_CHECKING 1
+#define MONITOR_STAGE_REPORTING 2
+#define MONITOR_N_STAGES 3
+
+#define MONITOR_SECTION_MISMATCH (FAULT_RENOTIFIED + 1)
+#define MONITOR_N_SECTIONS (FAULT_RENOTIFIED + 2)
+
+/*
+ * Where the configuration files of one chassis are: a directory and the
+ * names of the files within it. When the node monitors several chassis each
+ * has a name, which labels its faults, and may have a file its errors are
+ * echoed to instead of stdout.
+ */
+typedef struct {
+    char* name;
+    char* directory;
+    char* circuitFile;
+    char* wiringFile;
+    char* calibrationFile;
+    char* cacheFile;
+    char* outputFile;
+} ChassisConfig;
+
+/*
+ * The chassis a node monitors, read from a chassis list file.
+ */
+typedef struct {
+    ChassisConfig** chassis;
+    int nChassis;
+} ChassisList;
+
+/*
+ * One monitored chassis: its configuration and everything carried from one
+ * of its samples to the next. Monitors share only the network sender, which
+ * is safe to share, and the lock of an output written by several, so each
+ * checks its samples on a thread of its own. The thread sampling the backend
+ * reads every monitor's wiring in turn and queues each monitor's changed
+ * samples on that monitor's ring. primed is 0 until the first sample has been
+ * read, which is queued whatever it is.
+ */
+typedef struct {
+    const char* name;
+    char* label;
+    AssertionsSet* assertions;
+    Wiring* wiring;
+    Calibration* calibration;
+    NetworkHandle* network;
+    FaultTracker* tracker;
+    OutputSink* sink;
+    SampleChecker* checker;
+    Recorder* recorder;
+    SampleRing* ring;
+    StageLatencies* latencies;
+    char* faultSections[MONITOR_N_SECTIONS];
+    const TruthWord** batch;
+    uint64_t* timestamps;
+    TruthWord* results;
+    int* errorIndices;
+    TruthWord* sample;
+    TruthWord* lastSample;
+    int primed;
+    int dropped;
+    int started;
+    pthread_t thread;
+} Monitor;
+
+ChassisConfig* createChassisConfig(const char* name, const char* directory, const char* circuitFile, const char* wiringFile, const char* calibrationFile, const char* cacheFile, const char* outputFile);
+void freeChassisConfig(ChassisConfig* config);
+ChassisList* createChassisListFromXMLNode(xmlNode* listNode, const ChassisConfig* defaults);
+void freeChassisList(ChassisList* list);
+
+Monitor* createMonitor(const char* name, AssertionsSet* assertions, Wiring* wiring, Calibration* calibration, NetworkHandle* network, uint64_t renotifyNs, uint64_t suppressNs, OutputSink* sink);
+int checkMonitorPins(Monitor** monitors, int nMonitors);
+void sendMonitorFaults(Monitor* monitor, int nEvents, const TruthWord* mismatch);
+void flushMonitorFaults(Monitor* monitor, uint64_t now);
+void reportMonitorBatch(Monitor* monitor, const TruthWord** batch, const TruthWord* results, const uint64_t* timestamps, int n, uint64_t checked);
+void checkMonitorBatch(Monitor* monitor, const TruthWord** batch, const uint64_t* timestamps, int n);
+void sampleMonitor(Monitor* monitor, SamplingBackend* backend);
+int startMonitor(Monitor* monitor, const char* recordDirectory, long latencyPeriod);
+void stopMonitor(Monitor* monitor, long nRead);
+void freeMonitor(Monitor* monitor);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MONITOR_H */
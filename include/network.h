@@ -4,17 +4,97 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
-    
+
+#include <pthread.h>
 #include "edsac_representation.h"
 
 #define MAX_MSG_STR_LENGTH 200
 
+#define NETWORK_DROP_NEWEST 0
+#define NETWORK_DROP_OLDEST 1
+
+#ifndef NETWORK_QUEUE_MESSAGES
+#define NETWORK_QUEUE_MESSAGES 256
+#endif
+#ifndef NETWORK_BATCH_MESSAGES
+#define NETWORK_BATCH_MESSAGES 32
+#endif
+#ifndef NETWORK_DROP_POLICY
+#define NETWORK_DROP_POLICY NETWORK_DROP_OLDEST
+#endif
+#ifndef NETWORK_BACKOFF_MIN_MS
+#define NETWORK_BACKOFF_MIN_MS 100
+#endif
+#ifndef NETWORK_BACKOFF_MAX_MS
+#define NETWORK_BACKOFF_MAX_MS 10000
+#endif
+
+/*
+ * A fault waiting to be sent, with the number of times it was reported
+ * while it waited. The first keyLen characters of msg say which valves
+ * failed or cleared, the rest are details such as mismatch words that may
+ * differ between reports of the same fault.
+ */
+typedef struct {
+    int valveNo;
+    int count;
+    int keyLen;
+    char msg[MAX_MSG_STR_LENGTH];
+} QueuedFault;
+
+/*
+ * Sends faults to the mothership from a background thread. Faults are queued
+ * in a ring of NETWORK_QUEUE_MESSAGES and taken NETWORK_BATCH_MESSAGES at a
+ * time, which are packed into as few messages as MAX_MSG_STR_LENGTH allows.
+ * A fault reporting the same valves failing or clearing as the fault queued
+ * last is coalesced into it, taking its details. When the queue is full of other faults the oldest or the newest fault
+ * is dropped, as NETWORK_DROP_POLICY chooses. When a send fails the sender
+ * reconnects, waiting twice as long after each failure from
+ * NETWORK_BACKOFF_MIN_MS up to NETWORK_BACKOFF_MAX_MS, and sends the fault
+ * again. Queueing never waits for the network.
+ */
 typedef struct {
     Message* msgStruct;
+    struct sockaddr* address;
+    QueuedFault* queue;
+    QueuedFault* batch;
+    int head;
+    int nQueued;
+    long nSent;
+    long nMessages;
+    long nCoalesced;
+    long nDropped;
+    long nReconnects;
+    int connected;
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_t thread;
 } NetworkHandle;
 
+/*
+ * A message listing several faults, built up from items in sections. Each
+ * section starts with its heading and the items follow it separated by
+ * spaces. An item that would not fit in MAX_MSG_STR_LENGTH sends the message
+ * so far and starts another, which repeats the heading. The message is sent
+ * as from the valve of its first item. Details follow the faults, keyLen
+ * being where the first starts or -1 if there are none.
+ */
+typedef struct {
+    char text[MAX_MSG_STR_LENGTH];
+    int len;
+    int keyLen;
+    int valveNo;
+    const char* section;
+    int nSent;
+} FaultMessage;
+
 NetworkHandle* setupNetwork(const char* addrStr, int port);
-int sendNetworkMessage(NetworkHandle* network, int valveNo, char* msg);
+int sendNetworkMessage(NetworkHandle* network, int valveNo, char* msg, int keyLen);
+void startFaultMessage(FaultMessage* message);
+void appendFaultMessage(NetworkHandle* network, FaultMessage* message, const char* section, int valveNo, const char* item);
+void appendFaultDetail(NetworkHandle* network, FaultMessage* message, const char* section, const char* item);
+int finishFaultMessage(NetworkHandle* network, FaultMessage* message);
 void teardownNetwork(NetworkHandle* network);
 
 #ifdef __cplusplus
@@ -22,4 +102,3 @@ void teardownNetwork(NetworkHandle* network);
 #endif
 
 #endif /* NETWORK_H */
-
@@ -0,0 +1,77 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stddef.h>
+#include "assertions.h"
+
+#define OUTPUT_FORMAT_TEXT "text"
+#define OUTPUT_FORMAT_JSON "json"
+#define OUTPUT_FORMAT_BINARY "binary"
+
+#define OUTPUT_BINARY_MAGIC "EDSACOUT"
+#define OUTPUT_BINARY_MAGIC_LEN 8
+#define OUTPUT_BINARY_VERSION 1
+
+#ifndef OUTPUT_BUFFER_BYTES
+#define OUTPUT_BUFFER_BYTES (1024 * 1024)
+#endif
+
+/*
+ * Where echo mode writes each sample that has errors, in one of three
+ * formats:
+ *
+ * text, a "Data:" line of the TP values, a count of errors and an
+ * "Error[j]" line per failed TP naming its valve and TP.
+ *
+ * json, one object per line, {"values":"0110...","errors":[{"tp":"O2",
+ * "valve":84},...]}, the values being one character per TP.
+ *
+ * binary, OUTPUT_BINARY_MAGIC, the version, the number of TPs and the name
+ * and valve of each TP, then a record per sample of the number of errors,
+ * the sample packed as TruthWords and the index of each failed TP. Names are
+ * a 16 bit length and their bytes and all numbers are little endian, 16, 32
+ * or 64 bits as described.
+ *
+ * The text of every TP's error is formatted when the sink is created and
+ * samples are copied into a buffer of OUTPUT_BUFFER_BYTES that is written
+ * to fd when full, so nothing is formatted or written per sample.
+ *
+ * Several sinks may write to the same fd, each holding lock while it
+ * writes its buffer, which only ever holds whole samples. The samples of a
+ * sink with a label are marked with it, by a "Chassis:" line before each
+ * text sample or a "chassis" member of each json object.
+ */
+typedef struct OutputSink {
+    const char* name;
+    void (*writeSample)(struct OutputSink* sink, const TruthWord* sample, const int* errorIndices, int nErrors);
+    int fd;
+    pthread_mutex_t* lock;
+    char* label;
+    int labelLen;
+    char* buffer;
+    size_t size;
+    size_t len;
+    int failed;
+    int nTp;
+    int nSampleWords;
+    char** errorTexts;
+    int* errorTextLens;
+    int maxErrorTextLen;
+} OutputSink;
+
+OutputSink* createOutputSink(const char* name, AssertionsSet* set, int fd);
+void labelOutputSink(OutputSink* sink, const char* label, pthread_mutex_t* lock);
+void outputSample(OutputSink* sink, const TruthWord* sample, const int* errorIndices, int nErrors);
+int flushOutputSink(OutputSink* sink);
+int freeOutputSink(OutputSink* sink);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,68 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include <stdint.h>
+#include "assertions.h"
+#include "capture.h"
+#include "latency.h"
+
+#ifndef RECORD_SEGMENTS
+#define RECORD_SEGMENTS 8
+#endif
+#ifndef RECORD_SEGMENT_BYTES
+#define RECORD_SEGMENT_BYTES (16L * 1024 * 1024)
+#endif
+#ifndef RECORD_QUEUE_SAMPLES
+#define RECORD_QUEUE_SAMPLES 4096
+#endif
+#define RECORD_SEGMENT_FORMAT "segment-%02d.cap"
+
+/*
+ * Records timestamped samples to a ring of nSegments capture files in
+ * directory, each preallocated to segmentBytes. When a segment is full the
+ * next one is overwritten from its start. Every segment is a complete
+ * capture that begins with the last sample of the segment before it, so
+ * replaying it checks the same samples that were checked while recording.
+ *
+ * Samples are queued in a ring of nQueueSamples slots and written by a
+ * background thread. A sample that arrives while the queue is full is
+ * dropped and counted rather than waiting for the disk.
+ */
+typedef struct {
+    char* directory;
+    char** names;
+    int nColumns;
+    int nSampleWords;
+    int nSegments;
+    long segmentBytes;
+    int segment;
+    CaptureWriter* writer;
+    TruthWord* lastSample;
+    uint64_t lastTimestamp;
+    TruthWord* queue;
+    uint64_t* timestamps;
+    int nQueueSamples;
+    long head;
+    long tail;
+    long nDropped;
+    int stopping;
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_t thread;
+} Recorder;
+
+Recorder* createRecorder(const char* directory, AssertionsSet* set, int nSegments, long segmentBytes);
+int recorderAppend(Recorder* recorder, const TruthWord* sample, uint64_t timestamp);
+void freeRecorder(Recorder* recorder);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RECORDER_H */
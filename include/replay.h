@@ -0,0 +1,61 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pthread.h>
+#include "assertions.h"
+#include "monitor.h"
+#include "samples.h"
+
+#ifndef REPLAY_CHUNK_BYTES
+#define REPLAY_CHUNK_BYTES (8L * 1024 * 1024)
+#endif
+#ifndef REPLAY_MAX_THREADS
+#define REPLAY_MAX_THREADS 16
+#endif
+
+/*
+ * A run of consecutive samples of a replayed file, copied out of the file's
+ * window so it can be checked on a thread of its own while the next runs
+ * are checked on others. previous is the last sample of the run before, so
+ * the samples that changed are found as if the file were checked in one go.
+ * primed is 0 for the first run of the file, which has no sample before it,
+ * so its first sample is always checked. Sample i was taken at times[i].
+ * Checking leaves a pointer to each of the nChanged changed samples in
+ * changed, its time in changedTimes and its error mask in results.
+ * started is set while the chunk is being checked on thread.
+ */
+typedef struct {
+    AssertionsSet* assertions;
+    SampleChecker* checker;
+    int nSampleWords;
+    int nMaskWords;
+    long maxSamples;
+    long nSamples;
+    TruthWord* samples;
+    uint64_t* times;
+    TruthWord* previous;
+    int primed;
+    const TruthWord** changed;
+    uint64_t* changedTimes;
+    long nChanged;
+    TruthWord* results;
+    pthread_t thread;
+    int started;
+} ReplayChunk;
+
+ReplayChunk* createReplayChunk(AssertionsSet* set, long maxSamples);
+long fillReplayChunk(ReplayChunk* chunk, Samples* samples, TruthWord* lastSample, int primed);
+void* checkReplayChunk(void* arg);
+void freeReplayChunk(ReplayChunk* chunk);
+int getReplayThreads(int requested);
+void replaySamples(Monitor* monitor, Samples* samples, int nThreads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REPLAY_H */
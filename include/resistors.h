@@ -7,6 +7,7 @@ extern "C" {
     
 #include <stdint.h>
 #include <libxml/tree.h>
+#include "backend.h"
     
 typedef struct {
     int wireIndex;
@@ -18,14 +19,15 @@ typedef struct {
     int nThresholds;
 } Calibration;
     
-void setupResistors(int channel, int speed);
-void teardownResistors();
+int setupResistors(SamplingBackend* backend, int channel, int speed);
+void teardownResistors(SamplingBackend* backend);
+Threshold* createThreshold(int wiringIndex, float value);
 Calibration* createCalibrationFromXMLNode(AssertionsSet* set, Wiring* wiring, xmlNode* calibrateNode);
 void freeCalibration(Calibration* callibration);
 void printCalibration(AssertionsSet* set, Wiring* wiring, Calibration* calibration);
-void writeOutCalibration(int spiChannel, Wiring* wiring, Calibration* calibration);
+void writeOutCalibration(SamplingBackend* backend, int spiChannel, Wiring* wiring, Calibration* calibration);
 int setThresholdForTPIndex(Wiring* wiring, Calibration* calibration, int tpIndex, float threshold);
-int setAndWriteThresholdForTPIndex(int spiChannel, Wiring* wiring, Calibration* calibration, int tpIndex, float threshold);
+int setAndWriteThresholdForTPIndex(SamplingBackend* backend, int spiChannel, Wiring* wiring, Calibration* calibration, int tpIndex, float threshold);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,60 @@
+#ifndef RING_H
+#define RING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "truthtable.h"
+
+#ifndef SAMPLE_RING_SLOTS
+#define SAMPLE_RING_SLOTS 16384
+#endif
+#ifndef SAMPLE_RING_IDLE_NS
+#define SAMPLE_RING_IDLE_NS 50000
+#endif
+#define SAMPLE_RING_CACHE_LINE 64
+
+/*
+ * A lock free ring of nSlots timestamped packed samples passed from one
+ * producer thread to one consumer thread. The producer reserves the slot at
+ * head, fills it and publishes it; the consumer reads the slots from tail to
+ * head and releases them. Each side keeps a copy of the other's index and
+ * only reloads it when the ring looks full or empty, and the indices are on
+ * cache lines of their own, so the threads rarely touch the same line.
+ *
+ * The producer never waits for the consumer: a sample that arrives while
+ * the ring is full is dropped, and the producer counts it in nOverruns.
+ */
+typedef struct {
+    int nSampleWords;
+    long nSlots;
+    TruthWord* samples;
+    uint64_t* timestamps;
+    long head __attribute__((aligned(SAMPLE_RING_CACHE_LINE)));
+    long producerTail;
+    long nPushed;
+    long nOverruns;
+    int closed;
+    long tail __attribute__((aligned(SAMPLE_RING_CACHE_LINE)));
+    long consumerHead;
+    long maxDepth;
+} SampleRing;
+
+SampleRing* createSampleRing(int nSampleWords, long nSlots);
+TruthWord* sampleRingReserve(SampleRing* ring);
+void sampleRingPublish(SampleRing* ring, uint64_t timestamp);
+void sampleRingOverrun(SampleRing* ring);
+void sampleRingClose(SampleRing* ring);
+long sampleRingPeek(SampleRing* ring, const TruthWord** samples, uint64_t* timestamps, long max);
+void sampleRingRelease(SampleRing* ring, long n);
+int sampleRingFinished(SampleRing* ring);
+long sampleRingOverruns(SampleRing* ring);
+void freeSampleRing(SampleRing* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RING_H */
@@ -7,16 +7,62 @@ extern "C" {
 
 #include "circuit.h"
     
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef SAMPLES_UNTIMED_PERIOD_NS
+#define SAMPLES_UNTIMED_PERIOD_NS 1000000L
+#endif
+    
+/*
+ * A sample file being replayed, either csv or a binary capture. The file is
+ * read in blocks into buffer, of which bytes start to end are not yet
+ * parsed. A capture decodes into previous, which repeats nRepeats more
+ * times. Samples are parsed a window at a time, the current sample is row
+ * index of the nWindowRows rows in window. Each row is nSampleWords words
+ * with TP i in bit i % 64 of word i / 64, taken at the time in the same row
+ * of times: that of the last time record of a capture, or for samples
+ * without one SAMPLES_UNTIMED_PERIOD_NS apart from 0. nRead samples have
+ * been put in windows so far.
+ */
 typedef struct {
+    int fd;
+    char* filename;
+    char* buffer;
+    size_t bufferSize;
+    size_t start;
+    size_t end;
+    int eof;
+    int line;
+    int nTp;
+    int nSampleWords;
+    int* indices;
+    TruthWord* window;
+    uint64_t* times;
+    int nWindowRows;
     int index;
-    int** data;
-    int nSamplePoints;
+    int failed;
+    const char** lineStarts;
+    const char** lineEnds;
+    int* lineNumbers;
+    int nThreads;
+    int isCapture;
+    int captureEnded;
+    TruthWord* previous;
+    long nRepeats;
+    uint64_t time;
+    int timed;
+    long nRead;
 } Samples;
 
 Samples* createSamplesFromFile(AssertionsSet* set, const char* filename);
 void freeSamples(Samples* samples);
 int samplesNext(Samples* samples);
-void samplesGetValues(Wiring* wiring, Samples* samples, int* dest);
+int samplesFailed(Samples* samples);
+int samplesGetBatch(Samples* samples, const TruthWord** dest, uint64_t* times, int maxN);
+const TruthWord* samplesGetView(Samples* samples);
+void samplesGetValues(Samples* samples, int* dest);
+void samplesGetPackedValues(Samples* samples, TruthWord* dest);
     
 #ifdef __cplusplus
 }
@@ -0,0 +1,55 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "backend.h"
+
+#ifndef SIMULATOR_PINS
+#define SIMULATOR_PINS 65536
+#endif
+#ifndef SIMULATOR_SEED
+#define SIMULATOR_SEED 1
+#endif
+#ifndef SIMULATOR_FLIP_PERIOD
+#define SIMULATOR_FLIP_PERIOD 16
+#endif
+
+/*
+ * A software GPIO header of nPins pins, where physical pin p is GPIO pin p.
+ * Pin levels are kept one bit per pin. Driving an output pin low holds the
+ * inputs: the levels are latched and reads return the latched levels until
+ * it is driven high again. Every flipPeriod holds one input pin, chosen by a
+ * xorshift generator, changes level, so the monitor sees a steady stream of
+ * changed samples. SPI writes are only counted. The levels can also be read
+ * at once as a block of 32 bit level registers, as on a Raspberry Pi.
+ */
+typedef struct {
+    int nPins;
+    uint64_t* levels;
+    uint64_t* latched;
+    int* modes;
+    int* inputPins;
+    int nInputPins;
+    int held;
+    uint64_t random;
+    long flipPeriod;
+    long nHolds;
+    long nReads;
+    long nLevelReads;
+    long nSPIWrites;
+    long nSPIBytes;
+} Simulator;
+
+SamplingBackend* createSimulatorBackend(int nPins, uint64_t seed, long flipPeriod);
+Simulator* getSimulator(SamplingBackend* backend);
+void simulatorSetPin(SamplingBackend* backend, int pin, int value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIMULATOR_H */
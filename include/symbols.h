@@ -0,0 +1,30 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * An open addressing hash table from names to integer ids. Names are copied
+ * into the table when they are inserted.
+ */
+typedef struct {
+    char** names;
+    int* ids;
+    unsigned int* hashes;
+    int capacity;
+    int n;
+} SymbolTable;
+
+SymbolTable* createSymbolTable(int expected);
+void freeSymbolTable(SymbolTable* table);
+int symbolTableInsert(SymbolTable* table, const char* name, int id);
+int symbolTableFind(SymbolTable* table, const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SYMBOLS_H */
+
@@ -0,0 +1,76 @@
+#ifndef TRUTHTABLE_H
+#define TRUTHTABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint64_t TruthWord;
+
+#define TRUTH_WORD_BITS 64
+#define TRUTH_WORDS_FOR_BITS(n) (((n) + TRUTH_WORD_BITS - 1) / TRUTH_WORD_BITS)
+#define TRUTH_TABLE_MAX_INPUTS 30
+#ifndef TRUTH_TABLE_MAX_BYTES
+#define TRUTH_TABLE_MAX_BYTES (16L * 1024 * 1024)
+#endif
+
+/*
+ * One bit per row of a truth table, row r in bit r % 64 of word r / 64.
+ * Columns are shared by reference count and must be unshared before being
+ * modified.
+ */
+typedef struct {
+    int refCount;
+    int nWords;
+    TruthWord* words;
+} TruthColumn;
+
+/*
+ * A compiled truth table. Row r is the combination of inputs where input i
+ * is (r >> i) & 1, so a row index is built straight from the input bits.
+ * Each row holds the expected value of every output packed one bit per
+ * output into nRowWords words. A table loaded from a file may have its rows
+ * in a mapping of that file, which is unmapped when the table is freed.
+ */
+typedef struct {
+    int nInputs;
+    int nOutputs;
+    int nRowWords;
+    TruthWord* rows;
+    void* mapping;
+    size_t mappingSize;
+} TruthTable;
+
+void packBits(const int* values, int n, TruthWord* dest);
+void unpackBits(const TruthWord* src, int n, int* dest);
+void extractBits(const TruthWord* src, int start, int n, TruthWord* dest);
+void transposeBits64(TruthWord* block);
+
+int truthColumnWords(int nInputs);
+TruthColumn* createInputTruthColumn(int nInputs, int inputIndex);
+TruthColumn* retainTruthColumn(TruthColumn* column);
+void releaseTruthColumn(TruthColumn* column);
+TruthColumn* unshareTruthColumn(TruthColumn* column);
+void truthColumnAnd(TruthColumn* dst, const TruthColumn* src);
+void truthColumnOr(TruthColumn* dst, const TruthColumn* src);
+void truthColumnNot(TruthColumn* dst);
+
+int truthTableFits(int nInputs, int nOutputs);
+TruthTable* createTruthTable(int nInputs, int nOutputs);
+TruthTable* createMappedTruthTable(int nInputs, int nOutputs, TruthWord* rows, void* mapping, size_t mappingSize);
+void freeTruthTable(TruthTable* table);
+void truthTableSetColumn(TruthTable* table, int output, const TruthColumn* column);
+int truthTableGet(TruthTable* table, int row, int output);
+int truthTableRowForInputs(TruthTable* table, const int* inputs);
+int truthTableCheck(TruthTable* table, const int* samples, int* dest);
+void truthTableCheckPacked(TruthTable* table, const TruthWord* sample, TruthWord* errors);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRUTHTABLE_H */
+
@@ -6,12 +6,15 @@ extern "C" {
 #endif
 
 #include <stdarg.h>
+#include "symbols.h"
     
 int strEqual(const xmlChar* str1, const char* str2);
 int nodePropScanf(xmlNode* node, const char* propName, const char* format, ...);
 int nodePropAsInteger(xmlNode* node, const char* propName);
 float nodePropAsFloat(xmlNode* node, const char* propName);
 int nodePropEqual(xmlNode* node, const char* propName, const char* str2);
+const xmlChar* nodePropPeek(xmlNode* node, const char* propName);
+int nodePropLookup(xmlNode* node, const char* propName, SymbolTable* table);
 int nodeHasElementChildren(xmlNode* node);
 
 #ifdef __cplusplus
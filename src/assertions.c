@@ -6,6 +6,8 @@
 #include <libxml/tree.h>
 #include <libxml/xmlstring.h>
 #include "assertions.h"
+#include "gates.h"
+#include "truthtable.h"
 #include "xmlutil.h"
 #include "tables.h"
     
@@ -33,91 +35,109 @@
 #define TP_TABLE_HEADER_VALVE_NO "Valve No.";
 #define TP_TABLE_HEADER_MIN_V "Minimum (V)";
 #define TP_TABLE_HEADER_MAX_V "Maximum (V)";
+#define TP_TABLE_HEADER_LEVEL "Level";
+
+#define SLOT_NOT_COMPILED -1
+#define SLOT_COMPILING -2
+
+typedef struct {
+    int tpIndex;
+    int slot;
+    int valveNo;
+    TruthColumn* truth;
+} CompiledNode;
 
 NodeIdMap* createNodeIdMap() {
     NodeIdMap* map = malloc(sizeof(NodeIdMap));
     map->inputTpNodes = NULL;
     map->nInputs = 0;
+    map->inputIds = createSymbolTable(0);
     map->nodes = NULL;
-    map->n;
+    map->n = 0;
+    map->ids = createSymbolTable(0);
     return map;
 };
 
-void addNodeToIdMap(NodeIdMap* map, xmlNode* node) {
+/*
+ * Returns -1 if another node in the map already has the same id.
+ */
+int addNodeToIdMap(NodeIdMap* map, xmlNode* node) {
+    xmlChar* id = xmlGetProp(node, ATTR_NAME_ID);
+    int existing = symbolTableInsert(map->ids, (const char*) id, map->n);
+    xmlFree(id);
+    if(existing >= 0) {
+        return -1;
+    }
     map->nodes = realloc(map->nodes, (map->n + 1) * sizeof(xmlNode*));
     map->nodes[map->n] = node;
     map->n++;
+    return 1;
 }
 
 xmlNode* findNodeInMap(NodeIdMap* map, char* id) {
-    int i;
-    for(i = 0; i < map->n; i++) {
-        if(nodePropEqual(map->nodes[i], ATTR_NAME_ID, id)) {
-            return map->nodes[i];
-        }
+    int i = symbolTableFind(map->ids, id);
+    if(i < 0) {
+        fprintf(stderr, "No such node id found \"%s\"\n", id);
+        return NULL;
     }
-    fprintf(stderr, "No such node id found \"%s\"\n", id);
-    return NULL;
+    return map->nodes[i];
 }
 
 void addInputNodeToIdMap(NodeIdMap* map, xmlNode* node) {
+    xmlChar* id;
     map->inputTpNodes = realloc(map->inputTpNodes, (map->nInputs + 1) * sizeof(char*));
     map->inputTpNodes[map->nInputs] = node;
+    if(xmlHasProp(node, ATTR_NAME_ID)) {
+        id = xmlGetProp(node, ATTR_NAME_ID);
+        symbolTableInsert(map->inputIds, (const char*) id, map->nInputs);
+        xmlFree(id);
+    }
     map->nInputs++;
 }
 
 int findInputIndexInMap(NodeIdMap* map, xmlNode* node) {
-    int i;
-    for(i = 0; i < map->nInputs; i++) {
-        if(map->inputTpNodes[i] == node) {
-            return i;
-        }
+    int i = nodePropLookup(node, ATTR_NAME_ID, map->inputIds);
+    if(i < 0 || map->inputTpNodes[i] != node) {
+        fprintf(stderr, "No such input found\n");
+        return -1;
     }
-    fprintf(stderr, "No such input found\n");
-    return -1;
+    return i;
 }
 
 void freeNodeIdMap(NodeIdMap* map) {
     if(map != NULL) {
         free(map->inputTpNodes);
+        freeSymbolTable(map->inputIds);
         free(map->nodes);
+        freeSymbolTable(map->ids);
         free(map);
     }
 }
 
 int getIndexOfTPByName(AssertionsSet* set, const char* name) {
-    int i;
-    for(i = 0; i < set->nTp; i++) {
-        if(strcmp(set->tps[i]->tpName, name) == 0) {
-            return i;
-        }
-    }
-    return -1;
+    return symbolTableFind(set->symbols, name);
 }
 
 int getIndexOfTPNodeInSet(AssertionsSet* set, xmlNode* node) {
-    int i;
-    for(i = 0; i < set->nTp; i++) {
-        if(nodePropEqual(node, ATTR_NAME_ID, set->tps[i]->tpName)) {
-            return i;
-        }
-    }
-    return -1;
+    return nodePropLookup(node, ATTR_NAME_ID, set->symbols);
 }
 
-int* parseNode(xmlNode* node, NodeIdMap* map, int* depthOut, int* valveNoOut) {
+TruthColumn* parseNode(xmlNode* node, NodeIdMap* map, int* valveNoOut) {
     xmlNode* child = node->children;
+    xmlNode* refNode;
     xmlChar* contents = NULL;
-    int i, op = -1, inputIndex;
-    int* truth = NULL; 
-    int* truth2 = NULL;
-    int depth1, depth2;
+    CompiledNode* compiled;
+    int op = -1, inputIndex;
+    TruthColumn* truth = NULL; 
+    TruthColumn* truth2 = NULL;
     if(strEqual(node->name, NODE_NAME_REF)) {
         contents = xmlNodeListGetString(node->doc, node->children, 1);
-        truth = parseNode(findNodeInMap(map, contents), map, depthOut, valveNoOut);
-        assert(truth != NULL);
+        refNode = findNodeInMap(map, contents);
         xmlFree(contents);
-        return truth;
+        if(refNode == NULL) {
+            return NULL;
+        }
+        return parseNode(refNode, map, valveNoOut);
     } else if(strEqual(node->name, NODE_NAME_AND) || strEqual(node->name, NODE_NAME_OR) || 
             strEqual(node->name, NODE_NAME_NOT)) {
         
@@ -136,30 +156,30 @@ int* parseNode(xmlNode* node, NodeIdMap* map, int* depthOut, int* valveNoOut) {
             child = child->next;
         }
         if(child) {
-            truth = parseNode(child, map, &depth1, NULL);
+            truth = parseNode(child, map, NULL);
             assert(truth != NULL);
+            // The first operand may be a TP's shared column so it is copied
+            // before being combined with the rest
+            truth = unshareTruthColumn(truth);
             if(op == OP_NOT) {
-                for(i = 0; i < (1 << map->nInputs); i++) {
-                    truth[i] = !truth[i];
-                }
+                truthColumnNot(truth);
             }
             child = child->next;
             while(child) {
                 if(child->type == XML_ELEMENT_NODE) {
-                    truth2 = parseNode(child, map, &depth2, NULL);
+                    if(op == OP_NOT) {
+                        fprintf(stderr, "Not operator can only have one param\n");
+                        releaseTruthColumn(truth);
+                        return NULL;
+                    }
+                    truth2 = parseNode(child, map, NULL);
                     assert(truth2 != NULL);
-                    depth1 = fmax(depth1, depth2);
-                    for(i = 0; i < (1 << map->nInputs); i++) {
-                        if(op == OP_AND) {
-                            truth[i] = truth[i] && truth2[i];
-                        } else if(op == OP_OR) {
-                            truth[i] = truth[i] || truth2[i];
-                        } else if(op == OP_NOT) {
-                            fprintf(stderr, "Not operator can only have one param\n");
-                            return NULL;
-                        }
+                    if(op == OP_AND) {
+                        truthColumnAnd(truth, truth2);
+                    } else if(op == OP_OR) {
+                        truthColumnOr(truth, truth2);
                     }
-                    free(truth2);
+                    releaseTruthColumn(truth2);
                 }
                 child = child->next;
             }
@@ -168,33 +188,39 @@ int* parseNode(xmlNode* node, NodeIdMap* map, int* depthOut, int* valveNoOut) {
                 *valveNoOut = atoi(contents);
                 xmlFree(contents);
             }
-            *depthOut = depth1 + 1;
             return truth;
         } else {
             fprintf(stderr, "Operator node has no params\n");
             return NULL;
         }
     } else if(strEqual(node->name, NODE_NAME_TP)) {
-        while(child) {
-            if(child->type == XML_ELEMENT_NODE) {
-                truth = parseNode(child, map, depthOut, valveNoOut);
-                assert(truth != NULL);
-                return truth;
+        // A TP's column is built once and shared with every TP that refers to it
+        compiled = node->_private;
+        assert(compiled != NULL);
+        if(compiled->truth != NULL) {
+            if(valveNoOut != NULL) {
+                *valveNoOut = compiled->valveNo;
             }
-            child = child->next;
+            return retainTruthColumn(compiled->truth);
         }
-        inputIndex = findInputIndexInMap(map, node);
-        if(inputIndex < 0) {
-            fprintf(stderr, "TP has no child nodes but isn't an indexed input\n");
-            return NULL;
+        while(child != NULL && child->type != XML_ELEMENT_NODE) {
+            child = child->next;
         }
-        truth = malloc((1 << map->nInputs) * sizeof(int));
-        for(i = 0; i < (1 << map->nInputs); i++) {
-            truth[i] = (i & (1 << inputIndex)) != 0;
+        if(child) {
+            truth = parseNode(child, map, &compiled->valveNo);
+            assert(truth != NULL);
+        } else {
+            inputIndex = findInputIndexInMap(map, node);
+            if(inputIndex < 0) {
+                fprintf(stderr, "TP has no child nodes but isn't an indexed input\n");
+                return NULL;
+            }
+            truth = createInputTruthColumn(map->nInputs, inputIndex);
+            compiled->valveNo = -1;
         }
-        *depthOut = 0;
+        compiled->truth = retainTruthColumn(truth);
         if(valveNoOut != NULL) {
-            *valveNoOut = -1;
+            *valveNoOut = compiled->valveNo;
         }
         return truth;
     } else {
@@ -203,7 +229,114 @@ int* parseNode(xmlNode* node, NodeIdMap* map, int* depthOut, int* valveNoOut) {
     }
 }
 
-TestPoint* createTestPointFromXMLNode(xmlNode* tpNode, int* truthTable, int valveNo) {
+int compileNode(xmlNode* node, NodeIdMap* map, GateProgram* program, int* valveNoOut) {
+    xmlNode* child = node->children;
+    xmlNode* refNode;
+    xmlChar* contents = NULL;
+    CompiledNode* compiled;
+    int i, op = -1, nOperands, slot;
+    int* operands = NULL;
+    if(strEqual(node->name, NODE_NAME_REF)) {
+        contents = xmlNodeListGetString(node->doc, node->children, 1);
+        refNode = findNodeInMap(map, contents);
+        xmlFree(contents);
+        if(refNode == NULL) {
+            return -1;
+        }
+        return compileNode(refNode, map, program, valveNoOut);
+    } else if(strEqual(node->name, NODE_NAME_AND) || strEqual(node->name, NODE_NAME_OR) || 
+            strEqual(node->name, NODE_NAME_NOT)) {
+        
+        if(strEqual(node->name, NODE_NAME_AND)) {
+            op = GATE_OP_AND;
+        } else if(strEqual(node->name, NODE_NAME_OR)) {
+            op = GATE_OP_OR;
+        } else if(strEqual(node->name, NODE_NAME_NOT)) {
+            op = GATE_OP_NOT;
+        }
+        if(!xmlHasProp(node, ATTR_NAME_VALVE_NO)) {
+            fprintf(stderr, "%s node has no valveNo\n", node->name);
+            return -1;
+        }
+        nOperands = 0;
+        for(; child != NULL; child = child->next) {
+            if(child->type != XML_ELEMENT_NODE) {
+                continue;
+            }
+            if(op == GATE_OP_NOT && nOperands > 0) {
+                fprintf(stderr, "Not operator can only have one param\n");
+                free(operands);
+                return -1;
+            }
+            slot = compileNode(child, map, program, NULL);
+            if(slot < 0) {
+                free(operands);
+                return -1;
+            }
+            assert((operands = realloc(operands, sizeof(int) * (nOperands + 1))) != NULL);
+            operands[nOperands++] = slot;
+        }
+        if(nOperands == 0) {
+            fprintf(stderr, "Operator node has no params\n");
+            return -1;
+        }
+        if(op == GATE_OP_NOT) {
+            slot = gateProgramEmit(program, op, operands[0], -1);
+        } else {
+            // Combine operands pairwise to keep the number of levels down
+            while(nOperands > 1) {
+                for(i = 0; i + 1 < nOperands; i += 2) {
+                    operands[i / 2] = gateProgramEmit(program, op, operands[i], operands[i + 1]);
+                }
+                if(nOperands % 2) {
+                    operands[nOperands / 2] = operands[nOperands - 1];
+                }
+                nOperands = (nOperands + 1) / 2;
+            }
+            slot = operands[0];
+        }
+        free(operands);
+        if(valveNoOut != NULL) {
+            *valveNoOut = nodePropAsInteger(node, ATTR_NAME_VALVE_NO);
+        }
+        return slot;
+    } else if(strEqual(node->name, NODE_NAME_TP)) {
+        // Every TP node carries a CompiledNode so shared references compile once
+        compiled = node->_private;
+        assert(compiled != NULL);
+        if(compiled->slot == SLOT_COMPILING) {
+            contents = xmlGetProp(node, ATTR_NAME_ID);
+            fprintf(stderr, "TP \"%s\" refers to itself\n", contents);
+            xmlFree(contents);
+            return -1;
+        }
+        if(compiled->slot == SLOT_NOT_COMPILED) {
+            compiled->slot = SLOT_COMPILING;
+            compiled->valveNo = -1;
+            while(child != NULL && child->type != XML_ELEMENT_NODE) {
+                child = child->next;
+            }
+            if(child) {
+                slot = compileNode(child, map, program, &compiled->valveNo);
+            } else {
+                slot = findInputIndexInMap(map, node);
+                if(slot < 0) {
+                    fprintf(stderr, "TP has no child nodes but isn't an indexed input\n");
+                }
+            }
+            compiled->slot = slot;
+        }
+        if(valveNoOut != NULL) {
+            *valveNoOut = compiled->valveNo;
+        }
+        return compiled->slot;
+    } else {
+        fprintf(stderr, "Unknown node type \"%s\"\n", node->name);
+        return -1;
+    }
+}
+
+TestPoint* createTestPointFromXMLNode(xmlNode* tpNode, int valveNo) {
     TestPoint* tp;
     xmlChar* tempStr;
     if(!xmlHasProp(tpNode, ATTR_NAME_ID)) {
@@ -220,7 +353,6 @@ TestPoint* createTestPointFromXMLNode(xmlNode* tpNode, int* truthTable, int valv
     }
     tp = malloc(sizeof(TestPoint));
     tp->valveNo = valveNo;
-    tp->truth = truthTable;
     tempStr = xmlGetProp(tpNode, ATTR_NAME_ID);
     tp->tpName = strcpy(malloc((xmlStrlen(tempStr)+1) * sizeof(char)), tempStr);
     free(tempStr);
@@ -232,22 +364,208 @@ TestPoint* createTestPointFromXMLNode(xmlNode* tpNode, int* truthTable, int valv
 void freeTestPoint(TestPoint* tp) {
     if(tp != NULL) {
         free(tp->tpName);
-        free(tp->truth);
         free(tp);
     }
 }
 
+/*
+ * Builds the name lookup and evaluation slots of a set once its TPs and gate
+ * program are in place, and the cones of the inputs if it is checked by the
+ * gate program.
+ */
+void completeAssertionSet(AssertionsSet* set) {
+    int i;
+    set->symbols = createSymbolTable(set->nTp);
+    for(i = 0; i < set->nTp; i++) {
+        symbolTableInsert(set->symbols, set->tps[i]->tpName, i);
+    }
+    assert((set->slots = malloc(sizeof(TruthWord) * (set->program->nSlots + 1))) != NULL);
+    if(set->table == NULL) {
+        gateProgramBuildCones(set->program);
+    }
+}
+
+/*
+ * Adds the index of every TP referred to below node to deps, adding each TP
+ * once. stamps[j] is set to self once TP j has been added for TP self.
+ */
+int collectTPReferences(xmlNode* node, NodeIdMap* map, int self, int* stamps, int** deps, int* nDeps) {
+    xmlNode* child;
+    xmlNode* refNode;
+    xmlChar* contents;
+    CompiledNode* ref;
+    if(strEqual(node->name, NODE_NAME_REF)) {
+        contents = xmlNodeListGetString(node->doc, node->children, 1);
+        refNode = findNodeInMap(map, contents);
+        if(refNode != NULL && !strEqual(refNode->name, NODE_NAME_TP)) {
+            fprintf(stderr, "Reference to \"%s\" is not a TP\n", contents);
+            refNode = NULL;
+        }
+        xmlFree(contents);
+        if(refNode == NULL) {
+            return -1;
+        }
+        ref = refNode->_private;
+        if(stamps[ref->tpIndex] != self) {
+            stamps[ref->tpIndex] = self;
+            assert((*deps = realloc(*deps, sizeof(int) * (*nDeps + 1))) != NULL);
+            (*deps)[(*nDeps)++] = ref->tpIndex;
+        }
+        return 1;
+    }
+    for(child = node->children; child != NULL; child = child->next) {
+        if(child->type == XML_ELEMENT_NODE && collectTPReferences(child, map, self, stamps, deps, nDeps) < 0) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+int compareInts(const void* a, const void* b) {
+    return *(const int*) a - *(const int*) b;
+}
+
+/*
+ * Prints a cycle through the TPs that levelizeTPNodes could not order. Each
+ * of them refers to at least one other that could not be ordered, so
+ * following those references from any of them must come back round.
+ */
+void reportReferenceCycle(xmlNode** tpNodes, int nTp, int* depStarts, int* deps, int* inDegrees) {
+    int* steps;
+    int i, j, step;
+    xmlChar* id;
+
+    assert((steps = malloc(sizeof(int) * nTp)) != NULL);
+    for(i = 0; i < nTp; i++) {
+        steps[i] = -1;
+    }
+    for(i = 0; inDegrees[i] == 0; i++);
+    for(step = 0; steps[i] < 0; step++) {
+        steps[i] = step;
+        for(j = depStarts[i]; inDegrees[deps[j]] == 0; j++);
+        i = deps[j];
+    }
+    fprintf(stderr, "Reference cycle found:");
+    for(step = steps[i]; ; ) {
+        id = xmlGetProp(tpNodes[i], ATTR_NAME_ID);
+        fprintf(stderr, " %s", id);
+        xmlFree(id);
+        if(step > steps[i]) {
+            break;
+        }
+        fprintf(stderr, " ->");
+        for(j = depStarts[i]; inDegrees[deps[j]] == 0 || steps[deps[j]] < 0; j++);
+        i = deps[j];
+        step++;
+    }
+    fprintf(stderr, "\n");
+    free(steps);
+}
+
+/*
+ * Orders the TPs with Kahn's algorithm so that every TP comes after the TPs
+ * it refers to. Level 0 holds the inputs and each later level the TPs whose
+ * references all lie in earlier levels, in document order within a level.
+ * Writes the TP indices in order to order and the start of each level to
+ * levelStarts, followed by nTp. Returns the number of levels, or -1 if the
+ * references could not be resolved or form a cycle.
+ */
+int levelizeTPNodes(xmlNode** tpNodes, int nTp, NodeIdMap* map, int* order, int* levelStarts) {
+    int* stamps;
+    int* deps = NULL;
+    int* depStarts;
+    int* fanouts;
+    int* fanoutStarts;
+    int* inDegrees;
+    int i, j, k, nDeps, nOrdered, nLevels;
+
+    assert((stamps = malloc(sizeof(int) * (nTp + 1))) != NULL);
+    assert((depStarts = malloc(sizeof(int) * (nTp + 1))) != NULL);
+    for(i = 0; i < nTp; i++) {
+        stamps[i] = -1;
+    }
+    nDeps = 0;
+    for(i = 0; i < nTp; i++) {
+        depStarts[i] = nDeps;
+        if(collectTPReferences(tpNodes[i], map, i, stamps, &deps, &nDeps) < 0) {
+            free(stamps);
+            free(depStarts);
+            free(deps);
+            return -1;
+        }
+    }
+    depStarts[nTp] = nDeps;
+    
+    // Invert the references to find the TPs that refer to each TP
+    assert((fanoutStarts = calloc(nTp + 1, sizeof(int))) != NULL);
+    assert((fanouts = malloc(sizeof(int) * (nDeps + 1))) != NULL);
+    assert((inDegrees = malloc(sizeof(int) * (nTp + 1))) != NULL);
+    for(j = 0; j < nDeps; j++) {
+        fanoutStarts[deps[j]]++;
+    }
+    for(i = 1; i <= nTp; i++) {
+        fanoutStarts[i] += fanoutStarts[i - 1];
+    }
+    for(i = nTp - 1; i >= 0; i--) {
+        inDegrees[i] = depStarts[i + 1] - depStarts[i];
+        for(j = depStarts[i]; j < depStarts[i + 1]; j++) {
+            fanouts[--fanoutStarts[deps[j]]] = i;
+        }
+    }
+    
+    nOrdered = 0;
+    for(i = 0; i < nTp; i++) {
+        if(inDegrees[i] == 0) {
+            order[nOrdered++] = i;
+        }
+    }
+    nLevels = 0;
+    for(k = 0; k < nOrdered; ) {
+        levelStarts[nLevels++] = k;
+        for(i = nOrdered; k < i; k++) {
+            for(j = fanoutStarts[order[k]]; j < fanoutStarts[order[k] + 1]; j++) {
+                if(--inDegrees[fanouts[j]] == 0) {
+                    order[nOrdered++] = fanouts[j];
+                }
+            }
+        }
+        qsort(order + k, nOrdered - k, sizeof(int), compareInts);
+    }
+    levelStarts[nLevels] = nOrdered;
+    
+    if(nOrdered < nTp) {
+        reportReferenceCycle(tpNodes, nTp, depStarts, deps, inDegrees);
+        nLevels = -1;
+    }
+    
+    free(inDegrees);
+    free(fanouts);
+    free(fanoutStarts);
+    free(stamps);
+    free(depStarts);
+    free(deps);
+    return nLevels;
+}
+
 AssertionsSet* createAssertionSetFromXMLNode(xmlNode* circuitNode) {
     AssertionsSet* set = malloc(sizeof(AssertionsSet));
     xmlNode* child = circuitNode->children;
-    int i;
-    int* tmpTruth = NULL;
-    int tmpDepth, tmpValveNo;
+    int i, k, useTable;
+    TruthColumn* tmpTruth = NULL;
+    int* tpSlots;
+    int* order;
     xmlNode** tpNodes = NULL;
+    CompiledNode* compiled;
+    GateProgram* program;
+    xmlChar* contents;
     NodeIdMap* nodeMap = createNodeIdMap();
-    LinkedListSortingNode* thisNode;
-    LinkedListSortingNode* llNode;
     set->nTp = 0;
+    set->table = NULL;
+    set->program = NULL;
+    set->slots = NULL;
+    set->symbols = NULL;
+    set->levelStarts = NULL;
+    set->nLevels = 0;
     
     while(child) {
         if(strEqual(child->name, NODE_NAME_TP)) {
@@ -258,64 +576,97 @@ AssertionsSet* createAssertionSetFromXMLNode(xmlNode* circuitNode) {
                 addInputNodeToIdMap(nodeMap, child);
             }
         }
-        if(xmlHasProp(child, ATTR_NAME_ID)) {
-            addNodeToIdMap(nodeMap, child);
+        if(xmlHasProp(child, ATTR_NAME_ID) && addNodeToIdMap(nodeMap, child) < 0) {
+            contents = xmlGetProp(child, ATTR_NAME_ID);
+            fprintf(stderr, "Node id \"%s\" is used more than once\n", contents);
+            xmlFree(contents);
+            freeNodeIdMap(nodeMap);
+            free(tpNodes);
+            free(set);
+            return NULL;
         }
         child = child->next;
     }
     
-    LinkedListSortingNode* ll = NULL;
+    assert((compiled = malloc(sizeof(CompiledNode) * (set->nTp + 1))) != NULL);
     for(i = 0; i < set->nTp; i++) {
-        tmpTruth = parseNode(tpNodes[i],nodeMap,&tmpDepth,&tmpValveNo);
-        assert(tmpTruth != NULL);
-        
-        llNode = malloc(sizeof(LinkedListSortingNode));
-        llNode->next = NULL;
-        llNode->prev = NULL;
-        llNode->tp = createTestPointFromXMLNode(tpNodes[i], tmpTruth, tmpValveNo);
-        llNode->depth = tmpDepth;
-        
-        if(ll == NULL) {
-            ll = llNode;
-        } else {
-            thisNode = ll;
-            while(thisNode != NULL) {
-                if(thisNode->depth >= llNode->depth) {
-                    if(thisNode->prev != NULL) {
-                        thisNode->prev->next = llNode;
-                    }
-                    llNode->prev = thisNode->prev;
-                    llNode->next = thisNode;
-                    thisNode->prev = llNode;
-                    if(thisNode == ll) {
-                        ll = llNode;
-                    }
-                    break;
-                } else if(thisNode->next == NULL) {
-                    llNode->prev = thisNode;
-                    thisNode->next = llNode;
-                    break;
-                }
-                thisNode = thisNode->next;
+        compiled[i].tpIndex = i;
+        compiled[i].slot = SLOT_NOT_COMPILED;
+        compiled[i].truth = NULL;
+        tpNodes[i]->_private = &compiled[i];
+    }
+    
+    // Visiting the TPs level by level means every reference has already been
+    // compiled, so neither the compiler nor parseNode follow chains of TPs
+    assert((order = malloc(sizeof(int) * (set->nTp + 1))) != NULL);
+    assert((set->levelStarts = malloc(sizeof(int) * (set->nTp + 1))) != NULL);
+    assert((tpSlots = malloc(sizeof(int) * (set->nTp + 1))) != NULL);
+    program = createGateProgram(nodeMap->nInputs, set->nTp - nodeMap->nInputs);
+    set->nLevels = levelizeTPNodes(tpNodes, set->nTp, nodeMap, order, set->levelStarts);
+    k = 0;
+    if(set->nLevels >= 0) {
+        for(; k < set->nTp; k++) {
+            i = order[k];
+            tpSlots[i] = compileNode(tpNodes[i], nodeMap, program, NULL);
+            if(tpSlots[i] < 0) {
+                break;
             }
-            assert(thisNode != NULL);
         }
     }
+    if(k < set->nTp) {
+        for(i = 0; i < set->nTp; i++) {
+            tpNodes[i]->_private = NULL;
+        }
+        free(tpSlots);
+        free(order);
+        free(set->levelStarts);
+        free(compiled);
+        freeGateProgram(program);
+        freeNodeIdMap(nodeMap);
+        free(tpNodes);
+        free(set);
+        return NULL;
+    }
     
-    thisNode = ll;
+    // Only tabulate circuits whose table fits, wider ones use the gate program
+    useTable = truthTableFits(nodeMap->nInputs, set->nTp - nodeMap->nInputs);
+    
+    // Level 0 holds the inputs in document order, so input i of the set is
+    // bit i of a truth table row index
     set->tps = malloc(set->nTp * sizeof(TestPoint*));
     set->nInputs = nodeMap->nInputs;
-    for(i = 0; i < set->nTp; i++) {
-        assert(thisNode != NULL);
-        set->tps[i] = thisNode->tp;
-        if(thisNode->next != NULL) {
-            thisNode = thisNode->next;
-            free(thisNode->prev);
-        } else {
-            free(thisNode);
+    assert(set->nLevels == 0 || set->levelStarts[1] == set->nInputs);
+    if(useTable) {
+        set->table = createTruthTable(set->nInputs, set->nTp - set->nInputs);
+    }
+    for(k = 0; k < set->nTp; k++) {
+        i = order[k];
+        if(useTable) {
+            tmpTruth = parseNode(tpNodes[i], nodeMap, NULL);
+            assert(tmpTruth != NULL);
+        }
+        set->tps[k] = createTestPointFromXMLNode(tpNodes[i], compiled[i].valveNo);
+        if(k >= set->nInputs) {
+            program->outputSlots[k - set->nInputs] = tpSlots[i];
+            if(useTable) {
+                truthTableSetColumn(set->table, k - set->nInputs, tmpTruth);
+            }
         }
+        releaseTruthColumn(tmpTruth);
+        tmpTruth = NULL;
     }
     
+    gateProgramLevelize(program);
+    set->program = program;
+    completeAssertionSet(set);
+    
+    for(i = 0; i < set->nTp; i++) {
+        releaseTruthColumn(compiled[i].truth);
+        tpNodes[i]->_private = NULL;
+    }
+    free(tpSlots);
+    free(order);
+    free(compiled);
     freeNodeIdMap(nodeMap);
     free(tpNodes);
     return set;
@@ -327,54 +678,206 @@ void freeAssertionSet(AssertionsSet* set) {
         for(i = 0; i < set->nTp; i++) {
             freeTestPoint(set->tps[i]);
         }
+        free(set->tps);
+        freeTruthTable(set->table);
+        freeGateProgram(set->program);
+        free(set->slots);
+        freeSymbolTable(set->symbols);
+        free(set->levelStarts);
         free(set);
     }
 }
 
 int findTableRowForInputs(AssertionsSet* set, int* samples) {
-    int i, j, nCombs = 1 << set->nInputs;
-    for(j = 0; j < nCombs; j++) {
+    if(set->table == NULL) {
+        return -1;
+    }
+    return truthTableRowForInputs(set->table, samples);
+}
+
+void checkTruthTable(AssertionsSet* set, int* samples, int* dest, int* n) {
+    if(set->table != NULL) {
+        *n = truthTableCheck(set->table, samples, dest);
+    } else {
+        *n = gateProgramCheck(set->program, set->slots, samples, dest);
+    }
+}
+
+int getErrorMaskWords(AssertionsSet* set) {
+    return TRUTH_WORDS_FOR_BITS(set->nTp - set->nInputs);
+}
+
+int getSampleWords(AssertionsSet* set) {
+    return TRUTH_WORDS_FOR_BITS(set->nTp);
+}
+
+/*
+ * Checks n packed samples at once, each getSampleWords(set) words with TP i
+ * in bit i. The failing outputs of sample s are left as a mask of
+ * getErrorMaskWords(set) words starting at results[s * getErrorMaskWords(set)],
+ * see getErrorIndicesFromMask.
+ */
+void checkTruthTableBatch(AssertionsSet* set, const TruthWord* const* samples, int n, TruthWord* results) {
+    checkSamplesAtOnce(set, set->slots, samples, n, results);
+}
+
+/*
+ * Checks n packed samples like checkTruthTableBatch, evaluating gates in
+ * slots, which must have program->nSlots words, instead of the set's own, so
+ * threads with slots of their own can check samples of the same set at once.
+ */
+void checkSamplesAtOnce(AssertionsSet* set, TruthWord* slots, const TruthWord* const* samples, int n, TruthWord* results) {
+    int i, nMaskWords;
+    if(set->table != NULL) {
+        nMaskWords = getErrorMaskWords(set);
+        for(i = 0; i < n; i++) {
+            truthTableCheckPacked(set->table, samples[i], results + (long) i * nMaskWords);
+        }
+    } else {
+        gateProgramCheckBatch(set->program, slots, samples, n, results);
+    }
+}
+
+SampleChecker* createSampleChecker(AssertionsSet* set) {
+    SampleChecker* checker;
+    int nMaskWords;
+
+    nMaskWords = getErrorMaskWords(set);
+    assert((checker = malloc(sizeof(SampleChecker))) != NULL);
+    assert((checker->lastSample = calloc(getSampleWords(set) + 1, sizeof(TruthWord))) != NULL);
+    assert((checker->lastOutputs = calloc(nMaskWords + 1, sizeof(TruthWord))) != NULL);
+    assert((checker->lastErrors = calloc(nMaskWords + 1, sizeof(TruthWord))) != NULL);
+    assert((checker->outputs = calloc(nMaskWords + 1, sizeof(TruthWord))) != NULL);
+    assert((checker->slots = calloc(set->program->nSlots + 1, sizeof(TruthWord))) != NULL);
+    assert((checker->pending = calloc(TRUTH_WORDS_FOR_BITS(set->program->nCode) + 1, sizeof(TruthWord))) != NULL);
+    checker->primed = 0;
+    return checker;
+}
+
+/*
+ * Checks one packed sample into the error mask errors following the sample
+ * last, whose error mask was lastErrors. An output outside the cones of the
+ * inputs that changed expects what it did for last, so its error only
+ * changes if the output itself did. Only the outputs in the cones are
+ * compared afresh, against the gate program run over just those cones.
+ */
+void checkSampleChange(AssertionsSet* set, SampleChecker* checker, const TruthWord* last, const TruthWord* lastErrors, const TruthWord* sample, TruthWord* errors) {
+    GateProgram* program = set->program;
+    TruthWord* swap;
+    int i, nMaskWords;
+
+    nMaskWords = getErrorMaskWords(set);
+    extractBits(sample, set->nInputs, program->nOutputs, checker->outputs);
+    if(checker->primed) {
+        for(i = 0; i < nMaskWords; i++) {
+            errors[i] = lastErrors[i] ^ checker->outputs[i] ^ checker->lastOutputs[i];
+        }
+        gateProgramCheckChanges(program, checker->slots, checker->pending, last, sample, checker->outputs, errors);
+    } else {
         for(i = 0; i < set->nInputs; i++) {
-            if(set->tps[i]->truth[j] != samples[i]) {
-                i = -1;
-                break;
+            checker->slots[i] = (sample[i / TRUTH_WORD_BITS] >> (i % TRUTH_WORD_BITS)) & 1 ? ~(TruthWord) 0 : 0;
+        }
+        gateProgramRun(program, checker->slots);
+        memset(errors, 0, sizeof(TruthWord) * nMaskWords);
+        for(i = 0; i < program->nOutputs; i++) {
+            if((checker->slots[program->outputSlots[i]] ^ checker->outputs[i / TRUTH_WORD_BITS]) & (TruthWord) 1 << (i % TRUTH_WORD_BITS)) {
+                errors[i / TRUTH_WORD_BITS] |= (TruthWord) 1 << (i % TRUTH_WORD_BITS);
             }
         }
-        if(i >= 0) {
-            return j;
+        checker->primed = 1;
+    }
+    swap = checker->lastOutputs;
+    checker->lastOutputs = checker->outputs;
+    checker->outputs = swap;
+}
+
+/*
+ * Checks n packed samples of a stream like checkTruthTableBatch, leaving the
+ * same results, but running only the gates that depend on the inputs that
+ * changed since the sample before and comparing only the outputs that
+ * depend on them, so a sample costs as much as what changed in it. Sets
+ * checked by their truth table, whose cost does not depend on the circuit,
+ * and batches that change so much that checking them all at once would be
+ * quicker are checked at once. Only the checker is written to, so threads
+ * may each check samples of the same set with a checker of their own.
+ */
+void checkSampleChanges(AssertionsSet* set, SampleChecker* checker, const TruthWord* const* samples, int n, TruthWord* results) {
+    const TruthWord* last;
+    long work;
+    int i, nMaskWords;
+
+    if(set->table != NULL || set->program->cones == NULL || n == 0) {
+        checkSamplesAtOnce(set, checker->slots, samples, n, results);
+        if(n > 0) {
+            checker->primed = 0;
         }
+        return;
+    }
+    // Checking at once runs every instruction once for every 64 samples
+    work = checker->primed ? 0 : set->program->nCode;
+    last = checker->primed ? checker->lastSample : samples[0];
+    for(i = 0; i < n; i++) {
+        work += gateProgramChangedConeSize(set->program, last, samples[i]);
+        last = samples[i];
+    }
+    nMaskWords = getErrorMaskWords(set);
+    if(work > (long) set->program->nCode * TRUTH_WORDS_FOR_BITS(n)) {
+        checkSamplesAtOnce(set, checker->slots, samples, n, results);
+        checker->primed = 0;
+    } else {
+        checkSampleChange(set, checker, checker->lastSample, checker->lastErrors, samples[0], results);
+        for(i = 1; i < n; i++) {
+            checkSampleChange(set, checker, samples[i - 1], results + (long) (i - 1) * nMaskWords, samples[i], results + (long) i * nMaskWords);
+        }
+        memcpy(checker->lastErrors, results + (long) (n - 1) * nMaskWords, sizeof(TruthWord) * nMaskWords);
+        memcpy(checker->lastSample, samples[n - 1], sizeof(TruthWord) * getSampleWords(set));
     }
-    return -1;
 }
 
-void checkTruthTable(AssertionsSet* set, int* samples, int* dest, int* n) {
-    int i;
-    int row = findTableRowForInputs(set, samples);
-    assert(row >= 0);
-    *n = 0;
-    for(i = set->nInputs; i < set->nTp; i++) {
-        if(set->tps[i]->truth[row] != samples[i]) {
-            dest[*n] = i;
-            (*n)++;
+void freeSampleChecker(SampleChecker* checker) {
+    if(checker != NULL) {
+        free(checker->lastSample);
+        free(checker->lastOutputs);
+        free(checker->lastErrors);
+        free(checker->outputs);
+        free(checker->slots);
+        free(checker->pending);
+        free(checker);
+    }
+}
+
+int getErrorIndicesFromMask(AssertionsSet* set, const TruthWord* mask, int* dest) {
+    TruthWord word;
+    int i, n, nWords;
+    nWords = getErrorMaskWords(set);
+    n = 0;
+    for(i = 0; i < nWords; i++) {
+        word = mask[i];
+        while(word) {
+            dest[n++] = set->nInputs + i * TRUTH_WORD_BITS + __builtin_ctzll(word);
+            word &= word - 1;
         }
     }
+    return n;
 }
 
 void printTPs(AssertionsSet* set) {
-    int i, nColumns, nRows, maxCellStringLen;
+    int i, level, nColumns, nRows, maxCellStringLen;
     char** columns;
     char*** rows;
     assert(set != NULL);
     
     maxCellStringLen = 16;
-    nColumns = 5;
+    nColumns = 6;
     assert((columns = malloc(sizeof(char*) * nColumns)) != NULL);
     columns[0] = TP_TABLE_HEADER_TP;
     columns[1] = TP_TABLE_HEADER_IS_INPUT;
     columns[2] = TP_TABLE_HEADER_VALVE_NO;
     columns[3] = TP_TABLE_HEADER_MIN_V;
     columns[4] = TP_TABLE_HEADER_MAX_V;
+    columns[5] = TP_TABLE_HEADER_LEVEL;
     nRows = set->nTp;
+    level = 0;
     assert((rows = malloc(sizeof(char**) * nRows)) != NULL);
     for(i = 0; i < nRows; i++) {
         rows[i] = malloc(sizeof(char*) * nColumns);
@@ -391,12 +894,18 @@ void printTPs(AssertionsSet* set) {
         snprintf(rows[i][3], maxCellStringLen, "%f", set->tps[i]->min);
         assert((rows[i][4] = malloc(sizeof(char) * maxCellStringLen)) != NULL);
         snprintf(rows[i][4], maxCellStringLen, "%f", set->tps[i]->max);
+        while(level + 1 < set->nLevels && set->levelStarts[level + 1] <= i) {
+            level++;
+        }
+        assert((rows[i][5] = malloc(sizeof(char) * maxCellStringLen)) != NULL);
+        snprintf(rows[i][5], maxCellStringLen, "%d", level);
     }
     printTable(stdout, TP_TABLE_TITLE, columns, nColumns, rows, nRows);
     for(i = 0; i < nRows; i++) {
         free(rows[i][2]);
         free(rows[i][3]);
         free(rows[i][4]);
+        free(rows[i][5]);
         free(rows[i]);
     }
     free(rows);
@@ -409,6 +918,11 @@ void printTruthTable(AssertionsSet* set) {
     char*** rows;
     assert(set != NULL);
     
+    if(set->table == NULL) {
+        printf("Truth table not built for %d inputs, evaluating %d gates over %d levels\n",
+                set->nInputs, set->program->nCode, set->program->nLevels);
+        return;
+    }
     maxCellStringLen = 8;
     nColumns = set->nTp;
     assert((columns = malloc(sizeof(char*) * nColumns)) != NULL);
@@ -421,7 +935,11 @@ void printTruthTable(AssertionsSet* set) {
         rows[i] = malloc(sizeof(char*) * nColumns);
         for(j = 0; j < nColumns; j++) {
             rows[i][j] = malloc(sizeof(char) * maxCellStringLen);
-            snprintf(rows[i][j], maxCellStringLen, "%d", set->tps[j]->truth[i]);
+            if(j < set->nInputs) {
+                snprintf(rows[i][j], maxCellStringLen, "%d", (i >> j) & 1);
+            } else {
+                snprintf(rows[i][j], maxCellStringLen, "%d", truthTableGet(set->table, i, j - set->nInputs));
+            }
         }
     }
     printTable(stdout, TRUTH_TABLE_TITLE, columns, nColumns, rows, nRows);
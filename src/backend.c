@@ -0,0 +1,142 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef NO_WIRINGPI
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <wiringPi.h>
+#include <wiringPiSPI.h>
+#endif
+#include "backend.h"
+#include "simulator.h"
+
+#ifndef NO_WIRINGPI
+#define GPIO_MEM_DEVICE "/dev/gpiomem"
+#define GPIO_BLOCK_SIZE 4096
+#define GPIO_LEVEL_REGISTER 13
+#define GPIO_LEVEL_WORDS 2
+
+int wiringPiPhysPinToGpio(SamplingBackend* backend, int physPin) {
+    (void) backend;
+    return physPinToGpio(physPin);
+}
+
+void wiringPiSetPinMode(SamplingBackend* backend, int pin, int mode) {
+    (void) backend;
+    pinMode(pin, mode == PIN_OUTPUT ? OUTPUT : INPUT);
+}
+
+void wiringPiWritePin(SamplingBackend* backend, int pin, int value) {
+    (void) backend;
+    digitalWrite(pin, value == PIN_HIGH ? HIGH : LOW);
+}
+
+int wiringPiReadPin(SamplingBackend* backend, int pin) {
+    (void) backend;
+    return digitalRead(pin) == HIGH ? PIN_HIGH : PIN_LOW;
+}
+
+/*
+ * Reads the GPLEV0 register, which holds the levels of BCM pins 0 to 31,
+ * and GPLEV1, which holds those of pins 32 to 53, if it is wanted.
+ */
+void wiringPiReadLevels(SamplingBackend* backend, uint32_t* levels, int nWords) {
+    volatile uint32_t* gpio = backend->state;
+    levels[0] = gpio[GPIO_LEVEL_REGISTER];
+    if(nWords > 1) {
+        levels[1] = gpio[GPIO_LEVEL_REGISTER + 1];
+    }
+}
+
+/*
+ * Maps the GPIO registers through /dev/gpiomem so all the levels can be read
+ * at once. Returns NULL if they cannot be mapped.
+ */
+void* mapGpioRegisters(void) {
+    void* gpio;
+    int fd;
+
+    fd = open(GPIO_MEM_DEVICE, O_RDWR | O_SYNC);
+    if(fd < 0) {
+        return NULL;
+    }
+    gpio = mmap(NULL, GPIO_BLOCK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return gpio == MAP_FAILED ? NULL : gpio;
+}
+
+int wiringPiSetupSPI(SamplingBackend* backend, int channel, int speed) {
+    int code;
+    (void) backend;
+    code = wiringPiSPISetup(channel, speed);
+    if(code < 0) {
+        fprintf(stderr, "Error with wiringPiSPISetup(%d)\n", code);
+        return 0;
+    }
+    return 1;
+}
+
+int wiringPiWriteSPI(SamplingBackend* backend, int channel, unsigned char* data, int n) {
+    (void) backend;
+    return wiringPiSPIDataRW(channel, data, n) >= 0;
+}
+
+void freeWiringPiBackend(SamplingBackend* backend) {
+    if(backend->state != NULL) {
+        munmap(backend->state, GPIO_BLOCK_SIZE);
+    }
+    free(backend);
+}
+#endif
+
+/*
+ * Samples the GPIO pins of the Raspberry Pi the program runs on through
+ * wiringPi, using BCM pin numbers, reading the level registers directly when
+ * /dev/gpiomem can be mapped. Returns NULL if the program was built without
+ * wiringPi.
+ */
+SamplingBackend* createWiringPiBackend(void) {
+#ifdef NO_WIRINGPI
+    fprintf(stderr, "This program was built without wiringPi\n");
+    return NULL;
+#else
+    SamplingBackend* backend;
+
+    wiringPiSetupGpio();
+    assert((backend = malloc(sizeof(SamplingBackend))) != NULL);
+    backend->name = BACKEND_NAME_WIRINGPI;
+    backend->physPinToGpio = wiringPiPhysPinToGpio;
+    backend->setPinMode = wiringPiSetPinMode;
+    backend->writePin = wiringPiWritePin;
+    backend->readPin = wiringPiReadPin;
+    backend->setupSPI = wiringPiSetupSPI;
+    backend->writeSPI = wiringPiWriteSPI;
+    backend->free = freeWiringPiBackend;
+    backend->state = mapGpioRegisters();
+    backend->nLevelWords = backend->state != NULL ? GPIO_LEVEL_WORDS : 0;
+    backend->readLevels = backend->state != NULL ? wiringPiReadLevels : NULL;
+    return backend;
+#endif
+}
+
+/*
+ * Creates the backend with the given name. Returns NULL if there is no such
+ * backend or it could not be set up.
+ */
+SamplingBackend* createSamplingBackend(const char* name) {
+    if(strcmp(name, BACKEND_NAME_WIRINGPI) == 0) {
+        return createWiringPiBackend();
+    }
+    if(strcmp(name, BACKEND_NAME_SIMULATOR) == 0) {
+        return createSimulatorBackend(SIMULATOR_PINS, SIMULATOR_SEED, SIMULATOR_FLIP_PERIOD);
+    }
+    fprintf(stderr, "Unknown sampling backend \"%s\", expected %s or %s\n", name, BACKEND_NAME_WIRINGPI, BACKEND_NAME_SIMULATOR);
+    return NULL;
+}
+
+void freeSamplingBackend(SamplingBackend* backend) {
+    assert(backend != NULL);
+    backend->free(backend);
+}
@@ -0,0 +1,479 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+#define FNV64_OFFSET_BASIS 14695981039346656037ULL
+#define FNV64_PRIME 1099511628211ULL
+#define HASH_CHUNK_SIZE 65536
+#define CACHE_ALIGNMENT 8
+#define TMP_SUFFIX ".tmp"
+
+typedef struct {
+    char* data;
+    size_t n;
+    size_t capacity;
+} CacheWriter;
+
+typedef struct {
+    const char* data;
+    size_t n;
+    size_t pos;
+    int failed;
+} CacheReader;
+
+/*
+ * Hashes the contents of each file and the name of the sampling backend,
+ * which decides how pins are numbered, with 64 bit FNV-1a. Returns 1 on
+ * success or 0 if one of the files could not be read.
+ */
+int hashConfigFiles(const char** filenames, int n, const char* backendName, uint64_t* key) {
+    FILE* file;
+    unsigned char* chunk;
+    uint64_t hash = FNV64_OFFSET_BASIS;
+    size_t i, len;
+    int j;
+
+    assert((chunk = malloc(HASH_CHUNK_SIZE)) != NULL);
+    for(j = 0; j < n; j++) {
+        file = fopen(filenames[j], "rb");
+        if(file == NULL) {
+            free(chunk);
+            return 0;
+        }
+        while((len = fread(chunk, 1, HASH_CHUNK_SIZE, file)) > 0) {
+            for(i = 0; i < len; i++) {
+                hash = (hash ^ chunk[i]) * FNV64_PRIME;
+            }
+        }
+        fclose(file);
+        // Separate the files so moving bytes between them changes the key
+        hash = (hash ^ 0xFF) * FNV64_PRIME;
+    }
+    free(chunk);
+    for(i = 0; backendName[i] != '\0'; i++) {
+        hash = (hash ^ (unsigned char) backendName[i]) * FNV64_PRIME;
+    }
+    *key = hash;
+    return 1;
+}
+
+void cacheWrite(CacheWriter* writer, const void* src, size_t size) {
+    if(writer->n + size > writer->capacity) {
+        while(writer->n + size > writer->capacity) {
+            writer->capacity *= 2;
+        }
+        assert((writer->data = realloc(writer->data, writer->capacity)) != NULL);
+    }
+    memcpy(writer->data + writer->n, src, size);
+    writer->n += size;
+}
+
+void cacheWriteInt(CacheWriter* writer, int value) {
+    int32_t v = value;
+    cacheWrite(writer, &v, sizeof(v));
+}
+
+void cacheWriteFloat(CacheWriter* writer, float value) {
+    cacheWrite(writer, &value, sizeof(value));
+}
+
+void cacheWriteString(CacheWriter* writer, const char* str) {
+    int len = strlen(str);
+    cacheWriteInt(writer, len);
+    cacheWrite(writer, str, len);
+}
+
+void cacheWriteAlign(CacheWriter* writer) {
+    static const char padding[CACHE_ALIGNMENT] = { 0 };
+    cacheWrite(writer, padding, (CACHE_ALIGNMENT - writer->n % CACHE_ALIGNMENT) % CACHE_ALIGNMENT);
+}
+
+/*
+ * Returns the next size bytes of the file, or NULL and marks the reader
+ * failed if there are not that many left.
+ */
+const void* cacheRead(CacheReader* reader, size_t size) {
+    const void* src;
+    if(reader->failed || size > reader->n - reader->pos) {
+        reader->failed = 1;
+        return NULL;
+    }
+    src = reader->data + reader->pos;
+    reader->pos += size;
+    return src;
+}
+
+int cacheReadInt(CacheReader* reader) {
+    const void* src = cacheRead(reader, sizeof(int32_t));
+    int32_t v = 0;
+    if(src != NULL) {
+        memcpy(&v, src, sizeof(v));
+    }
+    return v;
+}
+
+float cacheReadFloat(CacheReader* reader) {
+    const void* src = cacheRead(reader, sizeof(float));
+    float v = 0;
+    if(src != NULL) {
+        memcpy(&v, src, sizeof(v));
+    }
+    return v;
+}
+
+/*
+ * Reads an int which must lie within [min, max], marking the reader failed
+ * otherwise.
+ */
+int cacheReadBounded(CacheReader* reader, int min, int max) {
+    int v = cacheReadInt(reader);
+    if(v < min || v > max) {
+        reader->failed = 1;
+        return min;
+    }
+    return v;
+}
+
+char* cacheReadString(CacheReader* reader) {
+    const char* src;
+    char* str;
+    int len;
+    len = cacheReadBounded(reader, 0, reader->n);
+    src = cacheRead(reader, len);
+    if(src == NULL) {
+        return NULL;
+    }
+    assert((str = malloc(sizeof(char) * (len + 1))) != NULL);
+    memcpy(str, src, len);
+    str[len] = '\0';
+    return str;
+}
+
+void cacheReadAlign(CacheReader* reader) {
+    cacheRead(reader, (CACHE_ALIGNMENT - reader->pos % CACHE_ALIGNMENT) % CACHE_ALIGNMENT);
+}
+
+void writeCachedAssertionSet(CacheWriter* writer, AssertionsSet* set) {
+    GateProgram* program = set->program;
+    int i;
+
+    cacheWriteInt(writer, set->nTp);
+    cacheWriteInt(writer, set->nInputs);
+    cacheWriteInt(writer, set->nLevels);
+    for(i = 0; i <= set->nLevels; i++) {
+        cacheWriteInt(writer, set->levelStarts[i]);
+    }
+    for(i = 0; i < set->nTp; i++) {
+        cacheWriteString(writer, set->tps[i]->tpName);
+        cacheWriteInt(writer, set->tps[i]->valveNo);
+        cacheWriteFloat(writer, set->tps[i]->min);
+        cacheWriteFloat(writer, set->tps[i]->max);
+    }
+
+    cacheWriteInt(writer, program->nSlots);
+    cacheWriteInt(writer, program->nCode);
+    for(i = 0; i < program->nCode; i++) {
+        cacheWriteInt(writer, program->code[i].op);
+        cacheWriteInt(writer, program->code[i].dst);
+        cacheWriteInt(writer, program->code[i].a);
+        cacheWriteInt(writer, program->code[i].b);
+    }
+    cacheWriteInt(writer, program->nLevels);
+    for(i = 0; i <= program->nLevels; i++) {
+        cacheWriteInt(writer, program->levelStarts[i]);
+    }
+    for(i = 0; i < program->nOutputs; i++) {
+        cacheWriteInt(writer, program->outputSlots[i]);
+    }
+
+    // The rows are aligned so they can be used in place from a mapping
+    cacheWriteInt(writer, set->table != NULL);
+    if(set->table != NULL) {
+        cacheWriteAlign(writer);
+        cacheWrite(writer, set->table->rows, sizeof(TruthWord) * ((size_t) set->table->nRowWords << set->table->nInputs));
+    }
+}
+
+/*
+ * Reads back a set written by writeCachedAssertionSet. The truth table rows
+ * are left in place and returned through rowsOut, the caller wraps them once
+ * the rest of the file has been read.
+ */
+AssertionsSet* readCachedAssertionSet(CacheReader* reader, TruthWord** rowsOut) {
+    AssertionsSet* set;
+    GateProgram* program;
+    GateInstruction* in;
+    int i;
+
+    assert((set = malloc(sizeof(AssertionsSet))) != NULL);
+    set->table = NULL;
+    set->program = NULL;
+    set->slots = NULL;
+    set->symbols = NULL;
+    *rowsOut = NULL;
+
+    set->nTp = cacheReadBounded(reader, 0, reader->n);
+    set->nInputs = cacheReadBounded(reader, 0, set->nTp);
+    set->nLevels = cacheReadBounded(reader, 0, set->nTp);
+    assert((set->tps = calloc(set->nTp + 1, sizeof(TestPoint*))) != NULL);
+    assert((set->levelStarts = malloc(sizeof(int) * (set->nLevels + 1))) != NULL);
+    for(i = 0; i <= set->nLevels; i++) {
+        set->levelStarts[i] = cacheReadBounded(reader, i > 0 ? set->levelStarts[i - 1] : 0, set->nTp);
+    }
+    for(i = 0; i < set->nTp && !reader->failed; i++) {
+        assert((set->tps[i] = malloc(sizeof(TestPoint))) != NULL);
+        set->tps[i]->tpName = cacheReadString(reader);
+        set->tps[i]->valveNo = cacheReadInt(reader);
+        set->tps[i]->isIndex = 0;
+        set->tps[i]->min = cacheReadFloat(reader);
+        set->tps[i]->max = cacheReadFloat(reader);
+    }
+
+    program = createGateProgram(set->nInputs, set->nTp - set->nInputs);
+    set->program = program;
+    program->nSlots = cacheReadBounded(reader, set->nInputs, reader->n);
+    program->nCode = cacheReadBounded(reader, 0, program->nSlots - set->nInputs);
+    assert((program->code = malloc(sizeof(GateInstruction) * (program->nCode + 1))) != NULL);
+    for(i = 0; i < program->nCode; i++) {
+        in = &program->code[i];
+        in->op = cacheReadBounded(reader, GATE_OP_AND, GATE_OP_NOT);
+        in->dst = cacheReadBounded(reader, set->nInputs, program->nSlots - 1);
+        in->a = cacheReadBounded(reader, 0, program->nSlots - 1);
+        in->b = cacheReadBounded(reader, 0, program->nSlots - 1);
+    }
+    program->nLevels = cacheReadBounded(reader, 0, program->nCode);
+    assert((program->levelStarts = malloc(sizeof(int) * (program->nLevels + 2))) != NULL);
+    for(i = 0; i <= program->nLevels; i++) {
+        program->levelStarts[i] = cacheReadBounded(reader, i > 0 ? program->levelStarts[i - 1] : 0, program->nCode);
+    }
+    for(i = 0; i < program->nOutputs; i++) {
+        program->outputSlots[i] = cacheReadBounded(reader, 0, program->nSlots - 1);
+    }
+
+    if(cacheReadBounded(reader, 0, 1)) {
+        if(!truthTableFits(set->nInputs, program->nOutputs)) {
+            reader->failed = 1;
+        } else {
+            cacheReadAlign(reader);
+            *rowsOut = (TruthWord*) cacheRead(reader, sizeof(TruthWord) * ((size_t) TRUTH_WORDS_FOR_BITS(program->nOutputs) << set->nInputs));
+        }
+    }
+
+    if(reader->failed) {
+        freeAssertionSet(set);
+        return NULL;
+    }
+    completeAssertionSet(set);
+    return set;
+}
+
+void writeCachedWiring(CacheWriter* writer, Wiring* wiring) {
+    int i;
+    cacheWriteInt(writer, wiring->nWires);
+    for(i = 0; i < wiring->nWires; i++) {
+        cacheWriteInt(writer, wiring->wires[i]->tpIndex);
+        cacheWriteInt(writer, wiring->wires[i]->gpioPin);
+        cacheWriteFloat(writer, wiring->wires[i]->attenuation);
+        cacheWriteInt(writer, wiring->wires[i]->resistor.chip);
+        cacheWriteInt(writer, wiring->wires[i]->resistor.resistor);
+    }
+    for(i = 0; i < wiring->nTp; i++) {
+        cacheWriteInt(writer, wiring->tpWireIndices[i]);
+    }
+    cacheWriteInt(writer, wiring->nResistorChips);
+    cacheWriteInt(writer, wiring->holdGpioPin);
+}
+
+Wiring* readCachedWiring(CacheReader* reader, AssertionsSet* set) {
+    Wiring* wiring;
+    int i, tpIndex, pin, chip, resistor;
+    float attenuation;
+
+    assert((wiring = malloc(sizeof(Wiring))) != NULL);
+    wiring->nWires = cacheReadBounded(reader, 0, set->nTp);
+    wiring->nTp = set->nTp;
+    assert((wiring->wires = malloc(sizeof(Wire*) * (wiring->nWires + 1))) != NULL);
+    for(i = 0; i < wiring->nWires; i++) {
+        tpIndex = cacheReadBounded(reader, 0, set->nTp - 1);
+        pin = cacheReadInt(reader);
+        attenuation = cacheReadFloat(reader);
+        chip = cacheReadInt(reader);
+        resistor = cacheReadInt(reader);
+        wiring->wires[i] = createWire(tpIndex, pin, attenuation, chip, resistor);
+    }
+    assert((wiring->tpWireIndices = malloc(sizeof(int) * (set->nTp + 1))) != NULL);
+    for(i = 0; i < set->nTp; i++) {
+        wiring->tpWireIndices[i] = cacheReadBounded(reader, -1, wiring->nWires - 1);
+    }
+    wiring->nResistorChips = cacheReadInt(reader);
+    wiring->holdGpioPin = cacheReadInt(reader);
+    wiring->runs = NULL;
+    wiring->nRuns = 0;
+    wiring->levels = NULL;
+    wiring->nLevelWords = 0;
+
+    if(reader->failed) {
+        freeWiring(wiring);
+        return NULL;
+    }
+    return wiring;
+}
+
+void writeCachedCalibration(CacheWriter* writer, Calibration* calibration) {
+    int i;
+    cacheWriteInt(writer, calibration->nThresholds);
+    for(i = 0; i < calibration->nThresholds; i++) {
+        cacheWriteInt(writer, calibration->thresholds[i]->wireIndex);
+        cacheWriteFloat(writer, calibration->thresholds[i]->value);
+    }
+}
+
+Calibration* readCachedCalibration(CacheReader* reader, Wiring* wiring) {
+    Calibration* calibration;
+    int i, wireIndex;
+    float value;
+
+    assert((calibration = malloc(sizeof(Calibration))) != NULL);
+    calibration->nThresholds = cacheReadBounded(reader, 0, wiring->nWires);
+    assert((calibration->thresholds = malloc(sizeof(Threshold*) * (calibration->nThresholds + 1))) != NULL);
+    for(i = 0; i < calibration->nThresholds; i++) {
+        wireIndex = cacheReadBounded(reader, 0, wiring->nWires - 1);
+        value = cacheReadFloat(reader);
+        calibration->thresholds[i] = createThreshold(wireIndex, value);
+    }
+
+    if(reader->failed) {
+        freeCalibration(calibration);
+        return NULL;
+    }
+    return calibration;
+}
+
+/*
+ * Loads a configuration compiled by writeConfigCache if the cache exists and
+ * was compiled from configuration files with the given key. The truth table
+ * is used straight from a read only mapping of the file. Returns 1 if the
+ * configuration was loaded or 0 if it has to be parsed.
+ */
+int loadConfigCache(const char* filename, uint64_t key, AssertionsSet** set, Wiring** wiring, Calibration** calibration) {
+    ConfigCacheHeader header;
+    CacheReader reader;
+    struct stat st;
+    TruthWord* rows;
+    void* mapping;
+    int fd;
+
+    fd = open(filename, O_RDONLY);
+    if(fd < 0) {
+        return 0;
+    }
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(ConfigCacheHeader)) {
+        close(fd);
+        return 0;
+    }
+    mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapping == MAP_FAILED) {
+        return 0;
+    }
+
+    memcpy(&header, mapping, sizeof(header));
+    if(header.magic != CONFIG_CACHE_MAGIC || header.version != CONFIG_CACHE_VERSION
+            || header.key != key || header.wordSize != sizeof(TruthWord)
+            || header.headerSize != sizeof(ConfigCacheHeader) || header.fileSize != (uint64_t) st.st_size) {
+        munmap(mapping, st.st_size);
+        return 0;
+    }
+
+    reader.data = mapping;
+    reader.n = st.st_size;
+    reader.pos = sizeof(ConfigCacheHeader);
+    reader.failed = 0;
+    *wiring = NULL;
+    *calibration = NULL;
+    *set = readCachedAssertionSet(&reader, &rows);
+    if(*set != NULL) {
+        *wiring = readCachedWiring(&reader, *set);
+    }
+    if(*wiring != NULL) {
+        *calibration = readCachedCalibration(&reader, *wiring);
+    }
+    if(*calibration == NULL || reader.pos != reader.n) {
+        fprintf(stderr, "Ignoring invalid configuration cache \"%s\"\n", filename);
+        freeCalibration(*calibration);
+        freeWiring(*wiring);
+        freeAssertionSet(*set);
+        munmap(mapping, st.st_size);
+        return 0;
+    }
+
+    if(rows != NULL) {
+        (*set)->table = createMappedTruthTable((*set)->nInputs, (*set)->nTp - (*set)->nInputs, rows, mapping, st.st_size);
+    } else {
+        munmap(mapping, st.st_size);
+    }
+    return 1;
+}
+
+/*
+ * Writes a compiled configuration for loadConfigCache. The cache is written
+ * to a temporary file first and renamed over the old one, so losing power
+ * part way through never leaves a truncated cache behind. Returns 1 on
+ * success or 0 on failure.
+ */
+int writeConfigCache(const char* filename, uint64_t key, AssertionsSet* set, Wiring* wiring, Calibration* calibration) {
+    ConfigCacheHeader header;
+    CacheWriter writer;
+    FILE* file;
+    char* tmpFilename;
+    int ok;
+
+    writer.n = 0;
+    writer.capacity = 4096;
+    assert((writer.data = malloc(writer.capacity)) != NULL);
+    memset(&header, 0, sizeof(header));
+    cacheWrite(&writer, &header, sizeof(header));
+    writeCachedAssertionSet(&writer, set);
+    writeCachedWiring(&writer, wiring);
+    writeCachedCalibration(&writer, calibration);
+
+    header.magic = CONFIG_CACHE_MAGIC;
+    header.version = CONFIG_CACHE_VERSION;
+    header.key = key;
+    header.wordSize = sizeof(TruthWord);
+    header.headerSize = sizeof(ConfigCacheHeader);
+    header.fileSize = writer.n;
+    memcpy(writer.data, &header, sizeof(header));
+
+    assert((tmpFilename = malloc(sizeof(char) * (strlen(filename) + strlen(TMP_SUFFIX) + 1))) != NULL);
+    strcpy(tmpFilename, filename);
+    strcat(tmpFilename, TMP_SUFFIX);
+    ok = 0;
+    file = fopen(tmpFilename, "wb");
+    if(file != NULL) {
+        ok = fwrite(writer.data, 1, writer.n, file) == writer.n;
+        ok = fflush(file) == 0 && ok;
+        ok = fsync(fileno(file)) == 0 && ok;
+        ok = fclose(file) == 0 && ok;
+        if(ok) {
+            ok = rename(tmpFilename, filename) == 0;
+        }
+        if(!ok) {
+            unlink(tmpFilename);
+        }
+    }
+    if(!ok) {
+        fprintf(stderr, "Failed to write configuration cache \"%s\"\n", filename);
+    }
+
+    free(tmpFilename);
+    free(writer.data);
+    return ok;
+}
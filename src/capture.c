@@ -0,0 +1,341 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+
+#define VARINT_MAX_BYTES 10
+#define CAPTURE_MAX_NAME_LEN 65535
+
+int writeVarint(unsigned char* dest, uint64_t value) {
+    int n = 0;
+    while(value >= 0x80) {
+        dest[n++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    dest[n++] = value;
+    return n;
+}
+
+/*
+ * Reads a little endian base 128 integer from at most n bytes. Returns the
+ * number of bytes used or -1 if it does not fit.
+ */
+int readVarint(const unsigned char* p, size_t n, uint64_t* value) {
+    int i, shift;
+    *value = 0;
+    for(i = 0, shift = 0; i < (int) n && i < VARINT_MAX_BYTES; i++, shift += 7) {
+        *value |= (uint64_t) (p[i] & 0x7F) << shift;
+        if(!(p[i] & 0x80)) {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+void writeUint32(unsigned char* dest, uint32_t value) {
+    int i;
+    for(i = 0; i < 4; i++) {
+        dest[i] = value >> (8 * i);
+    }
+}
+
+uint32_t readUint32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+size_t captureMaxRecordSize(int nColumns) {
+    return 1 + 2 * VARINT_MAX_BYTES + (size_t) VARINT_MAX_BYTES * nColumns;
+}
+
+/*
+ * Creates a capture file whose columns are the given TP names and writes its
+ * header. Returns NULL if the file could not be written.
+ */
+CaptureWriter* createCaptureWriter(const char* filename, char* const* names, int nColumns) {
+    FILE* file;
+
+    file = fopen(filename, "wb");
+    if(file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\" for writing\n", filename);
+        return NULL;
+    }
+    return createCaptureWriterForFile(file, filename, names, nColumns);
+}
+
+/*
+ * Writes a capture header at the current position of an open file and takes
+ * ownership of it. The file is closed and NULL returned if the header could
+ * not be written.
+ */
+CaptureWriter* createCaptureWriterForFile(FILE* file, const char* filename, char* const* names, int nColumns) {
+    CaptureWriter* writer;
+    unsigned char header[8];
+    long nBytes;
+    int i, ok, len;
+
+    ok = fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_LEN, file) == CAPTURE_MAGIC_LEN;
+    writeUint32(header, CAPTURE_VERSION);
+    writeUint32(header + 4, nColumns);
+    ok = ok && fwrite(header, 1, 8, file) == 8;
+    nBytes = CAPTURE_MAGIC_LEN + 8;
+    for(i = 0; i < nColumns && ok; i++) {
+        len = strlen(names[i]);
+        assert(len <= CAPTURE_MAX_NAME_LEN);
+        header[0] = len & 0xFF;
+        header[1] = len >> 8;
+        ok = fwrite(header, 1, 2, file) == 2 && fwrite(names[i], 1, len, file) == (size_t) len;
+        nBytes += 2 + len;
+    }
+    if(!ok) {
+        fprintf(stderr, "Failed to write to file \"%s\"\n", filename);
+        fclose(file);
+        return NULL;
+    }
+
+    assert((writer = malloc(sizeof(CaptureWriter))) != NULL);
+    writer->file = file;
+    writer->nColumns = nColumns;
+    writer->nRowBytes = (nColumns + 7) / 8;
+    assert((writer->previous = calloc(writer->nRowBytes + 1, 1)) != NULL);
+    assert((writer->row = calloc(writer->nRowBytes + 1, 1)) != NULL);
+    assert((writer->record = malloc(captureMaxRecordSize(nColumns))) != NULL);
+    writer->nRepeats = 0;
+    writer->nSamples = 0;
+    writer->nBytes = nBytes;
+    writer->timestamp = 0;
+    return writer;
+}
+
+int flushCaptureRepeats(CaptureWriter* writer) {
+    int n;
+    if(writer->nRepeats == 0) {
+        return 1;
+    }
+    writer->record[0] = CAPTURE_RECORD_REPEAT;
+    n = 1 + writeVarint(writer->record + 1, writer->nRepeats);
+    writer->nRepeats = 0;
+    writer->nBytes += n;
+    return fwrite(writer->record, 1, n, writer->file) == (size_t) n;
+}
+
+/*
+ * Appends a sample packed one bit per column, column i in bit i % 64 of word
+ * i / 64. Returns 1 on success or 0 if the file could not be written.
+ */
+int captureWriterAppend(CaptureWriter* writer, const TruthWord* sample) {
+    unsigned char* swap;
+    int i, n, column, lastColumn, nChanged;
+    unsigned char changed;
+
+    for(i = 0; i < writer->nRowBytes; i++) {
+        writer->row[i] = sample[i / 8] >> (8 * (i % 8));
+    }
+    if(writer->nColumns % 8 != 0) {
+        writer->row[writer->nRowBytes - 1] &= (1 << (writer->nColumns % 8)) - 1;
+    }
+
+    if(writer->nSamples > 0 && memcmp(writer->row, writer->previous, writer->nRowBytes) == 0) {
+        writer->nRepeats++;
+        writer->nSamples++;
+        return 1;
+    }
+    if(!flushCaptureRepeats(writer)) {
+        return 0;
+    }
+
+    // Encode the changed columns, first as a column index then as gaps
+    nChanged = 0;
+    for(i = 0; i < writer->nRowBytes; i++) {
+        nChanged += __builtin_popcount(writer->row[i] ^ writer->previous[i]);
+    }
+    n = 1 + writeVarint(writer->record + 1, nChanged);
+    lastColumn = 0;
+    for(i = 0; i < writer->nRowBytes && n < 1 + writer->nRowBytes; i++) {
+        changed = writer->row[i] ^ writer->previous[i];
+        while(changed) {
+            column = i * 8 + __builtin_ctz(changed);
+            n += writeVarint(writer->record + n, column - lastColumn);
+            lastColumn = column;
+            changed &= changed - 1;
+        }
+    }
+    if(writer->nSamples > 0 && n < 1 + writer->nRowBytes) {
+        writer->record[0] = CAPTURE_RECORD_DELTA;
+    } else {
+        writer->record[0] = CAPTURE_RECORD_FULL;
+        memcpy(writer->record + 1, writer->row, writer->nRowBytes);
+        n = 1 + writer->nRowBytes;
+    }
+
+    swap = writer->previous;
+    writer->previous = writer->row;
+    writer->row = swap;
+    writer->nSamples++;
+    writer->nBytes += n;
+    return fwrite(writer->record, 1, n, writer->file) == (size_t) n;
+}
+
+/*
+ * Appends a time record giving the monotonic time in nanoseconds of the
+ * samples that follow it. Returns 1 on success or 0 if the file could not be
+ * written.
+ */
+int captureWriterAppendTime(CaptureWriter* writer, uint64_t timestamp) {
+    int n;
+
+    if(!flushCaptureRepeats(writer)) {
+        return 0;
+    }
+    writer->record[0] = CAPTURE_RECORD_TIME;
+    n = 1 + writeVarint(writer->record + 1, timestamp - writer->timestamp);
+    writer->timestamp = timestamp;
+    writer->nBytes += n;
+    return fwrite(writer->record, 1, n, writer->file) == (size_t) n;
+}
+
+/*
+ * Makes everything appended so far readable: writes any pending repeats and
+ * an end record, then moves back over the end record so the next append
+ * replaces it. Returns 1 on success or 0 if the file could not be written.
+ */
+int captureWriterSync(CaptureWriter* writer) {
+    unsigned char end = CAPTURE_RECORD_END;
+    int ok;
+    ok = flushCaptureRepeats(writer);
+    ok = fwrite(&end, 1, 1, writer->file) == 1 && ok;
+    ok = fflush(writer->file) == 0 && ok;
+    return fseek(writer->file, -1, SEEK_CUR) == 0 && ok;
+}
+
+/*
+ * Writes any pending repeats and the end record and closes the file. Returns
+ * 1 on success or 0 if the file could not be written.
+ */
+int closeCaptureWriter(CaptureWriter* writer) {
+    unsigned char end = CAPTURE_RECORD_END;
+    int ok;
+    ok = flushCaptureRepeats(writer);
+    ok = fwrite(&end, 1, 1, writer->file) == 1 && ok;
+    ok = fclose(writer->file) == 0 && ok;
+    free(writer->previous);
+    free(writer->row);
+    free(writer->record);
+    free(writer);
+    return ok;
+}
+
+/*
+ * Reads the header of a capture from the n bytes at p, allocating the name
+ * of each column. Returns the size of the header, 0 if it is longer than n
+ * bytes or -1 if it is not a header this version can read.
+ */
+long readCaptureHeader(const unsigned char* p, size_t n, char*** names, int* nColumns) {
+    size_t pos, len;
+    int i, count;
+
+    if(n < CAPTURE_MAGIC_LEN + 8) {
+        return 0;
+    }
+    if(memcmp(p, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0 || readUint32(p + CAPTURE_MAGIC_LEN) != CAPTURE_VERSION) {
+        return -1;
+    }
+    count = readUint32(p + CAPTURE_MAGIC_LEN + 4);
+    if(count < 0) {
+        return -1;
+    }
+    pos = CAPTURE_MAGIC_LEN + 8;
+    for(i = 0; i < count; i++) {
+        if(pos + 2 > n) {
+            return 0;
+        }
+        len = p[pos] | (p[pos + 1] << 8);
+        pos += 2 + len;
+    }
+    if(pos > n) {
+        return 0;
+    }
+
+    assert((*names = malloc(sizeof(char*) * (count + 1))) != NULL);
+    pos = CAPTURE_MAGIC_LEN + 8;
+    for(i = 0; i < count; i++) {
+        len = p[pos] | (p[pos + 1] << 8);
+        assert(((*names)[i] = malloc(sizeof(char) * (len + 1))) != NULL);
+        memcpy((*names)[i], p + pos + 2, len);
+        (*names)[i][len] = '\0';
+        pos += 2 + len;
+    }
+    *nColumns = count;
+    return pos;
+}
+
+/*
+ * Decodes the record in the n bytes at p into sample, where column i is TP
+ * indices[i] and the sample is packed one bit per TP. The number of samples
+ * the record stands for is stored in nSamples, which is 0 for a time record.
+ * A time record advances time to the time of the samples after it. Returns
+ * the size of the record, 0 for the end record or -1 if the record is
+ * invalid or truncated.
+ */
+long decodeCaptureRecord(const unsigned char* p, size_t n, int nColumns, const int* indices, TruthWord* sample, long* nSamples, uint64_t* time) {
+    uint64_t value, column, nChanged;
+    size_t pos;
+    int i, k;
+
+    if(n < 1) {
+        return -1;
+    }
+    pos = 1;
+    *nSamples = 1;
+    switch(p[0]) {
+        case CAPTURE_RECORD_END:
+            *nSamples = 0;
+            return 0;
+        case CAPTURE_RECORD_FULL:
+            if(n < 1 + (size_t) (nColumns + 7) / 8) {
+                return -1;
+            }
+            for(i = 0; i < nColumns; i++) {
+                k = indices[i];
+                sample[k / TRUTH_WORD_BITS] &= ~((TruthWord) 1 << (k % TRUTH_WORD_BITS));
+                sample[k / TRUTH_WORD_BITS] |= (TruthWord) ((p[1 + i / 8] >> (i % 8)) & 1) << (k % TRUTH_WORD_BITS);
+            }
+            return 1 + (nColumns + 7) / 8;
+        case CAPTURE_RECORD_DELTA:
+            k = readVarint(p + pos, n - pos, &nChanged);
+            if(k < 0 || nChanged > (uint64_t) nColumns) {
+                return -1;
+            }
+            pos += k;
+            column = 0;
+            for(i = 0; i < (int) nChanged; i++) {
+                k = readVarint(p + pos, n - pos, &value);
+                if(k < 0 || (i > 0 && value == 0) || value >= (uint64_t) nColumns - column) {
+                    return -1;
+                }
+                pos += k;
+                column += value;
+                sample[indices[column] / TRUTH_WORD_BITS] ^= (TruthWord) 1 << (indices[column] % TRUTH_WORD_BITS);
+            }
+            return pos;
+        case CAPTURE_RECORD_REPEAT:
+            k = readVarint(p + pos, n - pos, &value);
+            if(k < 0 || value == 0 || value > (uint64_t) LONG_MAX) {
+                return -1;
+            }
+            *nSamples = value;
+            return pos + k;
+        case CAPTURE_RECORD_TIME:
+            k = readVarint(p + pos, n - pos, &value);
+            if(k < 0) {
+                return -1;
+            }
+            *time += value;
+            *nSamples = 0;
+            return pos + k;
+        default:
+            return -1;
+    }
+}
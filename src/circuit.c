@@ -6,8 +6,6 @@
 #include <string.h>
 #include <libxml/tree.h>
 #include <libxml/xmlstring.h>
-#include <wiringPi.h>
-#include <wiringPiSPI.h>
 #include "circuit.h"
 #include "xmlutil.h"
 #include "tables.h"
@@ -24,14 +22,6 @@
 #define TABLE_PIN_HEADING "BCM Pin"
 #define TABLE_RESISTOR_HEADING "Resistor"
 
-void setupWiring() {
-    wiringPiSetupGpio();
-}
-
-void teardownWiring() {
-    
-}
-
 Wire* createWire(int tpIndex, int pin, float attenuation, int resistorChip, int resistorOnChip) {
     Wire* wire = malloc(sizeof(Wire));
     wire->tpIndex = tpIndex;
@@ -47,16 +37,13 @@ void freeWire(Wire* wire) {
 }
 
 int getIndexOfTPIndexInWiring(Wiring* wiring, int tpIndex) {
-    int i;
-    for(i = 0; i < wiring->nWires; i++) {
-        if(wiring->wires[i]->tpIndex == tpIndex) {
-            return i;
-        }
+    if(tpIndex < 0 || tpIndex >= wiring->nTp) {
+        return -1;
     }
-    return -1;
+    return wiring->tpWireIndices[tpIndex];
 }
 
-int parseGpioPinAttr(xmlNode* node, const char* attrName) {
+int parseGpioPinAttr(SamplingBackend* backend, xmlNode* node, const char* attrName) {
     int pin;
     assert(node != NULL);
     assert(attrName != NULL);
@@ -65,7 +52,7 @@ int parseGpioPinAttr(xmlNode* node, const char* attrName) {
         fprintf(stderr, "%s node has an invalid %s attribute\n", node->name, attrName);
         return -1;
     }
-    pin = physPinToGpio(pin);
+    pin = backend->physPinToGpio(backend, pin);
     if(pin < 0) {
         fprintf(stderr, "TP node pin attribute refers to an invalid pin\n");
         return -1;
@@ -73,7 +60,7 @@ int parseGpioPinAttr(xmlNode* node, const char* attrName) {
     return pin;
 }
 
-Wiring* createWiringFromXMLNode(AssertionsSet* set, xmlNode* wiringNode) {
+Wiring* createWiringFromXMLNode(SamplingBackend* backend, AssertionsSet* set, xmlNode* wiringNode) {
     assert(set != NULL);
     assert(wiringNode != NULL);
     int j, tpIndex, pin, resistorChipIndex, resistorOnChip;
@@ -85,14 +72,23 @@ Wiring* createWiringFromXMLNode(AssertionsSet* set, xmlNode* wiringNode) {
     wiring = malloc(sizeof(Wiring));
     wiring->wires = NULL;
     wiring->nWires = 0;
+    wiring->nTp = set->nTp;
+    assert((wiring->tpWireIndices = malloc(sizeof(int) * (set->nTp + 1))) != NULL);
+    for(j = 0; j < set->nTp; j++) {
+        wiring->tpWireIndices[j] = -1;
+    }
     wiring->nResistorChips = 0;
+    wiring->runs = NULL;
+    wiring->nRuns = 0;
+    wiring->levels = NULL;
+    wiring->nLevelWords = 0;
     
     if(!xmlHasProp(wiringNode, ATTR_NAME_HOLD_PIN)) {
         fprintf(stderr, "Wiring node has no hold pin attribute\n");
         freeWiring(wiring);
         return NULL;
     }
-    pin = parseGpioPinAttr(wiringNode, ATTR_NAME_HOLD_PIN);
+    pin = parseGpioPinAttr(backend, wiringNode, ATTR_NAME_HOLD_PIN);
     if(pin < 0) {
         freeWiring(wiring);
         return NULL;
@@ -124,14 +120,12 @@ Wiring* createWiringFromXMLNode(AssertionsSet* set, xmlNode* wiringNode) {
                     fprintf(stderr, "TP node refers to a tp not in the assertions set\n");
                     return NULL;
                 }
-                for(j = 0; j < wiring->nWires; j++) {
-                    if(wiring->wires[j]->tpIndex == tpIndex) {
-                        freeWiring(wiring);
-                        fprintf(stderr, "TP node has an invalid pin attribute\n");
-                        return NULL;
-                    }
+                if(wiring->tpWireIndices[tpIndex] >= 0) {
+                    freeWiring(wiring);
+                    fprintf(stderr, "TP node has an invalid pin attribute\n");
+                    return NULL;
                 }
-                pin = parseGpioPinAttr(child, ATTR_NAME_PIN);
+                pin = parseGpioPinAttr(backend, child, ATTR_NAME_PIN);
                 if(pin < 0) {
                     freeWiring(wiring);
                     return NULL;
@@ -159,6 +153,7 @@ Wiring* createWiringFromXMLNode(AssertionsSet* set, xmlNode* wiringNode) {
                 
                 wiring->wires = realloc(wiring->wires, sizeof(Wire*) * (wiring->nWires + 1));
                 wiring->wires[wiring->nWires] = createWire(tpIndex, pin, attenuation, resistorChipIndex, resistorOnChip);
+                wiring->tpWireIndices[tpIndex] = wiring->nWires;
                 wiring->nWires++;
                 if(resistorChipIndex + 1 > wiring->nResistorChips) {
                     wiring->nResistorChips = resistorChipIndex + 1;
@@ -178,13 +173,84 @@ Wiring* createWiringFromXMLNode(AssertionsSet* set, xmlNode* wiringNode) {
         return NULL;
     }
     
-    pinMode(wiring->holdGpioPin, OUTPUT);
-    digitalWrite(wiring->holdGpioPin, HIGH);
+    return wiring;
+}
+
+int compareWirePins(const void* a, const void* b) {
+    const Wire* wireA = *(Wire* const*) a;
+    const Wire* wireB = *(Wire* const*) b;
+    return wireA->gpioPin - wireB->gpioPin;
+}
+
+/*
+ * Works out how to gather the wiring's TPs from the backend's level
+ * registers: the wires are taken in pin order and each run of consecutive
+ * pins on consecutive TPs that stays within one register and one sample word
+ * becomes one WireRun. Pins are usually wired in TP order, so a chassis
+ * typically needs only a few runs, and only the registers up to the highest
+ * wired pin are read. Leaves the wiring to be read pin by pin if
+ * the backend has no level registers or a pin is beyond them.
+ */
+void planWiringRuns(SamplingBackend* backend, Wiring* wiring) {
+    Wire** sorted;
+    WireRun* run;
+    int i, pin, tpIndex, lastPin, lastTPIndex;
+
+    free(wiring->runs);
+    free(wiring->levels);
+    wiring->runs = NULL;
+    wiring->nRuns = 0;
+    wiring->levels = NULL;
+    wiring->nLevelWords = 0;
+    if(backend->nLevelWords <= 0 || backend->readLevels == NULL) {
+        return;
+    }
+    for(i = 0; i < wiring->nWires; i++) {
+        if(wiring->wires[i]->gpioPin < 0 || wiring->wires[i]->gpioPin >= 32 * backend->nLevelWords) {
+            return;
+        }
+    }
+
+    assert((sorted = malloc(sizeof(Wire*) * (wiring->nWires + 1))) != NULL);
+    memcpy(sorted, wiring->wires, sizeof(Wire*) * wiring->nWires);
+    qsort(sorted, wiring->nWires, sizeof(Wire*), compareWirePins);
+    assert((wiring->runs = malloc(sizeof(WireRun) * (wiring->nWires + 1))) != NULL);
+    wiring->nLevelWords = wiring->nWires > 0 ? sorted[wiring->nWires - 1]->gpioPin / 32 + 1 : 1;
+    assert((wiring->levels = malloc(sizeof(uint32_t) * wiring->nLevelWords)) != NULL);
+    lastPin = -2;
+    lastTPIndex = -2;
+    for(i = 0; i < wiring->nWires; i++) {
+        pin = sorted[i]->gpioPin;
+        tpIndex = sorted[i]->tpIndex;
+        if(pin == lastPin + 1 && pin % 32 != 0 && tpIndex == lastTPIndex + 1 && tpIndex % TRUTH_WORD_BITS != 0) {
+            run = &wiring->runs[wiring->nRuns - 1];
+            run->mask = run->mask << 1 | 1;
+        } else {
+            run = &wiring->runs[wiring->nRuns++];
+            run->levelWord = pin / 32;
+            run->levelBit = pin % 32;
+            run->mask = 1;
+            run->sampleWord = tpIndex / TRUTH_WORD_BITS;
+            run->sampleBit = tpIndex % TRUTH_WORD_BITS;
+        }
+        lastPin = pin;
+        lastTPIndex = tpIndex;
+    }
+    free(sorted);
+}
+
+/*
+ * Makes the hold pin an output, releasing the hold, and the pin of every
+ * wire an input, and plans how to read the wires at once.
+ */
+void setupWiringPins(SamplingBackend* backend, Wiring* wiring) {
+    int j;
+    backend->setPinMode(backend, wiring->holdGpioPin, PIN_OUTPUT);
+    backend->writePin(backend, wiring->holdGpioPin, PIN_HIGH);
     for(j = 0; j < wiring->nWires; j++) {
-        pinMode(wiring->wires[j]->gpioPin, INPUT);
+        backend->setPinMode(backend, wiring->wires[j]->gpioPin, PIN_INPUT);
     }
-    
-    return wiring;
+    planWiringRuns(backend, wiring);
 }
 
 void freeWiring(Wiring* wiring) {
@@ -193,17 +259,74 @@ void freeWiring(Wiring* wiring) {
         for(i = 0; i < wiring->nWires; i++) {
             freeWire(wiring->wires[i]);
         }
+        free(wiring->wires);
+        free(wiring->tpWireIndices);
+        free(wiring->runs);
+        free(wiring->levels);
         free(wiring);
     }
 }
 
-void readInTPValues(Wiring* wiring, int* dest) {
+/*
+ * Reads a sample packed as the truth tables look rows up, TP i in bit i % 64
+ * of word i / 64. With planned runs the inputs are held for a single read of
+ * the level registers, and the runs are then gathered into dest; otherwise
+ * each pin is read in turn.
+ */
+void readInPackedTPValues(SamplingBackend* backend, Wiring* wiring, TruthWord* dest) {
+    const WireRun* run;
     int i;
-    digitalWrite(wiring->holdGpioPin, LOW);
+
+    memset(dest, 0, sizeof(TruthWord) * TRUTH_WORDS_FOR_BITS(wiring->nTp));
+    backend->writePin(backend, wiring->holdGpioPin, PIN_LOW);
+    if(wiring->levels != NULL) {
+        backend->readLevels(backend, wiring->levels, wiring->nLevelWords);
+        backend->writePin(backend, wiring->holdGpioPin, PIN_HIGH);
+        for(i = 0; i < wiring->nRuns; i++) {
+            run = &wiring->runs[i];
+            dest[run->sampleWord] |= (TruthWord) ((wiring->levels[run->levelWord] >> run->levelBit) & run->mask) << run->sampleBit;
+        }
+        return;
+    }
+    for(i = 0; i < wiring->nWires; i++) {
+        if(backend->readPin(backend, wiring->wires[i]->gpioPin) != 0) {
+            dest[wiring->wires[i]->tpIndex / TRUTH_WORD_BITS] |= (TruthWord) 1 << (wiring->wires[i]->tpIndex % TRUTH_WORD_BITS);
+        }
+    }
+    backend->writePin(backend, wiring->holdGpioPin, PIN_HIGH);
+}
+
+/*
+ * Reads a sample one pin at a time, whether or not the backend has level
+ * registers.
+ */
+void readInTPValuesByPin(SamplingBackend* backend, Wiring* wiring, int* dest) {
+    int i;
+    backend->writePin(backend, wiring->holdGpioPin, PIN_LOW);
+    for(i = 0; i < wiring->nWires; i++) {
+        dest[wiring->wires[i]->tpIndex] = backend->readPin(backend, wiring->wires[i]->gpioPin);
+    }
+    backend->writePin(backend, wiring->holdGpioPin, PIN_HIGH);
+}
+
+/*
+ * Reads a sample with one value per TP, in TP order, taking each TP's bit
+ * from a single read of the level registers when the wiring has planned
+ * runs.
+ */
+void readInTPValues(SamplingBackend* backend, Wiring* wiring, int* dest) {
+    int i, pin;
+    if(wiring->levels == NULL) {
+        readInTPValuesByPin(backend, wiring, dest);
+        return;
+    }
+    backend->writePin(backend, wiring->holdGpioPin, PIN_LOW);
+    backend->readLevels(backend, wiring->levels, wiring->nLevelWords);
+    backend->writePin(backend, wiring->holdGpioPin, PIN_HIGH);
     for(i = 0; i < wiring->nWires; i++) {
-        dest[wiring->wires[i]->tpIndex] = digitalRead(wiring->wires[i]->gpioPin);
+        pin = wiring->wires[i]->gpioPin;
+        dest[wiring->wires[i]->tpIndex] = (wiring->levels[pin / 32] >> (pin % 32)) & 1;
     }
-    digitalWrite(wiring->holdGpioPin, HIGH);
 }
 
 void printWiring(AssertionsSet* set, Wiring* wiring) {
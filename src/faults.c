@@ -0,0 +1,187 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "faults.h"
+
+typedef struct {
+    int valveNo;
+    int tp;
+} ValveTP;
+
+int compareValveTPs(const void* a, const void* b) {
+    const ValveTP* x = a;
+    const ValveTP* y = b;
+    if(x->valveNo != y->valveNo) {
+        return x->valveNo < y->valveNo ? -1 : 1;
+    }
+    return x->tp - y->tp;
+}
+
+/*
+ * Creates the tracker for the valves of set, with every valve clear. TPs
+ * without a valve are ignored.
+ */
+FaultTracker* createFaultTracker(AssertionsSet* set, uint64_t renotifyNs, uint64_t suppressNs) {
+    FaultTracker* tracker;
+    ValveTP* pairs;
+    int i, n;
+
+    assert((pairs = malloc(sizeof(ValveTP) * (set->nTp + 1))) != NULL);
+    n = 0;
+    for(i = 0; i < set->nTp; i++) {
+        if(set->tps[i]->valveNo != -1) {
+            pairs[n].valveNo = set->tps[i]->valveNo;
+            pairs[n].tp = i;
+            n++;
+        }
+    }
+    qsort(pairs, n, sizeof(ValveTP), compareValveTPs);
+
+    assert((tracker = malloc(sizeof(FaultTracker))) != NULL);
+    assert((tracker->valves = calloc(n + 1, sizeof(ValveFault))) != NULL);
+    assert((tracker->tpValves = malloc(sizeof(int) * (set->nTp + 1))) != NULL);
+    for(i = 0; i < set->nTp; i++) {
+        tracker->tpValves[i] = -1;
+    }
+    tracker->nValves = 0;
+    for(i = 0; i < n; i++) {
+        if(i == 0 || pairs[i].valveNo != pairs[i - 1].valveNo) {
+            tracker->valves[tracker->nValves++].valveNo = pairs[i].valveNo;
+        }
+        tracker->tpValves[pairs[i].tp] = tracker->nValves - 1;
+    }
+    free(pairs);
+
+    assert((tracker->active = malloc(sizeof(int) * (tracker->nValves + 1))) != NULL);
+    assert((tracker->events = malloc(sizeof(FaultEvent) * (tracker->nValves + 1))) != NULL);
+    tracker->nActive = 0;
+    tracker->renotifyNs = renotifyNs;
+    tracker->suppressNs = suppressNs;
+    tracker->nRaised = 0;
+    tracker->nCleared = 0;
+    tracker->nRenotified = 0;
+    tracker->nSuppressed = 0;
+    tracker->nFailures = 0;
+    return tracker;
+}
+
+void addFaultEvent(FaultTracker* tracker, ValveFault* valve, int type, long nSuppressed, uint64_t now, int* nEvents) {
+    FaultEvent* event = &tracker->events[(*nEvents)++];
+    event->type = type;
+    event->valveNo = valve->valveNo;
+    event->tp = valve->tp;
+    event->nSuppressed = nSuppressed;
+    valve->lastSent = now;
+    valve->sent = 1;
+    valve->nChanges = 0;
+    tracker->nSuppressed += nSuppressed;
+    if(type == FAULT_RAISED) {
+        tracker->nRaised++;
+    } else if(type == FAULT_CLEARED) {
+        tracker->nCleared++;
+    } else {
+        tracker->nRenotified++;
+    }
+}
+
+/*
+ * Writes the events due at now for the active valves to events and drops
+ * the valves that are clear and reported clear from the active list.
+ * Returns the number of events.
+ */
+int pollFaultTracker(FaultTracker* tracker, uint64_t now) {
+    ValveFault* valve;
+    int i, nActive, nEvents;
+
+    nActive = 0;
+    nEvents = 0;
+    for(i = 0; i < tracker->nActive; i++) {
+        valve = &tracker->valves[tracker->active[i]];
+        if(valve->failing != valve->reported) {
+            if(!valve->sent || now - valve->lastSent >= tracker->suppressNs) {
+                addFaultEvent(tracker, valve, valve->failing ? FAULT_RAISED : FAULT_CLEARED, valve->nChanges - 1, now, &nEvents);
+                valve->reported = valve->failing;
+            }
+        } else if(valve->failing && tracker->renotifyNs > 0 && now - valve->lastSent >= tracker->renotifyNs) {
+            addFaultEvent(tracker, valve, FAULT_RENOTIFIED, valve->nChanges, now, &nEvents);
+        }
+        if(valve->failing || valve->reported) {
+            tracker->active[nActive++] = tracker->active[i];
+        } else {
+            tracker->nSuppressed += valve->nChanges;
+            valve->nChanges = 0;
+            valve->active = 0;
+        }
+    }
+    tracker->nActive = nActive;
+    return nEvents;
+}
+
+/*
+ * Writes an event for every valve whose state differs from the one last
+ * sent, held back or not, so nothing is left unsent when monitoring stops.
+ * Returns the number of events.
+ */
+int flushFaultTracker(FaultTracker* tracker, uint64_t now) {
+    ValveFault* valve;
+    int i, nEvents;
+
+    nEvents = 0;
+    for(i = 0; i < tracker->nActive; i++) {
+        valve = &tracker->valves[tracker->active[i]];
+        if(valve->failing != valve->reported) {
+            addFaultEvent(tracker, valve, valve->failing ? FAULT_RAISED : FAULT_CLEARED, valve->nChanges - 1, now, &nEvents);
+            valve->reported = valve->failing;
+        }
+    }
+    return nEvents;
+}
+
+/*
+ * Takes the nErrors failed TPs of the sample at now, the state of every
+ * valve until the next sample, and returns the number of events written to
+ * events.
+ */
+int updateFaultTracker(FaultTracker* tracker, const int* errorIndices, int nErrors, uint64_t now) {
+    ValveFault* valve;
+    int i, v;
+
+    tracker->nFailures += nErrors;
+    for(i = 0; i < nErrors; i++) {
+        v = tracker->tpValves[errorIndices[i]];
+        if(v < 0 || tracker->valves[v].seen) {
+            continue;
+        }
+        valve = &tracker->valves[v];
+        valve->seen = 1;
+        valve->tp = errorIndices[i];
+        if(!valve->active) {
+            valve->active = 1;
+            tracker->active[tracker->nActive++] = v;
+        }
+    }
+    for(i = 0; i < tracker->nActive; i++) {
+        valve = &tracker->valves[tracker->active[i]];
+        if(valve->seen != valve->failing) {
+            valve->failing = valve->seen;
+            valve->nChanges++;
+        }
+        valve->seen = 0;
+    }
+    return pollFaultTracker(tracker, now);
+}
+
+void freeFaultTracker(FaultTracker* tracker) {
+    int i;
+    assert(tracker != NULL);
+    for(i = 0; i < tracker->nActive; i++) {
+        tracker->nSuppressed += tracker->valves[tracker->active[i]].nChanges;
+    }
+    fprintf(stderr, "%ld TP failures were sent as %ld raised, %ld cleared and %ld renotified valve faults, %ld valve changes were suppressed\n",
+            tracker->nFailures, tracker->nRaised, tracker->nCleared, tracker->nRenotified, tracker->nSuppressed);
+    free(tracker->valves);
+    free(tracker->tpValves);
+    free(tracker->active);
+    free(tracker->events);
+    free(tracker);
+}
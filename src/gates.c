@@ -0,0 +1,418 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gates.h"
+#include "truthtable.h"
+
+GateProgram* createGateProgram(int nInputs, int nOutputs) {
+    GateProgram* program;
+    int i;
+    assert(nInputs >= 0);
+    assert(nOutputs >= 0);
+
+    assert((program = malloc(sizeof(GateProgram))) != NULL);
+    program->nInputs = nInputs;
+    program->nOutputs = nOutputs;
+    program->nSlots = nInputs;
+    program->code = NULL;
+    program->nCode = 0;
+    program->levelStarts = NULL;
+    program->nLevels = 0;
+    assert((program->outputSlots = malloc(sizeof(int) * (nOutputs + 1))) != NULL);
+    for(i = 0; i < nOutputs; i++) {
+        program->outputSlots[i] = -1;
+    }
+    program->coneStarts = NULL;
+    program->cones = NULL;
+    program->outputConeStarts = NULL;
+    program->outputCones = NULL;
+    return program;
+}
+
+void freeGateCones(GateProgram* program) {
+    free(program->coneStarts);
+    free(program->cones);
+    free(program->outputConeStarts);
+    free(program->outputCones);
+    program->coneStarts = NULL;
+    program->cones = NULL;
+    program->outputConeStarts = NULL;
+    program->outputCones = NULL;
+}
+
+void freeGateProgram(GateProgram* program) {
+    if(program != NULL) {
+        free(program->code);
+        free(program->levelStarts);
+        free(program->outputSlots);
+        freeGateCones(program);
+        free(program);
+    }
+}
+
+/*
+ * Appends an instruction and returns the slot it writes. The operand b is
+ * ignored for GATE_OP_NOT.
+ */
+int gateProgramEmit(GateProgram* program, int op, int a, int b) {
+    GateInstruction* in;
+    assert(a >= 0 && a < program->nSlots);
+    assert(op == GATE_OP_NOT || (b >= 0 && b < program->nSlots));
+
+    assert((program->code = realloc(program->code, sizeof(GateInstruction) * (program->nCode + 1))) != NULL);
+    in = &program->code[program->nCode];
+    in->op = op;
+    in->dst = program->nSlots;
+    in->a = a;
+    in->b = op == GATE_OP_NOT ? a : b;
+    program->nCode++;
+    program->nSlots++;
+    return in->dst;
+}
+
+/*
+ * Reorders the instructions so that they run one level at a time. An
+ * instruction's level is one more than the deepest of its operands, with the
+ * inputs at level zero.
+ */
+void gateProgramLevelize(GateProgram* program) {
+    GateInstruction* sorted;
+    int* slotLevels;
+    int* counts;
+    int i, level;
+
+    assert((slotLevels = calloc(program->nSlots + 1, sizeof(int))) != NULL);
+    program->nLevels = 0;
+    for(i = 0; i < program->nCode; i++) {
+        level = slotLevels[program->code[i].a];
+        if(slotLevels[program->code[i].b] > level) {
+            level = slotLevels[program->code[i].b];
+        }
+        slotLevels[program->code[i].dst] = level + 1;
+        if(level + 1 > program->nLevels) {
+            program->nLevels = level + 1;
+        }
+    }
+
+    // Counting sort keeps the emitted order within each level
+    free(program->levelStarts);
+    assert((program->levelStarts = calloc(program->nLevels + 2, sizeof(int))) != NULL);
+    for(i = 0; i < program->nCode; i++) {
+        program->levelStarts[slotLevels[program->code[i].dst]]++;
+    }
+    for(i = 1; i <= program->nLevels; i++) {
+        program->levelStarts[i] += program->levelStarts[i - 1];
+    }
+    assert((counts = calloc(program->nLevels + 1, sizeof(int))) != NULL);
+    assert((sorted = malloc(sizeof(GateInstruction) * (program->nCode + 1))) != NULL);
+    for(i = 0; i < program->nCode; i++) {
+        level = slotLevels[program->code[i].dst] - 1;
+        sorted[program->levelStarts[level] + counts[level]] = program->code[i];
+        counts[level]++;
+    }
+    free(program->code);
+    program->code = sorted;
+
+    free(counts);
+    free(slotLevels);
+}
+
+/*
+ * Appends value to the list of n ints in list, which has room for size.
+ */
+int* appendConeEntry(int* list, long n, long* size, int value) {
+    if(n == *size) {
+        *size *= 2;
+        assert((list = realloc(list, sizeof(int) * *size)) != NULL);
+    }
+    list[n] = value;
+    return list;
+}
+
+/*
+ * Finds the cone of every input, following the instructions in order from
+ * the input and marking each slot written from a marked slot. Returns 1 if
+ * the cones were built or 0 if they would hold more than
+ * GATE_CONE_MAX_ENTRIES instructions and outputs.
+ */
+int gateProgramBuildCones(GateProgram* program) {
+    const GateInstruction* in;
+    int* marks;
+    long n, nOutputs, size, outputSize;
+    int i, j;
+
+    freeGateCones(program);
+    assert((program->coneStarts = malloc(sizeof(int) * (program->nInputs + 1))) != NULL);
+    assert((program->outputConeStarts = malloc(sizeof(int) * (program->nInputs + 1))) != NULL);
+    assert((marks = calloc(program->nSlots + 1, sizeof(int))) != NULL);
+    size = program->nCode + 1;
+    outputSize = program->nOutputs + 1;
+    assert((program->cones = malloc(sizeof(int) * size)) != NULL);
+    assert((program->outputCones = malloc(sizeof(int) * outputSize)) != NULL);
+    n = 0;
+    nOutputs = 0;
+    for(i = 0; i < program->nInputs && n + nOutputs <= GATE_CONE_MAX_ENTRIES; i++) {
+        program->coneStarts[i] = n;
+        program->outputConeStarts[i] = nOutputs;
+        // Marking with i + 1 saves clearing the marks for every input
+        marks[i] = i + 1;
+        for(j = 0, in = program->code; j < program->nCode; j++, in++) {
+            if(marks[in->a] == i + 1 || marks[in->b] == i + 1) {
+                marks[in->dst] = i + 1;
+                program->cones = appendConeEntry(program->cones, n++, &size, j);
+            }
+        }
+        for(j = 0; j < program->nOutputs; j++) {
+            if(marks[program->outputSlots[j]] == i + 1) {
+                program->outputCones = appendConeEntry(program->outputCones, nOutputs++, &outputSize, j);
+            }
+        }
+    }
+    program->coneStarts[program->nInputs] = n;
+    program->outputConeStarts[program->nInputs] = nOutputs;
+    free(marks);
+    if(n + nOutputs > GATE_CONE_MAX_ENTRIES) {
+        freeGateCones(program);
+        return 0;
+    }
+    return 1;
+}
+
+void runGateInstruction(const GateInstruction* in, TruthWord* slots) {
+    switch(in->op) {
+        case GATE_OP_AND:
+            slots[in->dst] = slots[in->a] & slots[in->b];
+            break;
+        case GATE_OP_OR:
+            slots[in->dst] = slots[in->a] | slots[in->b];
+            break;
+        default:
+            slots[in->dst] = ~slots[in->a];
+            break;
+    }
+}
+
+/*
+ * Evaluates every instruction over slots, which must have nSlots words with
+ * the inputs already loaded. Each bit of a word is an independent lane.
+ */
+void gateProgramRun(GateProgram* program, TruthWord* slots) {
+    const GateInstruction* in = program->code;
+    const GateInstruction* end = in + program->nCode;
+    for(; in < end; in++) {
+        runGateInstruction(in, slots);
+    }
+}
+
+/*
+ * Returns the inputs of packed sample that differ from those of last as a
+ * word of bits starting at input w * 64.
+ */
+TruthWord changedInputsWord(GateProgram* program, const TruthWord* last, const TruthWord* sample, int w) {
+    TruthWord diff = sample[w] ^ last[w];
+    if((w + 1) * TRUTH_WORD_BITS > program->nInputs) {
+        diff &= ~(TruthWord) 0 >> ((w + 1) * TRUTH_WORD_BITS - program->nInputs);
+    }
+    return diff;
+}
+
+/*
+ * Returns the number of instructions and outputs in the cones of the inputs
+ * that differ between the packed samples last and sample, counting each
+ * once for every cone it is in. This is at least the number
+ * gateProgramCheckChanges would run and compare.
+ */
+long gateProgramChangedConeSize(GateProgram* program, const TruthWord* last, const TruthWord* sample) {
+    TruthWord diff;
+    long n = 0;
+    int i, w;
+    for(w = 0; w < TRUTH_WORDS_FOR_BITS(program->nInputs); w++) {
+        for(diff = changedInputsWord(program, last, sample, w); diff; diff &= diff - 1) {
+            i = w * TRUTH_WORD_BITS + __builtin_ctzll(diff);
+            n += program->coneStarts[i + 1] - program->coneStarts[i];
+            n += program->outputConeStarts[i + 1] - program->outputConeStarts[i];
+        }
+    }
+    return n;
+}
+
+/*
+ * Sets or clears the bit of output in errors as it differs from expected,
+ * the actual outputs being packed in outputs.
+ */
+void setOutputError(GateProgram* program, const TruthWord* slots, const TruthWord* outputs, int output, TruthWord* errors) {
+    TruthWord bit = (TruthWord) 1 << (output % TRUTH_WORD_BITS);
+    if((slots[program->outputSlots[output]] ^ outputs[output / TRUTH_WORD_BITS]) & bit) {
+        errors[output / TRUTH_WORD_BITS] |= bit;
+    } else {
+        errors[output / TRUTH_WORD_BITS] &= ~bit;
+    }
+}
+
+/*
+ * Marks the cone of input in pending and widens the words from first up to
+ * end that hold the marks to cover it.
+ */
+void markPendingCone(GateProgram* program, TruthWord* pending, int input, int* first, int* end) {
+    int j, start, stop;
+    start = program->coneStarts[input];
+    stop = program->coneStarts[input + 1];
+    if(start == stop) {
+        return;
+    }
+    for(j = start; j < stop; j++) {
+        pending[program->cones[j] / TRUTH_WORD_BITS] |= (TruthWord) 1 << (program->cones[j] % TRUTH_WORD_BITS);
+    }
+    // Each cone is in the order the instructions run
+    if(program->cones[start] / TRUTH_WORD_BITS < *first) {
+        *first = program->cones[start] / TRUTH_WORD_BITS;
+    }
+    if(program->cones[stop - 1] / TRUTH_WORD_BITS >= *end) {
+        *end = program->cones[stop - 1] / TRUTH_WORD_BITS + 1;
+    }
+}
+
+/*
+ * Loads the inputs of packed sample that differ from last into slots, which
+ * must hold what the program computed for last in every lane, and runs only
+ * the instructions in their cones. The outputs in those cones are then
+ * compared with the actual outputs, packed in outputs, and their bits of
+ * errors set or cleared, the other bits being left as they were. When more
+ * than one input changed the cones are merged in pending, which has
+ * TRUTH_WORDS_FOR_BITS(nCode) words that must be clear and are left clear.
+ */
+void gateProgramCheckChanges(GateProgram* program, TruthWord* slots, TruthWord* pending, const TruthWord* last, const TruthWord* sample, const TruthWord* outputs, TruthWord* errors) {
+    TruthWord diff, word;
+    int i, j, w, changed, nChanged, first, end;
+
+    assert(program->cones != NULL);
+    nChanged = 0;
+    changed = -1;
+    first = TRUTH_WORDS_FOR_BITS(program->nCode);
+    end = 0;
+    for(w = 0; w < TRUTH_WORDS_FOR_BITS(program->nInputs); w++) {
+        for(diff = changedInputsWord(program, last, sample, w); diff; diff &= diff - 1) {
+            i = w * TRUTH_WORD_BITS + __builtin_ctzll(diff);
+            slots[i] = (sample[w] >> (i % TRUTH_WORD_BITS)) & 1 ? ~(TruthWord) 0 : 0;
+            if(nChanged++ == 0) {
+                changed = i;
+                continue;
+            }
+            if(nChanged == 2) {
+                // Only now is the first cone merged, most samples change one input
+                markPendingCone(program, pending, changed, &first, &end);
+            }
+            markPendingCone(program, pending, i, &first, &end);
+        }
+    }
+
+    if(nChanged == 1) {
+        for(j = program->coneStarts[changed]; j < program->coneStarts[changed + 1]; j++) {
+            runGateInstruction(&program->code[program->cones[j]], slots);
+        }
+        for(j = program->outputConeStarts[changed]; j < program->outputConeStarts[changed + 1]; j++) {
+            setOutputError(program, slots, outputs, program->outputCones[j], errors);
+        }
+        return;
+    }
+    for(w = first; w < end; w++) {
+        for(word = pending[w]; word; word &= word - 1) {
+            runGateInstruction(&program->code[w * TRUTH_WORD_BITS + __builtin_ctzll(word)], slots);
+        }
+        pending[w] = 0;
+    }
+    for(w = 0; w < TRUTH_WORDS_FOR_BITS(program->nInputs) && nChanged > 1; w++) {
+        for(diff = changedInputsWord(program, last, sample, w); diff; diff &= diff - 1) {
+            i = w * TRUTH_WORD_BITS + __builtin_ctzll(diff);
+            for(j = program->outputConeStarts[i]; j < program->outputConeStarts[i + 1]; j++) {
+                setOutputError(program, slots, outputs, program->outputCones[j], errors);
+            }
+        }
+    }
+}
+
+/*
+ * Checks a single sample laid out inputs first then outputs. Writes the
+ * sample index of each failing output to dest and returns how many there
+ * were.
+ */
+int gateProgramCheck(GateProgram* program, TruthWord* slots, const int* samples, int* dest) {
+    int i, n;
+    for(i = 0; i < program->nInputs; i++) {
+        slots[i] = samples[i] ? ~(TruthWord) 0 : 0;
+    }
+    gateProgramRun(program, slots);
+    n = 0;
+    for(i = 0; i < program->nOutputs; i++) {
+        if((slots[program->outputSlots[i]] & 1) != (samples[program->nInputs + i] != 0)) {
+            dest[n++] = program->nInputs + i;
+        }
+    }
+    return n;
+}
+
+/*
+ * Loads TPs first to first + n - 1 of up to 64 packed samples into dest, so
+ * that bit s of dest[i] is TP first + i of sample s. Each word of the samples
+ * is transposed 64 TPs at a time.
+ */
+void gatherLanes(const TruthWord* const* samples, int nLanes, int first, int n, TruthWord* dest) {
+    TruthWord block[TRUTH_WORD_BITS];
+    int s, w, b, tp;
+    if(n <= 0) {
+        return;
+    }
+    for(w = first / TRUTH_WORD_BITS; w <= (first + n - 1) / TRUTH_WORD_BITS; w++) {
+        for(s = 0; s < nLanes; s++) {
+            block[s] = samples[s][w];
+        }
+        for(; s < TRUTH_WORD_BITS; s++) {
+            block[s] = 0;
+        }
+        transposeBits64(block);
+        for(b = 0; b < TRUTH_WORD_BITS; b++) {
+            tp = w * TRUTH_WORD_BITS + b;
+            if(tp >= first && tp < first + n) {
+                dest[tp - first] = block[b];
+            }
+        }
+    }
+}
+
+/*
+ * Checks nSamples packed samples, TP i in bit i, 64 at a time with one sample
+ * per bit of each slot. For sample s the failing outputs are set in the mask
+ * of TRUTH_WORDS_FOR_BITS(nOutputs) words starting at errors[s * nWords],
+ * output j in bit j % 64 of word j / 64.
+ */
+void gateProgramCheckBatch(GateProgram* program, TruthWord* slots, const TruthWord* const* samples, int nSamples, TruthWord* errors) {
+    TruthWord actual[TRUTH_WORD_BITS];
+    TruthWord lanes, diff;
+    int i, j, m, base, nLanes, nWords;
+
+    nWords = TRUTH_WORDS_FOR_BITS(program->nOutputs);
+    memset(errors, 0, sizeof(TruthWord) * nWords * nSamples);
+    for(base = 0; base < nSamples; base += TRUTH_WORD_BITS) {
+        nLanes = nSamples - base;
+        if(nLanes > TRUTH_WORD_BITS) {
+            nLanes = TRUTH_WORD_BITS;
+        }
+        lanes = ~(TruthWord) 0 >> (TRUTH_WORD_BITS - nLanes);
+        gatherLanes(samples + base, nLanes, 0, program->nInputs, slots);
+        gateProgramRun(program, slots);
+        for(j = 0; j < program->nOutputs; j += TRUTH_WORD_BITS) {
+            m = program->nOutputs - j;
+            if(m > TRUTH_WORD_BITS) {
+                m = TRUTH_WORD_BITS;
+            }
+            gatherLanes(samples + base, nLanes, program->nInputs + j, m, actual);
+            for(i = 0; i < m; i++) {
+                diff = (slots[program->outputSlots[j + i]] ^ actual[i]) & lanes;
+                while(diff) {
+                    errors[(long) (base + __builtin_ctzll(diff)) * nWords + (j + i) / TRUTH_WORD_BITS] |= (TruthWord) 1 << ((j + i) % TRUTH_WORD_BITS);
+                    diff &= diff - 1;
+                }
+            }
+        }
+    }
+}
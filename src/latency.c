@@ -0,0 +1,240 @@
+#include <assert.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "latency.h"
+
+static volatile sig_atomic_t latencyDumpGeneration = 0;
+
+uint64_t monotonicNanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+int getLatencyBucket(uint64_t ns) {
+    int shift;
+    if(ns < LATENCY_SUB_BUCKETS) {
+        return (int) ns;
+    }
+    shift = 63 - __builtin_clzll(ns) - LATENCY_SUB_BUCKET_BITS;
+    return shift * LATENCY_SUB_BUCKETS + (int) (ns >> shift);
+}
+
+/*
+ * Returns the highest value that falls in bucket.
+ */
+uint64_t getLatencyBucketMax(int bucket) {
+    int shift;
+    if(bucket < 2 * LATENCY_SUB_BUCKETS) {
+        return bucket;
+    }
+    shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    return (((uint64_t) (bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS) + 1) << shift) - 1;
+}
+
+LatencyHistogram* createLatencyHistogram(const char* name, uint64_t stallNs) {
+    LatencyHistogram* histogram;
+    assert((histogram = malloc(sizeof(LatencyHistogram))) != NULL);
+    assert((histogram->counts = malloc(sizeof(uint64_t) * LATENCY_BUCKETS)) != NULL);
+    histogram->name = name;
+    histogram->stallNs = stallNs;
+    clearLatencyHistogram(histogram);
+    return histogram;
+}
+
+void clearLatencyHistogram(LatencyHistogram* histogram) {
+    memset(histogram->counts, 0, sizeof(uint64_t) * LATENCY_BUCKETS);
+    histogram->count = 0;
+    histogram->min = UINT64_MAX;
+    histogram->max = 0;
+    histogram->sum = 0;
+    histogram->nStalls = 0;
+}
+
+void recordLatency(LatencyHistogram* histogram, uint64_t ns) {
+    histogram->counts[getLatencyBucket(ns)]++;
+    histogram->count++;
+    histogram->sum += ns;
+    if(ns < histogram->min) {
+        histogram->min = ns;
+    }
+    if(ns > histogram->max) {
+        histogram->max = ns;
+    }
+    if(ns >= histogram->stallNs) {
+        histogram->nStalls++;
+    }
+}
+
+void addLatencyHistogram(LatencyHistogram* dest, const LatencyHistogram* src) {
+    int i;
+    if(src->count == 0) {
+        return;
+    }
+    for(i = 0; i < LATENCY_BUCKETS; i++) {
+        dest->counts[i] += src->counts[i];
+    }
+    dest->count += src->count;
+    dest->sum += src->sum;
+    dest->nStalls += src->nStalls;
+    if(src->min < dest->min) {
+        dest->min = src->min;
+    }
+    if(src->max > dest->max) {
+        dest->max = src->max;
+    }
+}
+
+/*
+ * Returns the value below which percentile percent of the recorded values
+ * fall, to the precision of the buckets, or 0 if nothing was recorded.
+ */
+uint64_t getLatencyPercentile(const LatencyHistogram* histogram, double percentile) {
+    uint64_t rank, seen, value;
+    int i;
+
+    if(histogram->count == 0) {
+        return 0;
+    }
+    rank = (uint64_t) (percentile / 100 * histogram->count + 0.5);
+    if(rank < 1) {
+        rank = 1;
+    }
+    seen = 0;
+    for(i = 0; i < LATENCY_BUCKETS - 1 && (seen += histogram->counts[i]) < rank; i++);
+    value = getLatencyBucketMax(i);
+    return value < histogram->max ? value : histogram->max;
+}
+
+void printLatencyHistogram(FILE* stream, const LatencyHistogram* histogram) {
+    if(histogram->count == 0) {
+        fprintf(stream, "  %-10s no samples\n", histogram->name);
+        return;
+    }
+    fprintf(stream, "  %-10s %llu samples, min %llu, p50 %llu, p90 %llu, p99 %llu, p99.9 %llu, max %llu, mean %llu ns, %llu stalls of at least %llu ns\n",
+            histogram->name, (unsigned long long) histogram->count, (unsigned long long) histogram->min,
+            (unsigned long long) getLatencyPercentile(histogram, 50), (unsigned long long) getLatencyPercentile(histogram, 90),
+            (unsigned long long) getLatencyPercentile(histogram, 99), (unsigned long long) getLatencyPercentile(histogram, 99.9),
+            (unsigned long long) histogram->max, (unsigned long long) (histogram->sum / histogram->count),
+            (unsigned long long) histogram->nStalls, (unsigned long long) histogram->stallNs);
+}
+
+void freeLatencyHistogram(LatencyHistogram* histogram) {
+    assert(histogram != NULL);
+    free(histogram->counts);
+    free(histogram);
+}
+
+/*
+ * Creates a histogram for each of the nStages stages named by names, which
+ * must outlive it. A periodSeconds of 0 turns off the periodic reports.
+ */
+StageLatencies* createStageLatencies(const char** names, int nStages, uint64_t stallNs, long periodSeconds) {
+    StageLatencies* latencies;
+    int i;
+
+    assert((latencies = malloc(sizeof(StageLatencies))) != NULL);
+    latencies->name = NULL;
+    latencies->nStages = nStages;
+    assert((latencies->period = malloc(sizeof(LatencyHistogram*) * nStages)) != NULL);
+    assert((latencies->total = malloc(sizeof(LatencyHistogram*) * nStages)) != NULL);
+    for(i = 0; i < nStages; i++) {
+        latencies->period[i] = createLatencyHistogram(names[i], stallNs);
+        latencies->total[i] = createLatencyHistogram(names[i], stallNs);
+    }
+    latencies->merged = createLatencyHistogram(NULL, stallNs);
+    latencies->periodNs = (uint64_t) periodSeconds * 1000000000;
+    latencies->start = monotonicNanoseconds();
+    latencies->periodStart = latencies->start;
+    latencies->dumpGeneration = latencyDumpGeneration;
+    return latencies;
+}
+
+void recordStageLatency(StageLatencies* latencies, int stage, uint64_t ns) {
+    recordLatency(latencies->period[stage], ns);
+}
+
+/*
+ * Prints the latencies of every stage since the latencies were created.
+ */
+void printStageLatencies(StageLatencies* latencies, FILE* stream, uint64_t now) {
+    int i;
+    flockfile(stream);
+    fprintf(stream, "Latencies%s%s over the whole run of %.1f s:\n", latencies->name != NULL ? " of " : "", latencies->name != NULL ? latencies->name : "", (double) (now - latencies->start) / 1e9);
+    for(i = 0; i < latencies->nStages; i++) {
+        clearLatencyHistogram(latencies->merged);
+        latencies->merged->name = latencies->total[i]->name;
+        addLatencyHistogram(latencies->merged, latencies->total[i]);
+        addLatencyHistogram(latencies->merged, latencies->period[i]);
+        printLatencyHistogram(stream, latencies->merged);
+    }
+    fflush(stream);
+    funlockfile(stream);
+}
+
+/*
+ * Called once per loop with the current monotonic time. Prints and starts a
+ * new period when the current one has lasted periodNs, and prints the
+ * latencies of the whole run when SIGUSR1 has been received since the last
+ * call.
+ */
+void pollStageLatencies(StageLatencies* latencies, FILE* stream, uint64_t now) {
+    int i;
+
+    if(latencies->dumpGeneration != latencyDumpGeneration) {
+        latencies->dumpGeneration = latencyDumpGeneration;
+        printStageLatencies(latencies, stream, now);
+    }
+    if(latencies->periodNs == 0 || now - latencies->periodStart < latencies->periodNs) {
+        return;
+    }
+    flockfile(stream);
+    fprintf(stream, "Latencies%s%s over the last %.1f s:\n", latencies->name != NULL ? " of " : "", latencies->name != NULL ? latencies->name : "", (double) (now - latencies->periodStart) / 1e9);
+    for(i = 0; i < latencies->nStages; i++) {
+        printLatencyHistogram(stream, latencies->period[i]);
+        addLatencyHistogram(latencies->total[i], latencies->period[i]);
+        clearLatencyHistogram(latencies->period[i]);
+    }
+    fflush(stream);
+    funlockfile(stream);
+    latencies->periodStart = now;
+}
+
+void freeStageLatencies(StageLatencies* latencies) {
+    int i;
+    assert(latencies != NULL);
+    for(i = 0; i < latencies->nStages; i++) {
+        freeLatencyHistogram(latencies->period[i]);
+        freeLatencyHistogram(latencies->total[i]);
+    }
+    freeLatencyHistogram(latencies->merged);
+    free(latencies->period);
+    free(latencies->total);
+    free(latencies);
+}
+
+void latencySignalHandler(int signal) {
+    (void) signal;
+    latencyDumpGeneration++;
+}
+
+/*
+ * Makes SIGUSR1 request a report of the latencies of the whole run from the
+ * next call to pollStageLatencies of each StageLatencies. Returns 1 on
+ * success or 0 on failure.
+ */
+int setupLatencySignal(void) {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = latencySignalHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if(sigaction(SIGUSR1, &action, NULL) != 0) {
+        fprintf(stderr, "Failed to install the SIGUSR1 handler\n");
+        return 0;
+    }
+    return 1;
+}
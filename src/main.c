@@ -5,14 +5,28 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
 #include <unistd.h>
-#include <wiringPi.h>
+#include <sys/stat.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 #include "assertions.h"
+#include "backend.h"
+#include "cache.h"
+#include "capture.h"
 #include "circuit.h"
+#include "faults.h"
+#include "latency.h"
+#include "monitor.h"
 #include "network.h"
+#include "output.h"
+#include "recorder.h"
+#include "replay.h"
 #include "resistors.h"
+#include "ring.h"
 #include "samples.h"
 
 #ifndef CIRCUIT_FILNAME
@@ -27,11 +41,12 @@
 
 #define PROGRAM_NAME "edsac_status_monitor"
 #define MAX_ARG_LEN 128
-#define N_PARAMS 10
+#define N_PARAMS 22
 #define CONFIG_DIR "config"
 #define CHASSIS_FILE "circuit.xml"
 #define WIRING_FILE "wiring.xml"
 #define CALLIBRATION_FILE "calibrate.xml"
+#define CACHE_FILE "compiled.cache"
 #define TX_ADDRESS "127.0.0.1"
 #define TX_PORT 2000
 #define ECHO_ONLY 0
@@ -39,6 +54,11 @@
 #define FILE_SEPARATOR '/'
 #define SPI_CHANNEL 0
 #define SPI_SPEED 50000
+
+#define STAGE_SAMPLING 0
+#define N_SAMPLING_STAGES 1
+
+const char* samplingStageNames[N_SAMPLING_STAGES] = { "sampling" };
     
 typedef struct {
     const char* name;
@@ -53,12 +73,36 @@ typedef struct {
     char* circuitFile;
     char* wiringFile;
     char* calibrationFile;
+    char* cacheFile;
+    char* chassisListFile;
     char* samplesFile;
+    char* convertFile;
+    char* recordDirectory;
+    char* backendName;
+    char* outputFormat;
     char* txAddr;
     int txPort;
-    int echoOnly, readInOnly, helpMessage;
+    long maxSamples;
+    int replayThreads;
+    long latencyPeriod;
+    long renotifyPeriod;
+    long suppressWindow;
+    int echoOnly, readInOnly, helpMessage, noCache;
 } CmdLineOptions;
 
+/*
+ * The state of the thread that reads samples of every monitored chassis from
+ * the backend and queues the changed ones on each monitor's ring.
+ */
+typedef struct {
+    CmdLineOptions* options;
+    SamplingBackend* backend;
+    Monitor** monitors;
+    int nMonitors;
+    long nRead;
+    pthread_t thread;
+} SamplingThread;
+
 CmdLineParam params[N_PARAMS] = {
     { .name="--config-dir", .format="%s", .dest=NULL, .argsName="<directory>", .description="The directory in which to look for configuration files"},
     { .name="--chassis-file", .format="%s", .dest=NULL, .argsName="<filename>", .description="The filename of the chassis configuration file within the configuration directory"},
@@ -69,11 +113,23 @@ CmdLineParam params[N_PARAMS] = {
     { .name="--no-up-network", .format=NULL, .dest=NULL, .argsName=NULL, .description="Do not relay any error messages to the mothership and simply echo them"},
     { .name="--help", .format=NULL, .dest=NULL, .argsName=NULL, .description="Display this help message"},
     { .name="--read-config", .format=NULL, .dest=NULL, .argsName=NULL, .description="Echo the parsed contents of the configuration files"},
-    { .name="--test-sample-file", .format="%s", .dest=NULL, .argsName="<filename>", .description="The filename of a csv file containing sample data to use instead of sampling from GPIO pins"}
+    { .name="--test-sample-file", .format="%s", .dest=NULL, .argsName="<filename>", .description="The filename of a csv or capture file containing sample data to use instead of sampling from GPIO pins"},
+    { .name="--cache-file", .format="%s", .dest=NULL, .argsName="<filename>", .description="The filename of the compiled configuration cache within the configuration directory"},
+    { .name="--no-cache", .format=NULL, .dest=NULL, .argsName=NULL, .description="Always parse the configuration files instead of loading or writing the compiled cache"},
+    { .name="--write-sample-file", .format="%s", .dest=NULL, .argsName="<filename>", .description="Convert the test sample file to a binary capture file instead of checking it"},
+    { .name="--record", .format="%s", .dest=NULL, .argsName="<directory>", .description="Record every changed sample read from the backend to a ring of capture files in the directory"},
+    { .name="--backend", .format="%s", .dest=NULL, .argsName="<name>", .description="The backend to sample through, " BACKEND_NAME_WIRINGPI " for the GPIO pins or " BACKEND_NAME_SIMULATOR " for simulated pins (default " BACKEND_DEFAULT ")"},
+    { .name="--max-samples", .format="%ld", .dest=NULL, .argsName="<count>", .description="Stop after reading this many samples from the backend instead of sampling until stopped"},
+    { .name="--latency-period", .format="%ld", .dest=NULL, .argsName="<seconds>", .description="Report the latencies of sampling, queueing, checking and reporting to stderr this often, 0 to only report them on SIGUSR1 and at exit"},
+    { .name="--renotify-period", .format="%ld", .dest=NULL, .argsName="<seconds>", .description="Send a fault again this often while its valve stays failed, 0 to only send when it fails"},
+    { .name="--suppress-window", .format="%ld", .dest=NULL, .argsName="<milliseconds>", .description="Hold back a valve failing or clearing this soon after the last message about it"},
+    { .name="--output-format", .format="%s", .dest=NULL, .argsName="<format>", .description="The format errors are echoed in, " OUTPUT_FORMAT_TEXT ", " OUTPUT_FORMAT_JSON " or " OUTPUT_FORMAT_BINARY " (default " OUTPUT_FORMAT_TEXT ")"},
+    { .name="--chassis-list", .format="%s", .dest=NULL, .argsName="<filename>", .description="The filename of a list of chassis to monitor at once, each with its own configuration directory, instead of the one in the configuration directory"},
+    { .name="--replay-threads", .format="%d", .dest=NULL, .argsName="<count>", .description="The number of threads to check the test sample file on, 0 for one per processor (default 0)"}
 };
 
 AssertionsSet* parseCircuitFile(const char* filename) {
-    AssertionsSet* set;
+    AssertionsSet* set = NULL;
     xmlDoc *doc = NULL;
     xmlNode *root = NULL;
     
@@ -94,7 +150,7 @@ AssertionsSet* parseCircuitFile(const char* filename) {
     return set;
 }
 
-Wiring* parseWiringFile(const char* filename, AssertionsSet* set) {
+Wiring* parseWiringFile(const char* filename, SamplingBackend* backend, AssertionsSet* set) {
     Wiring* wiring = NULL;
     xmlDoc *doc = NULL;
     xmlNode *root = NULL;
@@ -109,7 +165,7 @@ Wiring* parseWiringFile(const char* filename, AssertionsSet* set) {
         fprintf(stderr, "Failed to parse \"%s\" as an XML document\n", filename);
     } else {
         root = xmlDocGetRootElement(doc);
-        wiring = createWiringFromXMLNode(set, root);
+        wiring = createWiringFromXMLNode(backend, set, root);
         xmlFreeDoc(doc);
     }
     
@@ -138,6 +194,28 @@ Calibration* parseCalibrateFile(const char* filename, AssertionsSet* set, Wiring
     return calibration;
 }
 
+ChassisList* parseChassisListFile(const char* filename, const ChassisConfig* defaults) {
+    ChassisList* list = NULL;
+    xmlDoc *doc = NULL;
+    xmlNode *root = NULL;
+    
+    if(access(filename, R_OK) != 0) {
+        fprintf(stderr, "The expected chassis list file \"%s\" does not exist or could not be read\n", filename);
+        return NULL;
+    }
+    
+    doc = xmlReadFile(filename, NULL, 0);
+    if(doc == NULL) {
+        fprintf(stderr, "Failed to parse \"%s\" as an XML document\n", filename);
+    } else {
+        root = xmlDocGetRootElement(doc);
+        list = createChassisListFromXMLNode(root, defaults);
+        xmlFreeDoc(doc);
+    }
+    
+    return list;
+}
+
 char* addressOfFileInDirectory(const char* dir, const char* file) {
     char* dst;
     int lenDir, lenFile;
@@ -156,31 +234,71 @@ char* addressOfFileInDirectory(const char* dir, const char* file) {
     return dst;
 }
 
-int get(CmdLineOptions* options, AssertionsSet** set, Wiring** wiring, Calibration** calibration) {
-    char* file;
+/*
+ * Loads the configuration of a chassis from the compiled cache when it was
+ * compiled from the current configuration files, otherwise parses the files
+ * and writes a new cache for the next start.
+ */
+int get(CmdLineOptions* options, ChassisConfig* chassis, SamplingBackend* backend, AssertionsSet** set, Wiring** wiring, Calibration** calibration) {
+    char* files[3];
+    char* cacheFile;
+    uint64_t key;
+    int i, useCache, loaded;
     
-    file = addressOfFileInDirectory(options->configDirectory, options->circuitFile);
-    *set = parseCircuitFile(file);
-    free(file);
+    files[0] = addressOfFileInDirectory(chassis->directory, chassis->circuitFile);
+    files[1] = addressOfFileInDirectory(chassis->directory, chassis->wiringFile);
+    files[2] = addressOfFileInDirectory(chassis->directory, chassis->calibrationFile);
+    cacheFile = addressOfFileInDirectory(chassis->directory, chassis->cacheFile);
+    useCache = !options->noCache && hashConfigFiles((const char**) files, 3, backend->name, &key);
     
-    if(*set != NULL) {
-        file = addressOfFileInDirectory(options->configDirectory, options->wiringFile);
-        *wiring = parseWiringFile(file, *set);
-        free(file);
-        
-        if(*wiring != NULL) {
-            file = addressOfFileInDirectory(options->configDirectory, options->calibrationFile);
-            *calibration = parseCalibrateFile(file, *set, *wiring);
-            free(file);
-            
-            if(*calibration != NULL) {
-                return 1;
+    loaded = useCache && loadConfigCache(cacheFile, key, set, wiring, calibration);
+    if(!loaded) {
+        *set = parseCircuitFile(files[0]);
+        if(*set != NULL) {
+            *wiring = parseWiringFile(files[1], backend, *set);
+            if(*wiring != NULL) {
+                *calibration = parseCalibrateFile(files[2], *set, *wiring);
+                if(*calibration != NULL) {
+                    loaded = 1;
+                    if(useCache) {
+                        writeConfigCache(cacheFile, key, *set, *wiring, *calibration);
+                    }
+                } else {
+                    freeWiring(*wiring);
+                    freeAssertionSet(*set);
+                }
+            } else {
+                freeAssertionSet(*set);
             }
-            freeWiring(*wiring);
         }
-        freeAssertionSet(*set);
     }
-    return 0;
+    
+    for(i = 0; i < 3; i++) {
+        free(files[i]);
+    }
+    free(cacheFile);
+    return loaded;
+}
+
+/*
+ * Returns the chassis listed in --chassis-list, or when it is not given the
+ * one chassis configured by the other options, which has no name.
+ */
+ChassisList* getChassisList(CmdLineOptions* options) {
+    ChassisConfig* defaults;
+    ChassisList* list;
+
+    defaults = createChassisConfig(NULL, options->configDirectory, options->circuitFile, options->wiringFile, options->calibrationFile, options->cacheFile, NULL);
+    if(strlen(options->chassisListFile) != 0) {
+        list = parseChassisListFile(options->chassisListFile, defaults);
+        freeChassisConfig(defaults);
+    } else {
+        assert((list = malloc(sizeof(ChassisList))) != NULL);
+        assert((list->chassis = malloc(sizeof(ChassisConfig*))) != NULL);
+        list->chassis[0] = defaults;
+        list->nChassis = 1;
+    }
+    return list;
 }
 
 void printHelp(int argc, char** argv) {
@@ -266,6 +384,35 @@ CmdLineOptions* parseCommandLine(int argc, char** argv) {
     //Samples File
     options->samplesFile = malloc(sizeof(char) * (MAX_ARG_LEN + 1));
     strcpy(options->samplesFile, "");
+    //Chassis List
+    options->chassisListFile = malloc(sizeof(char) * (MAX_ARG_LEN + 1));
+    strcpy(options->chassisListFile, "");
+    //Compiled Configuration Cache
+    options->cacheFile = malloc(sizeof(char) * (MAX_ARG_LEN + 1));
+    strcpy(options->cacheFile, CACHE_FILE);
+    options->noCache = 0;
+    //Binary Capture Conversion
+    options->convertFile = malloc(sizeof(char) * (MAX_ARG_LEN + 1));
+    strcpy(options->convertFile, "");
+    //Recording
+    options->recordDirectory = malloc(sizeof(char) * (MAX_ARG_LEN + 1));
+    strcpy(options->recordDirectory, "");
+    //Sampling Backend
+    options->backendName = malloc(sizeof(char) * (MAX_ARG_LEN + 1));
+    assert(strlen(BACKEND_DEFAULT) <= MAX_ARG_LEN);
+    strcpy(options->backendName, BACKEND_DEFAULT);
+    options->maxSamples = 0;
+    //Replay
+    options->replayThreads = 0;
+    //Latency Reports
+    options->latencyPeriod = LATENCY_REPORT_SECONDS;
+    //Fault Messages
+    options->renotifyPeriod = FAULT_RENOTIFY_SECONDS;
+    options->suppressWindow = FAULT_SUPPRESS_MS;
+    //Echoed Output
+    options->outputFormat = malloc(sizeof(char) * (MAX_ARG_LEN + 1));
+    assert(strlen(OUTPUT_FORMAT_TEXT) <= MAX_ARG_LEN);
+    strcpy(options->outputFormat, OUTPUT_FORMAT_TEXT);
     
     params[0].dest = options->configDirectory;
     params[1].dest = options->circuitFile;
@@ -277,6 +424,18 @@ CmdLineOptions* parseCommandLine(int argc, char** argv) {
     params[7].dest = &options->helpMessage;
     params[8].dest = &options->readInOnly;
     params[9].dest = options->samplesFile;
+    params[10].dest = options->cacheFile;
+    params[11].dest = &options->noCache;
+    params[12].dest = options->convertFile;
+    params[13].dest = options->recordDirectory;
+    params[14].dest = options->backendName;
+    params[15].dest = &options->maxSamples;
+    params[16].dest = &options->latencyPeriod;
+    params[17].dest = &options->renotifyPeriod;
+    params[18].dest = &options->suppressWindow;
+    params[19].dest = options->outputFormat;
+    params[20].dest = options->chassisListFile;
+    params[21].dest = &options->replayThreads;
     
     optionsParsingFailed = 0;
     for(i = 1; i < argc && !optionsParsingFailed; i++) {
@@ -321,129 +480,330 @@ CmdLineOptions* parseCommandLine(int argc, char** argv) {
     return options;
 }
 
+/*
+ * Writes every sample of samples, including the first which replay skips, to
+ * filename as a binary capture. Returns 1 on success or 0 on failure.
+ */
+int convertSamples(AssertionsSet* assertions, Samples* samples, const char* filename) {
+    CaptureWriter* writer;
+    char** names;
+    int i, ok;
+
+    assert((names = malloc(sizeof(char*) * (assertions->nTp + 1))) != NULL);
+    for(i = 0; i < assertions->nTp; i++) {
+        names[i] = assertions->tps[i]->tpName;
+    }
+    writer = createCaptureWriter(filename, names, assertions->nTp);
+    free(names);
+    if(writer == NULL) {
+        return 0;
+    }
+
+    ok = 1;
+    if(samples->nWindowRows > 0) {
+        do {
+            ok = captureWriterAppend(writer, samplesGetView(samples)) && ok;
+        } while(samplesNext(samples));
+    }
+    ok = closeCaptureWriter(writer) && ok;
+    if(!ok) {
+        fprintf(stderr, "Failed to write to file \"%s\"\n", filename);
+    }
+    return ok && !samplesFailed(samples);
+}
+
+/*
+ * Reads samples of every monitored chassis from the backend, one chassis
+ * after another, until --max-samples rounds have been read, or forever, and
+ * queues every sample that differs from the one before it on its monitor's
+ * ring. Nothing else is done on this thread, so a slow check or report
+ * never delays the next read.
+ */
+void* runSamplingThread(void* arg) {
+    SamplingThread* sampling = arg;
+    StageLatencies* latencies;
+    uint64_t start, now;
+    long maxSamples;
+    int i;
+
+    latencies = createStageLatencies(samplingStageNames, N_SAMPLING_STAGES, LATENCY_STALL_NS, sampling->options->latencyPeriod);
+    maxSamples = sampling->options->maxSamples;
+
+    for(sampling->nRead = 0; maxSamples <= 0 || sampling->nRead < maxSamples; sampling->nRead++) {
+        start = monotonicNanoseconds();
+        for(i = 0; i < sampling->nMonitors; i++) {
+            sampleMonitor(sampling->monitors[i], sampling->backend);
+        }
+        now = monotonicNanoseconds();
+        recordStageLatency(latencies, STAGE_SAMPLING, now - start);
+        pollStageLatencies(latencies, stderr, now);
+    }
+
+    for(i = 0; i < sampling->nMonitors; i++) {
+        sampleRingClose(sampling->monitors[i]->ring);
+    }
+    printStageLatencies(latencies, stderr, monotonicNanoseconds());
+    freeStageLatencies(latencies);
+    return NULL;
+}
+
+/*
+ * Samples every monitored chassis through the backend on a thread of its
+ * own and checks the changed samples of each chassis on a thread of the
+ * chassis' own, recording them too when --record is given, into a
+ * directory per chassis named after it when there are several. Samples until
+ * stopped or until --max-samples samples have been read. The time each
+ * stage takes is recorded and reported every --latency-period seconds, on
+ * SIGUSR1 and at the end.
+ */
+void sampleLive(CmdLineOptions* options, SamplingBackend* backend, Monitor** monitors, int nMonitors) {
+    SamplingThread sampling;
+    char* recordDirectory;
+    int i, started;
+
+    for(i = 0; i < nMonitors; i++) {
+        setupWiringPins(backend, monitors[i]->wiring);
+    }
+    setupResistors(backend, SPI_CHANNEL, SPI_SPEED);
+    for(i = 0; i < nMonitors; i++) {
+        writeOutCalibration(backend, SPI_CHANNEL, monitors[i]->wiring, monitors[i]->calibration);
+    }
+
+    setupLatencySignal();
+    if(strlen(options->recordDirectory) != 0 && monitors[0]->name != NULL && mkdir(options->recordDirectory, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Failed to create the recording directory \"%s\"\n", options->recordDirectory);
+    }
+    for(i = 0; i < nMonitors; i++) {
+        recordDirectory = NULL;
+        if(strlen(options->recordDirectory) != 0) {
+            recordDirectory = monitors[i]->name != NULL ? addressOfFileInDirectory(options->recordDirectory, monitors[i]->name) : options->recordDirectory;
+        }
+        startMonitor(monitors[i], recordDirectory, options->latencyPeriod);
+        if(recordDirectory != NULL && recordDirectory != options->recordDirectory) {
+            free(recordDirectory);
+        }
+    }
+
+    sampling.options = options;
+    sampling.backend = backend;
+    sampling.monitors = monitors;
+    sampling.nMonitors = nMonitors;
+    sampling.nRead = 0;
+    started = pthread_create(&sampling.thread, NULL, runSamplingThread, &sampling) == 0;
+    if(!started) {
+        fprintf(stderr, "Failed to start the sampling thread\n");
+        for(i = 0; i < nMonitors; i++) {
+            sampleRingClose(monitors[i]->ring);
+        }
+    } else {
+        pthread_join(sampling.thread, NULL);
+    }
+
+    for(i = 0; i < nMonitors; i++) {
+        stopMonitor(monitors[i], sampling.nRead);
+    }
+    teardownResistors(backend);
+}
+
+/*
+ * Creates a monitor for each chassis from the configuration loaded for it,
+ * which the monitors take over, and checks samples from the test sample file
+ * or the backend. Faults are sent to the mothership or, with
+ * --no-up-network, echoed to each chassis' output file or to stdout. Returns
+ * 1 once done or 0 if the monitors could not be set up.
+ */
+int monitorChassis(CmdLineOptions* options, SamplingBackend* backend, ChassisList* chassis, AssertionsSet** sets, Wiring** wirings, Calibration** calibrations) {
+    NetworkHandle* netHndl = NULL;
+    Monitor** monitors;
+    OutputSink* sink;
+    Samples* samples;
+    ChassisConfig* config;
+    pthread_mutex_t outputLock;
+    int* outputFds;
+    int i, nMonitors, nToStdout, ready;
+
+    nToStdout = 0;
+    for(i = 0; i < chassis->nChassis; i++) {
+        nToStdout += chassis->chassis[i]->outputFile == NULL;
+    }
+    ready = 1;
+    if(!options->echoOnly) {
+        netHndl = setupNetwork(options->txAddr, options->txPort);
+        if(netHndl == NULL) {
+            fprintf(stderr, "Failed to open network sender on %s:%d\n", options->txAddr, options->txPort);
+            ready = 0;
+        }
+    } else if(nToStdout > 1 && strcmp(options->outputFormat, OUTPUT_FORMAT_BINARY) == 0) {
+        fprintf(stderr, "Binary output of several chassis needs an output file for each\n");
+        ready = 0;
+    } else {
+        // The sinks write to stdout themselves, after anything already printed.
+        fflush(stdout);
+    }
+
+    pthread_mutex_init(&outputLock, NULL);
+    assert((monitors = malloc(sizeof(Monitor*) * chassis->nChassis)) != NULL);
+    assert((outputFds = malloc(sizeof(int) * chassis->nChassis)) != NULL);
+    for(nMonitors = 0; nMonitors < chassis->nChassis && ready; nMonitors++) {
+        config = chassis->chassis[nMonitors];
+        sink = NULL;
+        outputFds[nMonitors] = -1;
+        if(options->echoOnly) {
+            if(config->outputFile != NULL) {
+                outputFds[nMonitors] = open(config->outputFile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if(outputFds[nMonitors] < 0) {
+                    fprintf(stderr, "Failed to open the output file \"%s\"\n", config->outputFile);
+                    break;
+                }
+            }
+            sink = createOutputSink(options->outputFormat, sets[nMonitors], outputFds[nMonitors] >= 0 ? outputFds[nMonitors] : STDOUT_FILENO);
+            if(sink == NULL) {
+                fprintf(stderr, "Output sink setup failed\n");
+                if(outputFds[nMonitors] >= 0) {
+                    close(outputFds[nMonitors]);
+                }
+                break;
+            }
+            if(config->name != NULL && outputFds[nMonitors] < 0) {
+                labelOutputSink(sink, config->name, &outputLock);
+            }
+        }
+        monitors[nMonitors] = createMonitor(config->name, sets[nMonitors], wirings[nMonitors], calibrations[nMonitors], netHndl,
+                (uint64_t) options->renotifyPeriod * 1000000000, (uint64_t) options->suppressWindow * 1000000, sink);
+    }
+
+    if(nMonitors < chassis->nChassis) {
+        for(i = nMonitors; i < chassis->nChassis; i++) {
+            freeAssertionSet(sets[i]);
+            freeWiring(wirings[i]);
+            freeCalibration(calibrations[i]);
+        }
+    } else if(strlen(options->samplesFile) == 0) {
+        ready = checkMonitorPins(monitors, nMonitors);
+        if(ready) {
+            sampleLive(options, backend, monitors, nMonitors);
+        } else {
+            fprintf(stderr, "Chassis wiring check failed\n");
+        }
+    } else {
+        samples = createSamplesFromFile(monitors[0]->assertions, options->samplesFile);
+        if(samples == NULL) {
+            fprintf(stderr, "Samples file parsing failed\n");
+        } else {
+            replaySamples(monitors[0], samples, getReplayThreads(options->replayThreads));
+            if(samplesFailed(samples)) {
+                fprintf(stderr, "Samples file parsing failed\n");
+            }
+            freeSamples(samples);
+        }
+    }
+
+    for(i = 0; i < nMonitors; i++) {
+        freeMonitor(monitors[i]);
+        if(outputFds[i] >= 0) {
+            close(outputFds[i]);
+        }
+    }
+    if(netHndl != NULL) {
+        teardownNetwork(netHndl);
+    }
+    free(outputFds);
+    free(monitors);
+    pthread_mutex_destroy(&outputLock);
+    return ready && nMonitors == chassis->nChassis;
+}
+
 int main(int argc, char** argv) {
     LIBXML_TEST_VERSION
 
     CmdLineOptions* options;
-    NetworkHandle* netHndl;
-    AssertionsSet* assertions;
-    Wiring* wiring;
-    Calibration* calibration;
-    Samples* samples;
-    int* errorIndicesStore;
-    int nErrors, i, j, valveNo;
-    float f;
+    ChassisList* chassis;
+    AssertionsSet** sets;
+    Wiring** wirings;
+    Calibration** calibrations;
+    Samples* samples = NULL;
+    SamplingBackend* backend;
+    int i, nLoaded, ok;
     
     options = parseCommandLine(argc, argv);
     if(options == NULL) {
         return -1;
     }
     
+    ok = 1;
     if(options->helpMessage) {
         printHelp(argc, argv);
     } else {
-        // Parsing wiring files requires the wiringPi to be initialised to convert physical pins to BCM pins.
-        setupWiring();
+        // Parsing wiring files requires the backend to convert physical pins to GPIO pins.
+        backend = createSamplingBackend(options->backendName);
+        if(backend == NULL) {
+            fprintf(stderr, "Sampling backend setup failed\n");
+            freeOptions(options);
+            return -1;
+        }
         
-        i = get(options, &assertions, &wiring, &calibration);
+        chassis = getChassisList(options);
+        if(chassis == NULL) {
+            fprintf(stderr, "Chassis list parsing failed\n");
+            freeSamplingBackend(backend);
+            freeOptions(options);
+            return -1;
+        }
+        assert((sets = malloc(sizeof(AssertionsSet*) * chassis->nChassis)) != NULL);
+        assert((wirings = malloc(sizeof(Wiring*) * chassis->nChassis)) != NULL);
+        assert((calibrations = malloc(sizeof(Calibration*) * chassis->nChassis)) != NULL);
+        for(nLoaded = 0; nLoaded < chassis->nChassis; nLoaded++) {
+            if(!get(options, chassis->chassis[nLoaded], backend, &sets[nLoaded], &wirings[nLoaded], &calibrations[nLoaded])) {
+                break;
+            }
+        }
         
-        if(i == 0) {
+        if(nLoaded < chassis->nChassis) {
             fprintf(stderr, "Configuration file parsing failed\n");
-        } else {
-            if(options->readInOnly) {
-                printTPs(assertions);
-                printTruthTable(assertions);
-                printWiring(assertions, wiring);
-                printCalibration(assertions, wiring, calibration);
-            } else {
-                if(!options->echoOnly) {
-                    netHndl = setupNetwork(options->txAddr, options->txPort);
-                    if(netHndl == NULL) {
-                        fprintf(stderr, "Failed to open network sender on %s:%d\n", options->txAddr, options->txPort);
-                        return -1;
-                    }
-                }
-
-                if(strlen(options->samplesFile) == 0) {
-                    setupResistors(SPI_CHANNEL, SPI_SPEED);
-                    writeOutCalibration(SPI_CHANNEL, wiring, calibration);
-                } else {
-                    samples = createSamplesFromFile(assertions, options->samplesFile);
-                }
-
-                if(strlen(options->samplesFile) != 0 && samples == NULL) {
-                    fprintf(stderr, "Samples file parsing failed\n");
-                } else {
-                    char* tmpMsg = malloc(sizeof(char) * MAX_MSG_STR_LENGTH);
-                    errorIndicesStore = malloc((assertions->nTp - assertions->nInputs) * sizeof(int));
-
-                    int* tpValues = malloc(sizeof(int) * assertions->nTp);
-                    int* lastTPValues = malloc(sizeof(int) * assertions->nTp);
-                    int* tmpTPValues;
-                    for(;;) {
-                        if(strlen(options->samplesFile) == 0) {
-                            readInTPValues(wiring, tpValues);
-                        } else {
-                            if(!samplesNext(samples)) {
-                                break;
-                            }
-                            samplesGetValues(wiring, samples, tpValues);
-                        }
-                        for(i = 0; i < assertions->nTp; i++) {
-                            if(tpValues[i] != lastTPValues[i]) {
-                                checkTruthTable(assertions, tpValues, errorIndicesStore, &nErrors);
-                                if(nErrors > 0) {
-                                    if(options->echoOnly) {
-                                        printf("Data:");
-                                        for(j = 0; j < assertions->nTp; j++) {
-                                            printf(" %d", tpValues[j]);
-                                        }
-                                        printf("\n%d errors:\n", nErrors);
-                                        for(j = 0; j < nErrors; j++) {
-                                            valveNo = assertions->tps[errorIndicesStore[j]]->valveNo;
-                                            snprintf(tmpMsg, MAX_MSG_STR_LENGTH, "Valve %d failed, registered on tp %s", valveNo, assertions->tps[errorIndicesStore[j]]->tpName);
-                                            printf("Error[%d] %s\n", j, tmpMsg);
-                                        }
-                                    } else {
-                                        for(j = 0; j < nErrors; j++) {
-                                            sendNetworkMessage(netHndl, valveNo, tmpMsg);
-                                        }
-                                    }
-                                }
-                                break;
-                            }
-                        }
-                        tmpTPValues = tpValues;
-                        tpValues = lastTPValues;
-                        lastTPValues = tmpTPValues;
-                    }
-
-                    free(errorIndicesStore);
-                    free(tmpMsg);
+        } else if(options->readInOnly) {
+            for(i = 0; i < nLoaded; i++) {
+                if(chassis->chassis[i]->name != NULL) {
+                    printf("Chassis %s:\n", chassis->chassis[i]->name);
                 }
-                
-                if(netHndl != NULL) {
-                    teardownNetwork(netHndl);
+                printTPs(sets[i]);
+                printTruthTable(sets[i]);
+                printWiring(sets[i], wirings[i]);
+                printCalibration(sets[i], wirings[i], calibrations[i]);
+            }
+        } else if(strlen(options->convertFile) != 0) {
+            if(strlen(options->samplesFile) == 0) {
+                fprintf(stderr, "No test sample file given to convert\n");
+            } else if(nLoaded > 1) {
+                fprintf(stderr, "A test sample file can only be converted for one chassis\n");
+            } else {
+                samples = createSamplesFromFile(sets[0], options->samplesFile);
+                if(samples == NULL || !convertSamples(sets[0], samples, options->convertFile)) {
+                    fprintf(stderr, "Samples file conversion failed\n");
                 }
-                
-                if(strlen(options->samplesFile) == 0) {
-                    teardownResistors();
-                } else {
-                    if(samples != NULL) {
-                        freeSamples(samples);
-                    }
+                if(samples != NULL) {
+                    freeSamples(samples);
                 }
             }
-
-            freeAssertionSet(assertions);
-            freeWiring(wiring);
-            freeCalibration(calibration);
+        } else if(strlen(options->samplesFile) != 0 && nLoaded > 1) {
+            fprintf(stderr, "A test sample file can only be checked against one chassis\n");
+        } else {
+            ok = monitorChassis(options, backend, chassis, sets, wirings, calibrations);
+            nLoaded = 0;
         }
         
-        teardownWiring();
+        for(i = 0; i < nLoaded; i++) {
+            freeAssertionSet(sets[i]);
+            freeWiring(wirings[i]);
+            freeCalibration(calibrations[i]);
+        }
+        free(calibrations);
+        free(wirings);
+        free(sets);
+        freeChassisList(chassis);
+        freeSamplingBackend(backend);
     }
     
     freeOptions(options);
     
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    return ok ? EXIT_SUCCESS : -1;
+}
@@ -0,0 +1,524 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libxml/tree.h>
+#include <libxml/xmlstring.h>
+#include "monitor.h"
+#include "xmlutil.h"
+
+#define NODE_NAME_CHASSIS "chassis"
+#define ATTR_NAME_NAME "name"
+#define ATTR_NAME_DIR "dir"
+#define ATTR_NAME_CIRCUIT "circuit"
+#define ATTR_NAME_WIRING "wiring"
+#define ATTR_NAME_CALIBRATION "calibration"
+#define ATTR_NAME_CACHE "cache"
+#define ATTR_NAME_OUTPUT "output"
+
+const char* monitorStageNames[MONITOR_N_STAGES] = { "queueing", "checking", "reporting" };
+const char* monitorSectionNames[MONITOR_N_SECTIONS] = { "Failed:", "Cleared:", "Still failed:", "Mismatch:" };
+
+/*
+ * Returns a copy of text, or NULL if text is NULL.
+ */
+char* copyText(const char* text) {
+    char* copy;
+    if(text == NULL) {
+        return NULL;
+    }
+    assert((copy = malloc(sizeof(char) * (strlen(text) + 1))) != NULL);
+    strcpy(copy, text);
+    return copy;
+}
+
+ChassisConfig* createChassisConfig(const char* name, const char* directory, const char* circuitFile, const char* wiringFile, const char* calibrationFile, const char* cacheFile, const char* outputFile) {
+    ChassisConfig* config;
+    assert((config = malloc(sizeof(ChassisConfig))) != NULL);
+    config->name = copyText(name);
+    config->directory = copyText(directory);
+    config->circuitFile = copyText(circuitFile);
+    config->wiringFile = copyText(wiringFile);
+    config->calibrationFile = copyText(calibrationFile);
+    config->cacheFile = copyText(cacheFile);
+    config->outputFile = copyText(outputFile);
+    return config;
+}
+
+void freeChassisConfig(ChassisConfig* config) {
+    assert(config != NULL);
+    free(config->name);
+    free(config->directory);
+    free(config->circuitFile);
+    free(config->wiringFile);
+    free(config->calibrationFile);
+    free(config->cacheFile);
+    free(config->outputFile);
+    free(config);
+}
+
+/*
+ * Reads a chassis node, taking the file names it does not give from
+ * defaults. Returns NULL if it has no name or directory.
+ */
+ChassisConfig* createChassisConfigFromXMLNode(xmlNode* chassisNode, const ChassisConfig* defaults) {
+    const char* attrNames[] = { ATTR_NAME_NAME, ATTR_NAME_DIR, ATTR_NAME_CIRCUIT, ATTR_NAME_WIRING, ATTR_NAME_CALIBRATION, ATTR_NAME_CACHE, ATTR_NAME_OUTPUT };
+    xmlChar* values[7];
+    ChassisConfig* config;
+    int i;
+
+    for(i = 0; i < 7; i++) {
+        values[i] = xmlGetProp(chassisNode, attrNames[i]);
+    }
+    if(values[0] == NULL || values[0][0] == '\0') {
+        fprintf(stderr, "Chassis node has no name\n");
+        config = NULL;
+    } else if(values[1] == NULL) {
+        fprintf(stderr, "Chassis node \"%s\" has no dir attribute\n", values[0]);
+        config = NULL;
+    } else {
+        config = createChassisConfig(values[0], values[1],
+                values[2] != NULL ? (const char*) values[2] : defaults->circuitFile,
+                values[3] != NULL ? (const char*) values[3] : defaults->wiringFile,
+                values[4] != NULL ? (const char*) values[4] : defaults->calibrationFile,
+                values[5] != NULL ? (const char*) values[5] : defaults->cacheFile,
+                values[6]);
+    }
+    for(i = 0; i < 7; i++) {
+        xmlFree(values[i]);
+    }
+    return config;
+}
+
+/*
+ * Reads the chassis nodes of a chassis list. Every chassis must have a name
+ * of its own. Returns NULL if the list is empty or a node is invalid.
+ */
+ChassisList* createChassisListFromXMLNode(xmlNode* listNode, const ChassisConfig* defaults) {
+    assert(listNode != NULL);
+    assert(defaults != NULL);
+    ChassisList* list;
+    ChassisConfig* config;
+    xmlNode* child;
+    int i;
+
+    assert((list = malloc(sizeof(ChassisList))) != NULL);
+    list->chassis = NULL;
+    list->nChassis = 0;
+    for(child = listNode->children; child != NULL; child = child->next) {
+        if(child->type != XML_ELEMENT_NODE) {
+            continue;
+        }
+        if(!strEqual(child->name, NODE_NAME_CHASSIS)) {
+            fprintf(stderr, "Unknown node name: \"%s\"\n", child->name);
+            freeChassisList(list);
+            return NULL;
+        }
+        config = createChassisConfigFromXMLNode(child, defaults);
+        if(config == NULL) {
+            freeChassisList(list);
+            return NULL;
+        }
+        for(i = 0; i < list->nChassis; i++) {
+            if(strcmp(list->chassis[i]->name, config->name) == 0) {
+                fprintf(stderr, "Chassis \"%s\" is listed more than once\n", config->name);
+                freeChassisConfig(config);
+                freeChassisList(list);
+                return NULL;
+            }
+        }
+        assert((list->chassis = realloc(list->chassis, sizeof(ChassisConfig*) * (list->nChassis + 1))) != NULL);
+        list->chassis[list->nChassis++] = config;
+    }
+    if(list->nChassis == 0) {
+        fprintf(stderr, "Chassis list has no chassis nodes\n");
+        freeChassisList(list);
+        return NULL;
+    }
+    return list;
+}
+
+void freeChassisList(ChassisList* list) {
+    int i;
+    assert(list != NULL);
+    for(i = 0; i < list->nChassis; i++) {
+        freeChassisConfig(list->chassis[i]);
+    }
+    free(list->chassis);
+    free(list);
+}
+
+/*
+ * Creates the monitor of a chassis, which takes over its set, wiring,
+ * calibration and sink. Faults are sent through network when it is not
+ * NULL and otherwise echoed to sink. A name, when given, labels everything
+ * the monitor sends or reports, so must outlive it.
+ */
+Monitor* createMonitor(const char* name, AssertionsSet* assertions, Wiring* wiring, Calibration* calibration, NetworkHandle* network, uint64_t renotifyNs, uint64_t suppressNs, OutputSink* sink) {
+    Monitor* monitor;
+    int i, len;
+
+    assert((monitor = malloc(sizeof(Monitor))) != NULL);
+    monitor->name = name;
+    monitor->assertions = assertions;
+    monitor->wiring = wiring;
+    monitor->calibration = calibration;
+    monitor->network = network;
+    monitor->tracker = network != NULL ? createFaultTracker(assertions, renotifyNs, suppressNs) : NULL;
+    monitor->sink = sink;
+    monitor->checker = createSampleChecker(assertions);
+    monitor->recorder = NULL;
+    monitor->ring = NULL;
+    monitor->latencies = NULL;
+    monitor->started = 0;
+
+    len = name != NULL ? strlen(name) + 1 : 0;
+    assert((monitor->label = malloc(sizeof(char) * (len + 10 + 1))) != NULL);
+    if(name != NULL) {
+        sprintf(monitor->label, "Chassis %s: ", name);
+    } else {
+        strcpy(monitor->label, "");
+    }
+    for(i = 0; i < MONITOR_N_SECTIONS; i++) {
+        assert((monitor->faultSections[i] = malloc(sizeof(char) * (len + strlen(monitorSectionNames[i]) + 1))) != NULL);
+        if(name != NULL) {
+            sprintf(monitor->faultSections[i], "%s %s", name, monitorSectionNames[i]);
+        } else {
+            strcpy(monitor->faultSections[i], monitorSectionNames[i]);
+        }
+    }
+
+    assert((monitor->batch = malloc(sizeof(TruthWord*) * MONITOR_BATCH_SIZE)) != NULL);
+    assert((monitor->timestamps = malloc(sizeof(uint64_t) * MONITOR_BATCH_SIZE)) != NULL);
+    assert((monitor->results = malloc(sizeof(TruthWord) * (getErrorMaskWords(assertions) * MONITOR_BATCH_SIZE + 1))) != NULL);
+    assert((monitor->errorIndices = malloc(sizeof(int) * (assertions->nTp - assertions->nInputs + 1))) != NULL);
+    assert((monitor->sample = calloc(getSampleWords(assertions) + 1, sizeof(TruthWord))) != NULL);
+    assert((monitor->lastSample = calloc(getSampleWords(assertions) + 1, sizeof(TruthWord))) != NULL);
+    monitor->primed = 0;
+    monitor->dropped = 0;
+    return monitor;
+}
+
+/*
+ * Checks that no two monitors read the same GPIO pin and that no monitor
+ * holds the inputs with a pin another reads. Monitors may share a hold pin.
+ * Returns 1 if they do not clash, otherwise 0.
+ */
+int checkMonitorPins(Monitor** monitors, int nMonitors) {
+    Wiring* wiring;
+    int* owners;
+    int i, j, pin, maxPin, ok;
+
+    maxPin = 0;
+    for(i = 0; i < nMonitors; i++) {
+        wiring = monitors[i]->wiring;
+        maxPin = wiring->holdGpioPin > maxPin ? wiring->holdGpioPin : maxPin;
+        for(j = 0; j < wiring->nWires; j++) {
+            maxPin = wiring->wires[j]->gpioPin > maxPin ? wiring->wires[j]->gpioPin : maxPin;
+        }
+    }
+    assert((owners = malloc(sizeof(int) * (maxPin + 1))) != NULL);
+    for(pin = 0; pin <= maxPin; pin++) {
+        owners[pin] = -1;
+    }
+
+    ok = 1;
+    for(i = 0; i < nMonitors && ok; i++) {
+        wiring = monitors[i]->wiring;
+        for(j = 0; j < wiring->nWires && ok; j++) {
+            pin = wiring->wires[j]->gpioPin;
+            if(owners[pin] >= 0 && owners[pin] != i) {
+                fprintf(stderr, "Chassis \"%s\" and \"%s\" are both wired to GPIO pin %d\n", monitors[owners[pin]]->name, monitors[i]->name, pin);
+                ok = 0;
+            }
+            owners[pin] = i;
+        }
+    }
+    for(i = 0; i < nMonitors && ok; i++) {
+        pin = monitors[i]->wiring->holdGpioPin;
+        if(owners[pin] >= 0 && owners[pin] != i) {
+            fprintf(stderr, "The hold pin of chassis \"%s\", GPIO pin %d, is wired to a TP of chassis \"%s\"\n", monitors[i]->name, pin, monitors[owners[pin]]->name);
+            ok = 0;
+        }
+    }
+    free(owners);
+    return ok;
+}
+
+/*
+ * Sends the first nEvents events of the monitor's fault tracker to the
+ * mothership as one message, split only if it is too long, listing the
+ * valves that failed, cleared and are still failed. When the events come
+ * from a sample, mismatch is its error mask, of which each non zero word w
+ * is listed as w:bits in hex, bit b standing for TP nInputs + 64 * w + b.
+ * The headings of a named monitor start with its name.
+ */
+void sendMonitorFaults(Monitor* monitor, int nEvents, const TruthWord* mismatch) {
+    AssertionsSet* assertions = monitor->assertions;
+    FaultMessage message;
+    FaultEvent* event;
+    char item[MAX_MSG_STR_LENGTH];
+    int j, type, nMaskWords;
+
+    if(nEvents == 0) {
+        return;
+    }
+    startFaultMessage(&message);
+    for(type = FAULT_RAISED; type <= FAULT_RENOTIFIED; type++) {
+        for(j = 0; j < nEvents; j++) {
+            event = &monitor->tracker->events[j];
+            if(event->type != type) {
+                continue;
+            }
+            if(type == FAULT_CLEARED && event->nSuppressed > 0) {
+                snprintf(item, MAX_MSG_STR_LENGTH, "%d (%ld held back)", event->valveNo, event->nSuppressed);
+            } else if(type == FAULT_CLEARED) {
+                snprintf(item, MAX_MSG_STR_LENGTH, "%d", event->valveNo);
+            } else if(event->nSuppressed > 0) {
+                snprintf(item, MAX_MSG_STR_LENGTH, "%d (%s, %ld held back)", event->valveNo, assertions->tps[event->tp]->tpName, event->nSuppressed);
+            } else {
+                snprintf(item, MAX_MSG_STR_LENGTH, "%d (%s)", event->valveNo, assertions->tps[event->tp]->tpName);
+            }
+            appendFaultMessage(monitor->network, &message, monitor->faultSections[type], event->valveNo, item);
+        }
+    }
+    if(mismatch != NULL) {
+        nMaskWords = getErrorMaskWords(assertions);
+        for(j = 0; j < nMaskWords; j++) {
+            if(mismatch[j] != 0) {
+                snprintf(item, MAX_MSG_STR_LENGTH, "%d:%llx", j, (unsigned long long) mismatch[j]);
+                appendFaultDetail(monitor->network, &message, monitor->faultSections[MONITOR_SECTION_MISMATCH], item);
+            }
+        }
+    }
+    finishFaultMessage(monitor->network, &message);
+}
+
+/*
+ * Sends every valve state the monitor's fault tracker still holds back, as
+ * at now, if the monitor has one.
+ */
+void flushMonitorFaults(Monitor* monitor, uint64_t now) {
+    if(monitor->tracker != NULL) {
+        sendMonitorFaults(monitor, flushFaultTracker(monitor->tracker, now), NULL);
+    }
+}
+
+/*
+ * Writes the nErrors failed TPs of sample to the monitor's sink, or passes
+ * them to its fault tracker and sends the valve faults it raises, clears or
+ * sends again along with the sample's error mask, mismatch.
+ */
+void reportMonitorErrors(Monitor* monitor, const TruthWord* sample, const TruthWord* mismatch, int nErrors, uint64_t timestamp) {
+    if(monitor->tracker != NULL) {
+        sendMonitorFaults(monitor, updateFaultTracker(monitor->tracker, monitor->errorIndices, nErrors, timestamp), mismatch);
+    } else if(nErrors > 0) {
+        outputSample(monitor->sink, sample, monitor->errorIndices, nErrors);
+    }
+}
+
+/*
+ * Reports the faults found in the n packed samples of batch, whose error
+ * masks are in results, timing each report from checked when the monitor
+ * has latencies. Sample i was taken at timestamps[i], or now if timestamps
+ * is NULL.
+ */
+void reportMonitorBatch(Monitor* monitor, const TruthWord** batch, const TruthWord* results, const uint64_t* timestamps, int n, uint64_t checked) {
+    AssertionsSet* assertions = monitor->assertions;
+    StageLatencies* latencies = monitor->latencies;
+    uint64_t start, now;
+    int i, nErrors, nMaskWords;
+
+    nMaskWords = getErrorMaskWords(assertions);
+    now = timestamps == NULL ? monotonicNanoseconds() : 0;
+    for(i = 0; i < n; i++) {
+        nErrors = getErrorIndicesFromMask(assertions, results + (long) i * nMaskWords, monitor->errorIndices);
+        if(nErrors > 0 || (monitor->tracker != NULL && monitor->tracker->nActive > 0)) {
+            reportMonitorErrors(monitor, batch[i], results + (long) i * nMaskWords, nErrors, timestamps != NULL ? timestamps[i] : now);
+            if(latencies != NULL) {
+                start = checked;
+                checked = monotonicNanoseconds();
+                recordStageLatency(latencies, MONITOR_STAGE_REPORTING, checked - start);
+            }
+        }
+    }
+}
+
+/*
+ * Checks the n packed samples of batch, following on from those the
+ * monitor has seen, and reports the faults found in each, timing the check
+ * and each report when the monitor has latencies. Sample i was taken at
+ * timestamps[i], or now if timestamps is NULL.
+ */
+void checkMonitorBatch(Monitor* monitor, const TruthWord** batch, const uint64_t* timestamps, int n) {
+    StageLatencies* latencies = monitor->latencies;
+    uint64_t start, checked;
+
+    start = latencies != NULL ? monotonicNanoseconds() : 0;
+    checkSampleChanges(monitor->assertions, monitor->checker, batch, n, monitor->results);
+    checked = 0;
+    if(latencies != NULL) {
+        checked = monotonicNanoseconds();
+        recordStageLatency(latencies, MONITOR_STAGE_CHECKING, checked - start);
+    }
+    reportMonitorBatch(monitor, batch, monitor->results, timestamps, n, checked);
+}
+
+/*
+ * Reads a sample of the monitor's chassis from the backend and queues it on
+ * the monitor's ring if it is the first or differs from the one before it.
+ * When the ring is full the changed sample is dropped and counted, and the
+ * next sample is queued even if it is unchanged. Called on the sampling
+ * thread only.
+ */
+void sampleMonitor(Monitor* monitor, SamplingBackend* backend) {
+    TruthWord* slot;
+    TruthWord* tmpSample;
+    int changed;
+
+    readInPackedTPValues(backend, monitor->wiring, monitor->sample);
+    changed = !monitor->primed || memcmp(monitor->sample, monitor->lastSample, sizeof(TruthWord) * getSampleWords(monitor->assertions)) != 0;
+    monitor->primed = 1;
+    if(changed || monitor->dropped) {
+        slot = sampleRingReserve(monitor->ring);
+        monitor->dropped = slot == NULL;
+        if(slot != NULL) {
+            memcpy(slot, monitor->sample, sizeof(TruthWord) * getSampleWords(monitor->assertions));
+            sampleRingPublish(monitor->ring, monotonicNanoseconds());
+        } else if(changed) {
+            sampleRingOverrun(monitor->ring);
+        }
+        tmpSample = monitor->sample;
+        monitor->sample = monitor->lastSample;
+        monitor->lastSample = tmpSample;
+    }
+}
+
+/*
+ * Checks every changed sample queued on the monitor's ring, recording it too
+ * when the monitor has a recorder, in batches of up to MONITOR_BATCH_SIZE as
+ * they arrive, until the ring is closed and empty. While no samples are
+ * waiting faults held back are sent and echoed output is written, and the
+ * faults still held back when the ring is finished are sent. Samples
+ * that overran the ring are reported at most once every
+ * MONITOR_OVERRUN_REPORT_NS.
+ */
+void* runMonitor(void* arg) {
+    Monitor* monitor = arg;
+    struct timespec idle = { 0, SAMPLE_RING_IDLE_NS };
+    uint64_t now, lastOverrunReport;
+    long i, n, nOverruns, nReportedOverruns;
+
+    nReportedOverruns = 0;
+    lastOverrunReport = 0;
+    while(!sampleRingFinished(monitor->ring)) {
+        n = sampleRingPeek(monitor->ring, monitor->batch, monitor->timestamps, MONITOR_BATCH_SIZE);
+        if(n == 0) {
+            if(monitor->tracker != NULL && monitor->tracker->nActive > 0) {
+                sendMonitorFaults(monitor, pollFaultTracker(monitor->tracker, monotonicNanoseconds()), NULL);
+            }
+            if(monitor->sink != NULL && monitor->sink->len > 0) {
+                flushOutputSink(monitor->sink);
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        now = monotonicNanoseconds();
+        for(i = 0; i < n; i++) {
+            recordStageLatency(monitor->latencies, MONITOR_STAGE_QUEUEING, now - monitor->timestamps[i]);
+            if(monitor->recorder != NULL) {
+                recorderAppend(monitor->recorder, monitor->batch[i], monitor->timestamps[i]);
+            }
+        }
+        checkMonitorBatch(monitor, monitor->batch, monitor->timestamps, n);
+        sampleRingRelease(monitor->ring, n);
+        nOverruns = sampleRingOverruns(monitor->ring);
+        if(nOverruns != nReportedOverruns && now - lastOverrunReport >= MONITOR_OVERRUN_REPORT_NS) {
+            fprintf(stderr, "%s%ld changed samples overran the sample queue, checking is falling behind sampling\n", monitor->label, nOverruns - nReportedOverruns);
+            nReportedOverruns = nOverruns;
+            lastOverrunReport = now;
+        }
+        pollStageLatencies(monitor->latencies, stderr, now);
+    }
+    flushMonitorFaults(monitor, monotonicNanoseconds());
+    return NULL;
+}
+
+/*
+ * Creates the ring the sampling thread queues the monitor's samples on and
+ * starts checking them on a thread of the monitor's own, recording them to
+ * recordDirectory unless it is NULL. Returns 1 on success or 0 if the
+ * thread could not be started, in which case the ring is closed.
+ */
+int startMonitor(Monitor* monitor, const char* recordDirectory, long latencyPeriod) {
+    if(recordDirectory != NULL) {
+        monitor->recorder = createRecorder(recordDirectory, monitor->assertions, RECORD_SEGMENTS, RECORD_SEGMENT_BYTES);
+        if(monitor->recorder == NULL) {
+            fprintf(stderr, "%sRecording to \"%s\" failed to start\n", monitor->label, recordDirectory);
+        }
+    }
+    monitor->latencies = createStageLatencies(monitorStageNames, MONITOR_N_STAGES, LATENCY_STALL_NS, latencyPeriod);
+    monitor->latencies->name = monitor->name;
+    monitor->ring = createSampleRing(getSampleWords(monitor->assertions), SAMPLE_RING_SLOTS);
+    monitor->started = pthread_create(&monitor->thread, NULL, runMonitor, monitor) == 0;
+    if(!monitor->started) {
+        fprintf(stderr, "%sFailed to start the checking thread\n", monitor->label);
+        sampleRingClose(monitor->ring);
+    }
+    return monitor->started;
+}
+
+/*
+ * Waits for the monitor's thread to check what is left on its ring, which
+ * must have been closed, and reports its latencies and how its samples were
+ * queued, nRead samples having been read.
+ */
+void stopMonitor(Monitor* monitor, long nRead) {
+    if(monitor->started) {
+        pthread_join(monitor->thread, NULL);
+        monitor->started = 0;
+    }
+    printStageLatencies(monitor->latencies, stderr, monotonicNanoseconds());
+    fprintf(stderr, "%sRead %ld samples, queued %ld changed samples, %ld overran the sample queue, at most %ld were queued\n",
+            monitor->label, nRead, monitor->ring->nPushed, sampleRingOverruns(monitor->ring), monitor->ring->maxDepth);
+}
+
+/*
+ * Frees the monitor along with the set, wiring, calibration and sink it
+ * took over. Writes what is left of the sink's output first.
+ */
+void freeMonitor(Monitor* monitor) {
+    int i;
+    assert(monitor != NULL);
+    if(monitor->sink != NULL) {
+        freeOutputSink(monitor->sink);
+    }
+    if(monitor->tracker != NULL) {
+        freeFaultTracker(monitor->tracker);
+    }
+    if(monitor->recorder != NULL) {
+        freeRecorder(monitor->recorder);
+    }
+    if(monitor->ring != NULL) {
+        freeSampleRing(monitor->ring);
+    }
+    if(monitor->latencies != NULL) {
+        freeStageLatencies(monitor->latencies);
+    }
+    freeSampleChecker(monitor->checker);
+    for(i = 0; i < MONITOR_N_SECTIONS; i++) {
+        free(monitor->faultSections[i]);
+    }
+    free(monitor->label);
+    free(monitor->lastSample);
+    free(monitor->sample);
+    free(monitor->errorIndices);
+    free(monitor->results);
+    free(monitor->timestamps);
+    free(monitor->batch);
+    freeAssertionSet(monitor->assertions);
+    freeWiring(monitor->wiring);
+    freeCalibration(monitor->calibration);
+    free(monitor);
+}
@@ -3,43 +3,326 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "network.h"
 #include "edsac_representation.h"
 #include "edsac_sending.h"
 #include "edsac_arguments.h"
 
+/*
+ * Writes as many of the n faults as fit in one message into text, separated
+ * by "; ", noting how many times each was reported if it was coalesced and
+ * the note fits. Returns the number of faults written, at least 1.
+ */
+int packQueuedFaults(const QueuedFault* faults, int n, char* text) {
+    char suffix[32];
+    int i, len, faultLen, suffixLen;
+
+    len = 0;
+    for(i = 0; i < n; i++) {
+        faultLen = strlen(faults[i].msg);
+        suffixLen = 0;
+        if(faults[i].count > 1) {
+            suffixLen = snprintf(suffix, sizeof(suffix), " (reported %d times)", faults[i].count);
+            if(faultLen + suffixLen >= MAX_MSG_STR_LENGTH) {
+                suffixLen = 0;
+            }
+        }
+        if(i > 0 && len + 2 + faultLen + suffixLen >= MAX_MSG_STR_LENGTH) {
+            break;
+        }
+        if(i > 0) {
+            memcpy(text + len, "; ", 2);
+            len += 2;
+        }
+        memcpy(text + len, faults[i].msg, faultLen);
+        len += faultLen;
+        memcpy(text + len, suffix, suffixLen);
+        len += suffixLen;
+    }
+    text[len] = '\0';
+    return i;
+}
+
+/*
+ * Sends one message as from valveNo. Returns 1 on success or 0 on failure.
+ */
+int sendFaultText(NetworkHandle* network, int valveNo, char* text) {
+    bool state;
+
+    hardware_error_valve(network->msgStruct, valveNo, text);
+    state = send_message(network->msgStruct);
+    free_message(network->msgStruct);
+    if(state != true) {
+        fprintf(stderr, "Could not send message\n");
+        return 0;
+    }
+    return 1;
+}
+
+void reconnectNetwork(NetworkHandle* network) {
+    if(network->connected) {
+        stop_sending();
+    }
+    network->connected = start_sending(network->address, sizeof(*network->address)) == true;
+    network->nReconnects++;
+    if(!network->connected) {
+        fprintf(stderr, "Could not start sending\n");
+    }
+}
+
+/*
+ * Waits for ms milliseconds or until the network is torn down. Returns 0 if
+ * it is being torn down, otherwise 1.
+ */
+int waitNetworkBackoff(NetworkHandle* network, int ms) {
+    struct timespec deadline;
+    int stopping;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (long) (ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&network->lock);
+    while(!network->stopping && pthread_cond_timedwait(&network->ready, &network->lock, &deadline) == 0);
+    stopping = network->stopping;
+    pthread_mutex_unlock(&network->lock);
+    return !stopping;
+}
+
+/*
+ * Takes up to NETWORK_BATCH_MESSAGES faults from the queue at a time and
+ * sends them, packed into as few messages as fit, without holding the lock.
+ * A message that fails to send is sent again after reconnecting. Once the
+ * network is being torn down the faults left are sent, or dropped if a send
+ * fails.
+ */
+void* runNetworkSender(void* arg) {
+    NetworkHandle* network = arg;
+    char text[MAX_MSG_STR_LENGTH];
+    int i, n, nPacked, backoff;
+
+    backoff = NETWORK_BACKOFF_MIN_MS;
+    pthread_mutex_lock(&network->lock);
+    for(;;) {
+        while(network->nQueued == 0 && !network->stopping) {
+            pthread_cond_wait(&network->ready, &network->lock);
+        }
+        if(network->nQueued == 0) {
+            break;
+        }
+        for(n = 0; n < NETWORK_BATCH_MESSAGES && network->nQueued > 0; n++) {
+            network->batch[n] = network->queue[network->head];
+            network->head = (network->head + 1) % NETWORK_QUEUE_MESSAGES;
+            network->nQueued--;
+        }
+        pthread_mutex_unlock(&network->lock);
+
+        for(i = 0; i < n; ) {
+            nPacked = packQueuedFaults(network->batch + i, n - i, text);
+            if(network->connected && sendFaultText(network, network->batch[i].valveNo, text)) {
+                network->nSent += nPacked;
+                network->nMessages++;
+                backoff = NETWORK_BACKOFF_MIN_MS;
+                i += nPacked;
+            } else if(waitNetworkBackoff(network, backoff)) {
+                backoff = backoff * 2 < NETWORK_BACKOFF_MAX_MS ? backoff * 2 : NETWORK_BACKOFF_MAX_MS;
+                reconnectNetwork(network);
+            } else {
+                break;
+            }
+        }
+
+        pthread_mutex_lock(&network->lock);
+        if(i < n) {
+            network->nDropped += n - i + network->nQueued;
+            network->nQueued = 0;
+        }
+    }
+    pthread_mutex_unlock(&network->lock);
+    return NULL;
+}
+
 NetworkHandle* setupNetwork(const char* addrStr, int port) {
     assert(MAX_MSG_STR_LENGTH <= MAX_MSG_LEN);
     bool state;
     struct sockaddr* adr = alloc_addr(addrStr, port);
     assert(NULL != adr);
     state = start_sending(adr, sizeof(*adr));
-    free(adr);
     if(state != true) {
         fprintf(stderr, "Could not start sending\n");
+        free(adr);
+        return NULL;
+    }
+    NetworkHandle* network;
+    assert((network = malloc(sizeof(NetworkHandle))) != NULL);
+    assert((network->msgStruct = malloc(sizeof(Message))) != NULL);
+    assert((network->queue = malloc(sizeof(QueuedFault) * NETWORK_QUEUE_MESSAGES)) != NULL);
+    assert((network->batch = malloc(sizeof(QueuedFault) * NETWORK_BATCH_MESSAGES)) != NULL);
+    network->address = adr;
+    network->head = 0;
+    network->nQueued = 0;
+    network->nSent = 0;
+    network->nMessages = 0;
+    network->nCoalesced = 0;
+    network->nDropped = 0;
+    network->nReconnects = 0;
+    network->connected = 1;
+    network->stopping = 0;
+    pthread_mutex_init(&network->lock, NULL);
+    pthread_cond_init(&network->ready, NULL);
+    if(pthread_create(&network->thread, NULL, runNetworkSender, network) != 0) {
+        fprintf(stderr, "Could not start the network sender thread\n");
+        stop_sending();
+        pthread_cond_destroy(&network->ready);
+        pthread_mutex_destroy(&network->lock);
+        free(network->batch);
+        free(network->queue);
+        free(network->msgStruct);
+        free(network->address);
+        free(network);
         return NULL;
     }
-    NetworkHandle* network = malloc(sizeof(NetworkHandle));
-    network->msgStruct = malloc(sizeof(Message));
     return network;
 }
 
-int sendNetworkMessage(NetworkHandle* network, int valveNo, char* msg) {
-    bool state;
-    hardware_error_valve(network->msgStruct, valveNo, msg);
-    state = send_message(network->msgStruct);
-    free_message(network->msgStruct);
-    if(state != true) {
-        fprintf(stderr, "Could not send message\n");
-        return -1;
+/*
+ * Queues a fault on valveNo to be sent, the first keyLen characters of msg
+ * saying which valves failed or cleared. If the fault queued last is on the
+ * same valve and reports the same, the fault is coalesced into it and its
+ * details replaced by those of msg. Only the last is looked at so faults on
+ * a valve are never reordered. A keyLen of 0 is never coalesced. Returns 1
+ * if it was queued or coalesced, or -1 if it was dropped because the queue
+ * was full.
+ */
+int sendNetworkMessage(NetworkHandle* network, int valveNo, char* msg, int keyLen) {
+    QueuedFault* fault;
+
+    pthread_mutex_lock(&network->lock);
+    if(network->nQueued > 0 && keyLen > 0) {
+        fault = &network->queue[(network->head + network->nQueued - 1) % NETWORK_QUEUE_MESSAGES];
+        if(fault->valveNo == valveNo && fault->keyLen == keyLen && strncmp(fault->msg, msg, keyLen) == 0) {
+            snprintf(fault->msg, MAX_MSG_STR_LENGTH, "%s", msg);
+            fault->count++;
+            network->nCoalesced++;
+            pthread_mutex_unlock(&network->lock);
+            return 1;
+        }
+    }
+    if(network->nQueued == NETWORK_QUEUE_MESSAGES) {
+        network->nDropped++;
+        if(NETWORK_DROP_POLICY == NETWORK_DROP_NEWEST) {
+            pthread_mutex_unlock(&network->lock);
+            return -1;
+        }
+        network->head = (network->head + 1) % NETWORK_QUEUE_MESSAGES;
+        network->nQueued--;
     }
+    fault = &network->queue[(network->head + network->nQueued) % NETWORK_QUEUE_MESSAGES];
+    fault->valveNo = valveNo;
+    fault->count = 1;
+    fault->keyLen = keyLen;
+    snprintf(fault->msg, MAX_MSG_STR_LENGTH, "%s", msg);
+    network->nQueued++;
+    pthread_cond_signal(&network->ready);
+    pthread_mutex_unlock(&network->lock);
     return 1;
 }
 
+void startFaultMessage(FaultMessage* message) {
+    message->len = 0;
+    message->keyLen = -1;
+    message->valveNo = -1;
+    message->section = NULL;
+    message->nSent = 0;
+}
+
+void appendFaultText(FaultMessage* message, const char* section, const char* item) {
+    int len;
+    if(section != message->section) {
+        len = snprintf(message->text + message->len, MAX_MSG_STR_LENGTH - message->len, "%s%s %s", message->len > 0 ? " " : "", section, item);
+    } else {
+        len = snprintf(message->text + message->len, MAX_MSG_STR_LENGTH - message->len, " %s", item);
+    }
+    message->len = message->len + len < MAX_MSG_STR_LENGTH ? message->len + len : MAX_MSG_STR_LENGTH - 1;
+    message->section = section;
+}
+
+/*
+ * Sends the message so far if item would not fit after it in section.
+ */
+void makeRoomInFaultMessage(NetworkHandle* network, FaultMessage* message, const char* section, const char* item) {
+    int len;
+    len = (message->len > 0 ? 1 : 0) + (section != message->section ? strlen(section) + 1 : 0) + strlen(item);
+    if(message->len > 0 && message->len + len >= MAX_MSG_STR_LENGTH) {
+        finishFaultMessage(network, message);
+    }
+}
+
+/*
+ * Appends a fault on valveNo to section of message, first sending the
+ * message so far if item would not fit. Faults go before any details.
+ */
+void appendFaultMessage(NetworkHandle* network, FaultMessage* message, const char* section, int valveNo, const char* item) {
+    makeRoomInFaultMessage(network, message, section, item);
+    if(message->len == 0) {
+        message->valveNo = valveNo;
+    }
+    appendFaultText(message, section, item);
+}
+
+/*
+ * Appends a detail of the faults to section of message, first sending the
+ * message so far if item would not fit.
+ */
+void appendFaultDetail(NetworkHandle* network, FaultMessage* message, const char* section, const char* item) {
+    makeRoomInFaultMessage(network, message, section, item);
+    if(message->keyLen < 0) {
+        message->keyLen = message->len;
+    }
+    appendFaultText(message, section, item);
+}
+
+/*
+ * Sends the message so far, if there is any, and empties it. Returns the
+ * number of messages sent for it since it was started.
+ */
+int finishFaultMessage(NetworkHandle* network, FaultMessage* message) {
+    if(message->len > 0) {
+        sendNetworkMessage(network, message->valveNo, message->text, message->keyLen < 0 ? message->len : message->keyLen);
+        message->nSent++;
+    }
+    message->len = 0;
+    message->keyLen = -1;
+    message->section = NULL;
+    return message->nSent;
+}
+
+/*
+ * Sends the faults still queued, unless a send fails, and stops sending.
+ */
 void teardownNetwork(NetworkHandle* network) {
+    pthread_mutex_lock(&network->lock);
+    network->stopping = 1;
+    pthread_cond_broadcast(&network->ready);
+    pthread_mutex_unlock(&network->lock);
+    pthread_join(network->thread, NULL);
+
+    if(network->nCoalesced > 0 || network->nDropped > 0 || network->nReconnects > 0) {
+        fprintf(stderr, "Sent %ld faults in %ld messages, coalesced %ld into faults already queued, dropped %ld and reconnected %ld times\n",
+                network->nSent, network->nMessages, network->nCoalesced, network->nDropped, network->nReconnects);
+    }
+    if(network->connected) {
+        stop_sending();
+    }
+    pthread_cond_destroy(&network->ready);
+    pthread_mutex_destroy(&network->lock);
+    free(network->batch);
+    free(network->queue);
     free(network->msgStruct);
+    free(network->address);
     free(network);
-    
-    stop_sending();
 }
-
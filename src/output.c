@@ -0,0 +1,316 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "output.h"
+
+/*
+ * Writes the buffered output to the sink's file. Returns 1 on success or 0
+ * if this or an earlier write failed.
+ */
+int flushOutputSink(OutputSink* sink) {
+    size_t written;
+    ssize_t n;
+
+    if(sink->lock != NULL) {
+        pthread_mutex_lock(sink->lock);
+    }
+    for(written = 0; written < sink->len && !sink->failed; written += n) {
+        n = write(sink->fd, sink->buffer + written, sink->len - written);
+        if(n < 0 && errno == EINTR) {
+            n = 0;
+        } else if(n <= 0) {
+            fprintf(stderr, "Failed to write the %s output\n", sink->name);
+            sink->failed = 1;
+        }
+    }
+    if(sink->lock != NULL) {
+        pthread_mutex_unlock(sink->lock);
+    }
+    sink->len = 0;
+    return !sink->failed;
+}
+
+/*
+ * Makes room for n more bytes in the buffer and returns where to write them.
+ */
+char* reserveOutput(OutputSink* sink, size_t n) {
+    if(sink->len + n > sink->size) {
+        flushOutputSink(sink);
+        if(n > sink->size) {
+            sink->size = n;
+            assert((sink->buffer = realloc(sink->buffer, sink->size)) != NULL);
+        }
+    }
+    return sink->buffer + sink->len;
+}
+
+char* appendUnsigned(char* dest, unsigned int value) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while(value > 0);
+    while(n > 0) {
+        *dest++ = digits[--n];
+    }
+    return dest;
+}
+
+char* appendText(char* dest, const char* text, int len) {
+    memcpy(dest, text, len);
+    return dest + len;
+}
+
+char* appendBits(char* dest, const TruthWord* sample, int n, int spaced) {
+    int i;
+    for(i = 0; i < n; i++) {
+        if(spaced) {
+            *dest++ = ' ';
+        }
+        *dest++ = '0' + (int) ((sample[i / TRUTH_WORD_BITS] >> (i % TRUTH_WORD_BITS)) & 1);
+    }
+    return dest;
+}
+
+char* appendLittleEndian(char* dest, uint64_t value, int nBytes) {
+    int i;
+    for(i = 0; i < nBytes; i++) {
+        *dest++ = (char) (value >> (8 * i));
+    }
+    return dest;
+}
+
+void writeTextSample(OutputSink* sink, const TruthWord* sample, const int* errorIndices, int nErrors) {
+    char* start;
+    char* p;
+    int j;
+
+    start = p = reserveOutput(sink, sink->labelLen + 5 + 2 * sink->nTp + 1 + 10 + 9 + (size_t) nErrors * (6 + 10 + sink->maxErrorTextLen));
+    if(sink->label != NULL) {
+        p = appendText(p, sink->label, sink->labelLen);
+    }
+    p = appendText(p, "Data:", 5);
+    p = appendBits(p, sample, sink->nTp, 1);
+    *p++ = '\n';
+    p = appendUnsigned(p, nErrors);
+    p = appendText(p, " errors:\n", 9);
+    for(j = 0; j < nErrors; j++) {
+        p = appendText(p, "Error[", 6);
+        p = appendUnsigned(p, j);
+        p = appendText(p, sink->errorTexts[errorIndices[j]], sink->errorTextLens[errorIndices[j]]);
+    }
+    sink->len += p - start;
+}
+
+void writeJSONSample(OutputSink* sink, const TruthWord* sample, const int* errorIndices, int nErrors) {
+    char* start;
+    char* p;
+    int j;
+
+    start = p = reserveOutput(sink, 1 + sink->labelLen + 10 + sink->nTp + 13 + (size_t) nErrors * (1 + sink->maxErrorTextLen) + 3);
+    *p++ = '{';
+    if(sink->label != NULL) {
+        p = appendText(p, sink->label, sink->labelLen);
+    }
+    p = appendText(p, "\"values\":\"", 10);
+    p = appendBits(p, sample, sink->nTp, 0);
+    p = appendText(p, "\",\"errors\":[", 12);
+    for(j = 0; j < nErrors; j++) {
+        if(j > 0) {
+            *p++ = ',';
+        }
+        p = appendText(p, sink->errorTexts[errorIndices[j]], sink->errorTextLens[errorIndices[j]]);
+    }
+    p = appendText(p, "]}\n", 3);
+    sink->len += p - start;
+}
+
+void writeBinarySample(OutputSink* sink, const TruthWord* sample, const int* errorIndices, int nErrors) {
+    char* start;
+    char* p;
+    int j;
+
+    start = p = reserveOutput(sink, 4 + (size_t) sink->nSampleWords * 8 + (size_t) nErrors * 4);
+    p = appendLittleEndian(p, nErrors, 4);
+    for(j = 0; j < sink->nSampleWords; j++) {
+        p = appendLittleEndian(p, sample[j], 8);
+    }
+    for(j = 0; j < nErrors; j++) {
+        p = appendLittleEndian(p, errorIndices[j], 4);
+    }
+    sink->len += p - start;
+}
+
+/*
+ * Returns name with the characters JSON strings cannot hold escaped.
+ */
+char* escapeJSON(const char* name) {
+    char* escaped;
+    char* p;
+    const char* c;
+
+    assert((escaped = malloc(sizeof(char) * (6 * strlen(name) + 1))) != NULL);
+    for(p = escaped, c = name; *c != '\0'; c++) {
+        if(*c == '"' || *c == '\\') {
+            *p++ = '\\';
+            *p++ = *c;
+        } else if((unsigned char) *c < 0x20) {
+            p += sprintf(p, "\\u%04x", (unsigned char) *c);
+        } else {
+            *p++ = *c;
+        }
+    }
+    *p = '\0';
+    return escaped;
+}
+
+/*
+ * Formats what is written for an error on each TP in the sink's format.
+ */
+void formatErrorTexts(OutputSink* sink, AssertionsSet* set) {
+    TestPoint* tp;
+    char* escaped;
+    int i, len;
+
+    assert((sink->errorTexts = calloc(set->nTp + 1, sizeof(char*))) != NULL);
+    assert((sink->errorTextLens = calloc(set->nTp + 1, sizeof(int))) != NULL);
+    sink->maxErrorTextLen = 0;
+    for(i = 0; i < set->nTp; i++) {
+        tp = set->tps[i];
+        if(sink->writeSample == writeTextSample) {
+            len = snprintf(NULL, 0, "] Valve %d failed, registered on tp %s\n", tp->valveNo, tp->tpName);
+            assert((sink->errorTexts[i] = malloc(sizeof(char) * (len + 1))) != NULL);
+            snprintf(sink->errorTexts[i], len + 1, "] Valve %d failed, registered on tp %s\n", tp->valveNo, tp->tpName);
+        } else if(sink->writeSample == writeJSONSample) {
+            escaped = escapeJSON(tp->tpName);
+            len = snprintf(NULL, 0, "{\"tp\":\"%s\",\"valve\":%d}", escaped, tp->valveNo);
+            assert((sink->errorTexts[i] = malloc(sizeof(char) * (len + 1))) != NULL);
+            snprintf(sink->errorTexts[i], len + 1, "{\"tp\":\"%s\",\"valve\":%d}", escaped, tp->valveNo);
+            free(escaped);
+        } else {
+            len = 0;
+        }
+        sink->errorTextLens[i] = len;
+        if(len > sink->maxErrorTextLen) {
+            sink->maxErrorTextLen = len;
+        }
+    }
+}
+
+void writeBinaryHeader(OutputSink* sink, AssertionsSet* set) {
+    char* start;
+    char* p;
+    int i, len;
+
+    start = p = reserveOutput(sink, OUTPUT_BINARY_MAGIC_LEN + 8);
+    p = appendText(p, OUTPUT_BINARY_MAGIC, OUTPUT_BINARY_MAGIC_LEN);
+    p = appendLittleEndian(p, OUTPUT_BINARY_VERSION, 4);
+    p = appendLittleEndian(p, set->nTp, 4);
+    sink->len += p - start;
+    for(i = 0; i < set->nTp; i++) {
+        len = strlen(set->tps[i]->tpName);
+        start = p = reserveOutput(sink, 2 + len + 4);
+        p = appendLittleEndian(p, len, 2);
+        p = appendText(p, set->tps[i]->tpName, len);
+        p = appendLittleEndian(p, (uint32_t) set->tps[i]->valveNo, 4);
+        sink->len += p - start;
+    }
+}
+
+/*
+ * Creates the sink writing the samples of set to fd in the format with the
+ * given name. Returns NULL if there is no such format.
+ */
+OutputSink* createOutputSink(const char* name, AssertionsSet* set, int fd) {
+    OutputSink* sink;
+
+    assert((sink = malloc(sizeof(OutputSink))) != NULL);
+    if(strcmp(name, OUTPUT_FORMAT_TEXT) == 0) {
+        sink->name = OUTPUT_FORMAT_TEXT;
+        sink->writeSample = writeTextSample;
+    } else if(strcmp(name, OUTPUT_FORMAT_JSON) == 0) {
+        sink->name = OUTPUT_FORMAT_JSON;
+        sink->writeSample = writeJSONSample;
+    } else if(strcmp(name, OUTPUT_FORMAT_BINARY) == 0) {
+        sink->name = OUTPUT_FORMAT_BINARY;
+        sink->writeSample = writeBinarySample;
+    } else {
+        fprintf(stderr, "Unknown output format \"%s\", expected %s, %s or %s\n", name, OUTPUT_FORMAT_TEXT, OUTPUT_FORMAT_JSON, OUTPUT_FORMAT_BINARY);
+        free(sink);
+        return NULL;
+    }
+    sink->fd = fd;
+    sink->lock = NULL;
+    sink->label = NULL;
+    sink->labelLen = 0;
+    sink->size = OUTPUT_BUFFER_BYTES;
+    assert((sink->buffer = malloc(sink->size)) != NULL);
+    sink->len = 0;
+    sink->failed = 0;
+    sink->nTp = set->nTp;
+    sink->nSampleWords = getSampleWords(set);
+    formatErrorTexts(sink, set);
+    if(sink->writeSample == writeBinarySample) {
+        writeBinaryHeader(sink, set);
+    }
+    return sink;
+}
+
+/*
+ * Marks every sample the sink writes from now on with label, and makes it
+ * hold lock, unless it is NULL, while it writes. Binary samples are not
+ * marked.
+ */
+void labelOutputSink(OutputSink* sink, const char* label, pthread_mutex_t* lock) {
+    char* escaped;
+    int len;
+
+    free(sink->label);
+    if(sink->writeSample == writeJSONSample) {
+        escaped = escapeJSON(label);
+        len = snprintf(NULL, 0, "\"chassis\":\"%s\",", escaped);
+        assert((sink->label = malloc(sizeof(char) * (len + 1))) != NULL);
+        snprintf(sink->label, len + 1, "\"chassis\":\"%s\",", escaped);
+        free(escaped);
+    } else if(sink->writeSample == writeTextSample) {
+        len = snprintf(NULL, 0, "Chassis: %s\n", label);
+        assert((sink->label = malloc(sizeof(char) * (len + 1))) != NULL);
+        snprintf(sink->label, len + 1, "Chassis: %s\n", label);
+    } else {
+        len = 0;
+        sink->label = NULL;
+    }
+    sink->labelLen = len;
+    sink->lock = lock;
+}
+
+/*
+ * Writes a sample with nErrors failed TPs, the indices of which are in
+ * errorIndices.
+ */
+void outputSample(OutputSink* sink, const TruthWord* sample, const int* errorIndices, int nErrors) {
+    sink->writeSample(sink, sample, errorIndices, nErrors);
+}
+
+/*
+ * Writes what is left in the buffer and frees the sink. Returns 1 if
+ * everything was written or 0 if a write failed.
+ */
+int freeOutputSink(OutputSink* sink) {
+    int i, ok;
+    assert(sink != NULL);
+    ok = flushOutputSink(sink);
+    for(i = 0; i < sink->nTp; i++) {
+        free(sink->errorTexts[i]);
+    }
+    free(sink->errorTexts);
+    free(sink->errorTextLens);
+    free(sink->label);
+    free(sink->buffer);
+    free(sink);
+    return ok;
+}
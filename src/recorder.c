@@ -0,0 +1,260 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "recorder.h"
+
+#define RECORD_TIME_RECORD_BYTES 11
+
+char* recorderSegmentFilename(Recorder* recorder, int segment) {
+    char* filename;
+    int len;
+
+    len = snprintf(NULL, 0, "%s/" RECORD_SEGMENT_FORMAT, recorder->directory, segment);
+    assert((filename = malloc(sizeof(char) * (len + 1))) != NULL);
+    snprintf(filename, len + 1, "%s/" RECORD_SEGMENT_FORMAT, recorder->directory, segment);
+    return filename;
+}
+
+/*
+ * Creates the segment file if needed and reserves segmentBytes of disk for
+ * it, so that recording never runs out of space part way through a segment.
+ */
+int preallocateRecorderSegment(Recorder* recorder, int segment) {
+    char* filename;
+    int fd, ok;
+
+    filename = recorderSegmentFilename(recorder, segment);
+    fd = open(filename, O_WRONLY | O_CREAT, 0644);
+    ok = fd >= 0 && posix_fallocate(fd, 0, recorder->segmentBytes) == 0;
+    if(!ok) {
+        fprintf(stderr, "Could not preallocate record segment \"%s\"\n", filename);
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    free(filename);
+    return ok;
+}
+
+/*
+ * Starts writing the current segment from its start, beginning with the last
+ * sample recorded. The old contents of the segment are left in place but are
+ * never reachable, as an end record always follows the last record written.
+ */
+int openRecorderSegment(Recorder* recorder) {
+    char* filename;
+    FILE* file;
+    int fd;
+
+    filename = recorderSegmentFilename(recorder, recorder->segment);
+    fd = open(filename, O_WRONLY);
+    file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if(file == NULL) {
+        fprintf(stderr, "Could not open file \"%s\" for writing\n", filename);
+        if(fd >= 0) {
+            close(fd);
+        }
+        free(filename);
+        return 0;
+    }
+    recorder->writer = createCaptureWriterForFile(file, filename, recorder->names, recorder->nColumns);
+    free(filename);
+    return recorder->writer != NULL
+            && captureWriterAppendTime(recorder->writer, recorder->lastTimestamp)
+            && captureWriterAppend(recorder->writer, recorder->lastSample)
+            && captureWriterSync(recorder->writer);
+}
+
+void writeRecordedSample(Recorder* recorder, const TruthWord* sample, uint64_t timestamp) {
+    long needed;
+    int ok;
+
+    if(recorder->failed) {
+        return;
+    }
+    needed = RECORD_TIME_RECORD_BYTES + captureMaxRecordSize(recorder->nColumns) + 1;
+    ok = 1;
+    if(recorder->writer == NULL || recorder->writer->nBytes + needed > recorder->segmentBytes) {
+        if(recorder->writer != NULL) {
+            ok = closeCaptureWriter(recorder->writer);
+            recorder->writer = NULL;
+            recorder->segment = (recorder->segment + 1) % recorder->nSegments;
+        }
+        ok = ok && openRecorderSegment(recorder);
+    }
+    ok = ok && captureWriterAppendTime(recorder->writer, timestamp)
+            && captureWriterAppend(recorder->writer, sample);
+    if(!ok) {
+        fprintf(stderr, "Failed to write to record segment %d, recording stopped\n", recorder->segment);
+        recorder->failed = 1;
+        return;
+    }
+    memcpy(recorder->lastSample, sample, sizeof(TruthWord) * recorder->nSampleWords);
+    recorder->lastTimestamp = timestamp;
+}
+
+/*
+ * Writes queued samples until the recorder is stopped. The queue is only
+ * locked to find the samples waiting and to release them once written.
+ */
+void* runRecorder(void* arg) {
+    Recorder* recorder = arg;
+    long i, head;
+
+    pthread_mutex_lock(&recorder->lock);
+    for(;;) {
+        while(recorder->head == recorder->tail && !recorder->stopping) {
+            pthread_cond_wait(&recorder->ready, &recorder->lock);
+        }
+        if(recorder->head == recorder->tail) {
+            break;
+        }
+        head = recorder->head;
+        pthread_mutex_unlock(&recorder->lock);
+
+        for(i = recorder->tail; i < head; i++) {
+            writeRecordedSample(recorder, recorder->queue + (i % recorder->nQueueSamples) * recorder->nSampleWords,
+                    recorder->timestamps[i % recorder->nQueueSamples]);
+        }
+        if(!recorder->failed && !captureWriterSync(recorder->writer)) {
+            fprintf(stderr, "Failed to write to record segment %d, recording stopped\n", recorder->segment);
+            recorder->failed = 1;
+        }
+
+        pthread_mutex_lock(&recorder->lock);
+        recorder->tail = head;
+    }
+    pthread_mutex_unlock(&recorder->lock);
+    return NULL;
+}
+
+/*
+ * Preallocates the segments and starts the writing thread. Returns NULL if
+ * the directory or segments could not be created.
+ */
+Recorder* createRecorder(const char* directory, AssertionsSet* set, int nSegments, long segmentBytes) {
+    Recorder* recorder;
+    long headerBytes;
+    int i;
+
+    if(nSegments < 1) {
+        fprintf(stderr, "At least one record segment is needed\n");
+        return NULL;
+    }
+    headerBytes = CAPTURE_MAGIC_LEN + 8;
+    for(i = 0; i < set->nTp; i++) {
+        headerBytes += 2 + strlen(set->tps[i]->tpName);
+    }
+    if(segmentBytes < headerBytes + 2 * (RECORD_TIME_RECORD_BYTES + (long) captureMaxRecordSize(set->nTp)) + 1) {
+        fprintf(stderr, "Record segments of %ld bytes are too small for %d TPs\n", segmentBytes, set->nTp);
+        return NULL;
+    }
+    if(mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create record directory \"%s\"\n", directory);
+        return NULL;
+    }
+
+    assert((recorder = malloc(sizeof(Recorder))) != NULL);
+    assert((recorder->directory = malloc(sizeof(char) * (strlen(directory) + 1))) != NULL);
+    strcpy(recorder->directory, directory);
+    assert((recorder->names = malloc(sizeof(char*) * (set->nTp + 1))) != NULL);
+    for(i = 0; i < set->nTp; i++) {
+        recorder->names[i] = set->tps[i]->tpName;
+    }
+    recorder->nColumns = set->nTp;
+    recorder->nSampleWords = getSampleWords(set);
+    recorder->nSegments = nSegments;
+    recorder->segmentBytes = segmentBytes;
+    recorder->segment = 0;
+    recorder->writer = NULL;
+    assert((recorder->lastSample = calloc(recorder->nSampleWords + 1, sizeof(TruthWord))) != NULL);
+    recorder->lastTimestamp = 0;
+    recorder->nQueueSamples = RECORD_QUEUE_SAMPLES;
+    assert((recorder->queue = malloc(sizeof(TruthWord) * ((long) recorder->nQueueSamples * recorder->nSampleWords + 1))) != NULL);
+    assert((recorder->timestamps = malloc(sizeof(uint64_t) * recorder->nQueueSamples)) != NULL);
+    recorder->head = 0;
+    recorder->tail = 0;
+    recorder->nDropped = 0;
+    recorder->stopping = 0;
+    recorder->failed = 0;
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->ready, NULL);
+
+    for(i = 0; i < nSegments; i++) {
+        if(!preallocateRecorderSegment(recorder, i)) {
+            recorder->failed = 1;
+            break;
+        }
+    }
+    if(recorder->failed || pthread_create(&recorder->thread, NULL, runRecorder, recorder) != 0) {
+        if(!recorder->failed) {
+            fprintf(stderr, "Could not start the recorder thread\n");
+        }
+        pthread_cond_destroy(&recorder->ready);
+        pthread_mutex_destroy(&recorder->lock);
+        free(recorder->timestamps);
+        free(recorder->queue);
+        free(recorder->lastSample);
+        free(recorder->names);
+        free(recorder->directory);
+        free(recorder);
+        return NULL;
+    }
+    return recorder;
+}
+
+/*
+ * Queues a sample packed one bit per TP for writing. Never waits for the
+ * disk: returns 0 and counts the sample as dropped if the queue is full.
+ */
+int recorderAppend(Recorder* recorder, const TruthWord* sample, uint64_t timestamp) {
+    long slot;
+
+    pthread_mutex_lock(&recorder->lock);
+    if(recorder->head - recorder->tail >= recorder->nQueueSamples) {
+        recorder->nDropped++;
+        pthread_mutex_unlock(&recorder->lock);
+        return 0;
+    }
+    slot = recorder->head % recorder->nQueueSamples;
+    memcpy(recorder->queue + slot * recorder->nSampleWords, sample, sizeof(TruthWord) * recorder->nSampleWords);
+    recorder->timestamps[slot] = timestamp;
+    recorder->head++;
+    pthread_cond_signal(&recorder->ready);
+    pthread_mutex_unlock(&recorder->lock);
+    return 1;
+}
+
+/*
+ * Writes every queued sample, stops the writing thread and closes the
+ * current segment.
+ */
+void freeRecorder(Recorder* recorder) {
+    assert(recorder != NULL);
+
+    pthread_mutex_lock(&recorder->lock);
+    recorder->stopping = 1;
+    pthread_cond_signal(&recorder->ready);
+    pthread_mutex_unlock(&recorder->lock);
+    pthread_join(recorder->thread, NULL);
+
+    if(recorder->writer != NULL && !closeCaptureWriter(recorder->writer)) {
+        fprintf(stderr, "Failed to write to record segment %d\n", recorder->segment);
+    }
+    if(recorder->nDropped > 0) {
+        fprintf(stderr, "%ld samples were not recorded as the record queue was full\n", recorder->nDropped);
+    }
+    pthread_cond_destroy(&recorder->ready);
+    pthread_mutex_destroy(&recorder->lock);
+    free(recorder->timestamps);
+    free(recorder->queue);
+    free(recorder->lastSample);
+    free(recorder->names);
+    free(recorder->directory);
+    free(recorder);
+}
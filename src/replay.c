@@ -0,0 +1,182 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "replay.h"
+
+/*
+ * Creates a chunk of up to maxSamples samples of set with a checker of its
+ * own.
+ */
+ReplayChunk* createReplayChunk(AssertionsSet* set, long maxSamples) {
+    ReplayChunk* chunk;
+
+    assert((chunk = malloc(sizeof(ReplayChunk))) != NULL);
+    chunk->assertions = set;
+    chunk->checker = createSampleChecker(set);
+    chunk->nSampleWords = getSampleWords(set);
+    chunk->nMaskWords = getErrorMaskWords(set);
+    chunk->maxSamples = maxSamples;
+    chunk->nSamples = 0;
+    chunk->nChanged = 0;
+    assert((chunk->samples = malloc(sizeof(TruthWord) * (chunk->nSampleWords * maxSamples + 1))) != NULL);
+    assert((chunk->times = malloc(sizeof(uint64_t) * maxSamples)) != NULL);
+    assert((chunk->previous = calloc(chunk->nSampleWords + 1, sizeof(TruthWord))) != NULL);
+    chunk->primed = 0;
+    chunk->started = 0;
+    assert((chunk->changed = malloc(sizeof(TruthWord*) * maxSamples)) != NULL);
+    assert((chunk->changedTimes = malloc(sizeof(uint64_t) * maxSamples)) != NULL);
+    assert((chunk->results = malloc(sizeof(TruthWord) * (chunk->nMaskWords * maxSamples + 1))) != NULL);
+    return chunk;
+}
+
+/*
+ * Copies the next samples of the file into the chunk until it is full or
+ * the file ends, following on from lastSample, which is then replaced by the
+ * last sample copied. lastSample is only a sample of the file if primed is
+ * set. Returns the number of samples copied.
+ */
+long fillReplayChunk(ReplayChunk* chunk, Samples* samples, TruthWord* lastSample, int primed) {
+    const TruthWord* batch[MONITOR_BATCH_SIZE];
+    size_t rowSize;
+    long i, n, max;
+
+    rowSize = sizeof(TruthWord) * chunk->nSampleWords;
+    memcpy(chunk->previous, lastSample, rowSize);
+    chunk->primed = primed;
+    chunk->nSamples = 0;
+    chunk->nChanged = 0;
+    while(chunk->nSamples < chunk->maxSamples) {
+        max = chunk->maxSamples - chunk->nSamples < MONITOR_BATCH_SIZE ? chunk->maxSamples - chunk->nSamples : MONITOR_BATCH_SIZE;
+        n = samplesGetBatch(samples, batch, chunk->times + chunk->nSamples, max);
+        if(n == 0) {
+            break;
+        }
+        for(i = 0; i < n; i++) {
+            memcpy(chunk->samples + (chunk->nSamples + i) * chunk->nSampleWords, batch[i], rowSize);
+        }
+        chunk->nSamples += n;
+    }
+    if(chunk->nSamples > 0) {
+        memcpy(lastSample, chunk->samples + (chunk->nSamples - 1) * chunk->nSampleWords, rowSize);
+    }
+    return chunk->nSamples;
+}
+
+/*
+ * Finds the samples of the chunk that differ from the one before them, and
+ * the first sample replayed, and checks them in batches of
+ * MONITOR_BATCH_SIZE. The checker starts afresh, as the chunk before may be
+ * checked at the same time. Only the chunk is written to, so chunks of the
+ * same set can be checked on several threads.
+ */
+void* checkReplayChunk(void* arg) {
+    ReplayChunk* chunk = arg;
+    const TruthWord* last;
+    const TruthWord* sample;
+    long i, n;
+
+    last = chunk->previous;
+    for(i = 0; i < chunk->nSamples; i++) {
+        sample = chunk->samples + i * chunk->nSampleWords;
+        if((i == 0 && !chunk->primed) || memcmp(sample, last, sizeof(TruthWord) * chunk->nSampleWords) != 0) {
+            chunk->changedTimes[chunk->nChanged] = chunk->times[i];
+            chunk->changed[chunk->nChanged++] = sample;
+        }
+        last = sample;
+    }
+    chunk->checker->primed = 0;
+    for(i = 0; i < chunk->nChanged; i += n) {
+        n = chunk->nChanged - i < MONITOR_BATCH_SIZE ? chunk->nChanged - i : MONITOR_BATCH_SIZE;
+        checkSampleChanges(chunk->assertions, chunk->checker, chunk->changed + i, n, chunk->results + i * chunk->nMaskWords);
+    }
+    return NULL;
+}
+
+void freeReplayChunk(ReplayChunk* chunk) {
+    assert(chunk != NULL);
+    freeSampleChecker(chunk->checker);
+    free(chunk->samples);
+    free(chunk->times);
+    free(chunk->previous);
+    free(chunk->changed);
+    free(chunk->changedTimes);
+    free(chunk->results);
+    free(chunk);
+}
+
+/*
+ * Returns the number of threads to replay on: requested, or when it is 0
+ * one per online processor, at most REPLAY_MAX_THREADS.
+ */
+int getReplayThreads(int requested) {
+    long nCpus;
+    if(requested <= 0) {
+        nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        requested = nCpus < 1 ? 1 : nCpus;
+    }
+    return requested > REPLAY_MAX_THREADS ? REPLAY_MAX_THREADS : requested;
+}
+
+/*
+ * Checks the first sample and every sample that differs from the one before
+ * it against the monitor's chassis on nThreads threads. The file is read
+ * into nThreads chunks of about REPLAY_CHUNK_BYTES of samples at a time,
+ * which are checked at once, one per thread, and then reported in the order
+ * of the file, so faults are sent or echoed exactly as if the file were
+ * checked in one go. Faults are timed by when their samples were taken, and
+ * those still held back at the end of the file are sent. Each sample is
+ * checked only as far as it changed or, when a batch changes a lot, with the
+ * whole batch at once.
+ */
+void replaySamples(Monitor* monitor, Samples* samples, int nThreads) {
+    ReplayChunk** chunks;
+    TruthWord* lastSample;
+    long rowsPerChunk, i, n;
+    uint64_t lastTime;
+    int c, nFilled, primed;
+
+    rowsPerChunk = REPLAY_CHUNK_BYTES / ((long) sizeof(TruthWord) * getSampleWords(monitor->assertions));
+    rowsPerChunk = rowsPerChunk < MONITOR_BATCH_SIZE ? MONITOR_BATCH_SIZE : rowsPerChunk;
+    assert((chunks = malloc(sizeof(ReplayChunk*) * nThreads)) != NULL);
+    for(c = 0; c < nThreads; c++) {
+        chunks[c] = createReplayChunk(monitor->assertions, rowsPerChunk);
+    }
+    assert((lastSample = calloc(getSampleWords(monitor->assertions) + 1, sizeof(TruthWord))) != NULL);
+
+    primed = 0;
+    lastTime = 0;
+    do {
+        for(nFilled = 0; nFilled < nThreads && fillReplayChunk(chunks[nFilled], samples, lastSample, primed) > 0; nFilled++) {
+            primed = 1;
+        }
+        for(c = 1; c < nFilled; c++) {
+            chunks[c]->started = pthread_create(&chunks[c]->thread, NULL, checkReplayChunk, chunks[c]) == 0;
+            if(!chunks[c]->started) {
+                checkReplayChunk(chunks[c]);
+            }
+        }
+        if(nFilled > 0) {
+            checkReplayChunk(chunks[0]);
+        }
+        for(c = 0; c < nFilled; c++) {
+            if(chunks[c]->started) {
+                pthread_join(chunks[c]->thread, NULL);
+                chunks[c]->started = 0;
+            }
+            for(i = 0; i < chunks[c]->nChanged; i += n) {
+                n = chunks[c]->nChanged - i < MONITOR_BATCH_SIZE ? chunks[c]->nChanged - i : MONITOR_BATCH_SIZE;
+                reportMonitorBatch(monitor, chunks[c]->changed + i, chunks[c]->results + i * chunks[c]->nMaskWords, chunks[c]->changedTimes + i, n, 0);
+            }
+            lastTime = chunks[c]->times[chunks[c]->nSamples - 1];
+        }
+    } while(nFilled == nThreads);
+    flushMonitorFaults(monitor, lastTime);
+
+    for(c = 0; c < nThreads; c++) {
+        freeReplayChunk(chunks[c]);
+    }
+    free(lastSample);
+    free(chunks);
+}
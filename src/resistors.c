@@ -3,7 +3,6 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
-#include <wiringPiSPI.h>
 #include <libxml/tree.h>
 #include <libxml/xmlstring.h>
 #include "assertions.h"
@@ -20,16 +19,12 @@
 #define TABLE_TP_HEADING "TP"
 #define TABLE_THRESHOLD_HEADING "Threshold"
 
-void setupResistors(int channel, int speed) {
-    int code;
-    code = wiringPiSPISetup(channel, speed);
-    if(code < 0) {
-        fprintf(stderr, "Error with wiringPiSPISetip(%d)\n", code);
-    }
+int setupResistors(SamplingBackend* backend, int channel, int speed) {
+    return backend->setupSPI(backend, channel, speed);
 }
 
-void teardownResistors() {
-    
+void teardownResistors(SamplingBackend* backend) {
+    (void) backend;
 }
 
 Threshold* createThreshold(int wiringIndex, float value) {
@@ -50,9 +45,11 @@ Calibration* createCalibrationFromXMLNode(AssertionsSet* set, Wiring* wiring, xm
     assert(calibrateNode != NULL);
     Calibration* calibration;
     xmlNode* child;
-    int j, tpIndex, wiringIndex;
+    int tpIndex, wiringIndex;
+    int* wireHasThreshold;
     float thresholdValue;
     
+    assert((wireHasThreshold = calloc(wiring->nWires + 1, sizeof(int))) != NULL);
     child = calibrateNode->children;
     calibration = malloc(sizeof(Calibration));
     calibration->thresholds = NULL;
@@ -62,39 +59,44 @@ Calibration* createCalibrationFromXMLNode(AssertionsSet* set, Wiring* wiring, xm
             if(strEqual(child->name, NODE_NAME_TP)) {
                 if(!xmlHasProp(child, ATTR_NAME_ID)) {
                     freeCalibration(calibration);
+                    free(wireHasThreshold);
                     fprintf(stderr, "TP node has no id\n");
                     return NULL;
                 }
                 if(!xmlHasProp(child, ATTR_NAME_THRESHOLD)) {
                     freeCalibration(calibration);
+                    free(wireHasThreshold);
                     fprintf(stderr, "TP node has no threshold\n");
                     return NULL;
                 }
                 tpIndex = getIndexOfTPNodeInSet(set, child);
                 if(tpIndex < 0) {
                     freeCalibration(calibration);
+                    free(wireHasThreshold);
                     fprintf(stderr, "TP node refers to a tp not in the assertions set\n");
                     return NULL;
                 }
                 wiringIndex = getIndexOfTPIndexInWiring(wiring, tpIndex);
                 if(wiringIndex < 0) {
                     freeCalibration(calibration);
+                    free(wireHasThreshold);
                     fprintf(stderr, "TP node refers to a tp not in the wiring set\n");
                     return NULL;
                 }
                 
-                for(j = 0; j < calibration->nThresholds; j++) {
-                    if(calibration->thresholds[j]->wireIndex == wiringIndex) {
-                        freeCalibration(calibration);
-                        fprintf(stderr, "TP node has an invalid pin attribute\n");
-                        return NULL;
-                    }
+                if(wireHasThreshold[wiringIndex]) {
+                    freeCalibration(calibration);
+                    free(wireHasThreshold);
+                    fprintf(stderr, "TP node has an invalid pin attribute\n");
+                    return NULL;
                 }
+                wireHasThreshold[wiringIndex] = 1;
                 thresholdValue = nodePropAsFloat(child, ATTR_NAME_THRESHOLD);
                 if(thresholdValue < set->tps[tpIndex]->min || 
                         thresholdValue > set->tps[tpIndex]->max) {
                     
                     freeCalibration(calibration);
+                    free(wireHasThreshold);
                     fprintf(stderr, "TP node has an invalid threshold attribute\n");
                     return NULL;
                 }
@@ -104,6 +106,7 @@ Calibration* createCalibrationFromXMLNode(AssertionsSet* set, Wiring* wiring, xm
                 calibration->nThresholds++;
             } else {
                 freeCalibration(calibration);
+                free(wireHasThreshold);
                 fprintf(stderr, "Unknown node name: \"%s\"\n", child->name);
                 return NULL;
             }
@@ -114,9 +117,11 @@ Calibration* createCalibrationFromXMLNode(AssertionsSet* set, Wiring* wiring, xm
     if(calibration->nThresholds != set->nTp) {
         fprintf(stderr, "Number of TPs in thresholds (%d) does not match number of TPs in assertions (%d)\n", calibration->nThresholds, set->nTp);
         freeCalibration(calibration);
+        free(wireHasThreshold);
         return NULL;
     }
     
+    free(wireHasThreshold);
     return calibration;
 }
 
@@ -126,6 +131,7 @@ void freeCalibration(Calibration* calibration) {
         for(i = 0; i < calibration->nThresholds; i++) {
             freeThreshold(calibration->thresholds[i]);
         }
+        free(calibration->thresholds);
         free(calibration);
     }
 }
@@ -167,7 +173,7 @@ uint8_t getResistanceValue(Wiring* wiring, int wiringIndex, float value) {
     return (uint8_t) roundf((1 - ((value / attenuation) / 5.0)) * 255.0);
 }
 
-void writeOutCallibrationStream(int spiChannel, Wiring* wiring, Calibration* calibration, int stream) {
+void writeOutCallibrationStream(SamplingBackend* backend, int spiChannel, Wiring* wiring, Calibration* calibration, int stream) {
     assert(wiring != NULL);
     assert(calibration != NULL);
     uint8_t* streamData;
@@ -188,13 +194,13 @@ void writeOutCallibrationStream(int spiChannel, Wiring* wiring, Calibration* cal
             streamData[(indexFromEnd*2)+1] = getResistanceValue(wiring, wiringIndex, calibration->thresholds[i]->value);
         }
     }
-    wiringPiSPIDataRW(spiChannel, streamData, wiring->nResistorChips * 2);
+    backend->writeSPI(backend, spiChannel, streamData, wiring->nResistorChips * 2);
     free(streamData);
 }
 
-void writeOutCalibration(int spiChannel, Wiring* wiring, Calibration* calibration) {
-    writeOutCallibrationStream(spiChannel, wiring, calibration, STREAM_A);
-    writeOutCallibrationStream(spiChannel, wiring, calibration, STREAM_B);
+void writeOutCalibration(SamplingBackend* backend, int spiChannel, Wiring* wiring, Calibration* calibration) {
+    writeOutCallibrationStream(backend, spiChannel, wiring, calibration, STREAM_A);
+    writeOutCallibrationStream(backend, spiChannel, wiring, calibration, STREAM_B);
 }
 
 int setThresholdForTPIndex(Wiring* wiring, Calibration* calibration, int tpIndex, float threshold) {
@@ -214,12 +220,12 @@ int setThresholdForTPIndex(Wiring* wiring, Calibration* calibration, int tpIndex
     return -1;
 }
 
-int setAndWriteThresholdForTPIndex(int spiChannel, Wiring* wiring, Calibration* calibration, int tpIndex, float threshold) {
+int setAndWriteThresholdForTPIndex(SamplingBackend* backend, int spiChannel, Wiring* wiring, Calibration* calibration, int tpIndex, float threshold) {
     int wiringIndex;
     if(!setThresholdForTPIndex(wiring, calibration, tpIndex, threshold)) {
         return -1;
     }
     wiringIndex = getIndexOfTPIndexInWiring(wiring, tpIndex);
-    writeOutCallibrationStream(spiChannel, wiring, calibration, wiring->wires[wiringIndex]->resistor.resistor);
+    writeOutCallibrationStream(backend, spiChannel, wiring, calibration, wiring->wires[wiringIndex]->resistor.resistor);
     return 1;
 }
\ No newline at end of file
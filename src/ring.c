@@ -0,0 +1,117 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ring.h"
+
+/*
+ * Creates a ring of at least nSlots slots for samples of nSampleWords words,
+ * rounded up to a power of two.
+ */
+SampleRing* createSampleRing(int nSampleWords, long nSlots) {
+    SampleRing* ring;
+    long slots;
+
+    assert(nSlots > 0);
+    for(slots = 1; slots < nSlots; slots *= 2);
+    assert(posix_memalign((void**) &ring, SAMPLE_RING_CACHE_LINE, sizeof(SampleRing)) == 0);
+    memset(ring, 0, sizeof(SampleRing));
+    ring->nSampleWords = nSampleWords;
+    ring->nSlots = slots;
+    assert((ring->samples = calloc(slots * nSampleWords + 1, sizeof(TruthWord))) != NULL);
+    assert((ring->timestamps = malloc(sizeof(uint64_t) * slots)) != NULL);
+    return ring;
+}
+
+/*
+ * Called by the producer. Returns the slot to fill with the next sample, or
+ * NULL if the ring is full.
+ */
+TruthWord* sampleRingReserve(SampleRing* ring) {
+    if(ring->head - ring->producerTail >= ring->nSlots) {
+        ring->producerTail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        if(ring->head - ring->producerTail >= ring->nSlots) {
+            return NULL;
+        }
+    }
+    return ring->samples + (ring->head & (ring->nSlots - 1)) * ring->nSampleWords;
+}
+
+/*
+ * Called by the producer after filling the slot returned by
+ * sampleRingReserve, to hand it to the consumer.
+ */
+void sampleRingPublish(SampleRing* ring, uint64_t timestamp) {
+    ring->timestamps[ring->head & (ring->nSlots - 1)] = timestamp;
+    ring->nPushed++;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Called by the producer to count a sample it dropped as the ring was full.
+ */
+void sampleRingOverrun(SampleRing* ring) {
+    __atomic_store_n(&ring->nOverruns, ring->nOverruns + 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Called by the producer once it will publish no more samples.
+ */
+void sampleRingClose(SampleRing* ring) {
+    __atomic_store_n(&ring->closed, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Called by the consumer. Points samples and, unless it is NULL, timestamps
+ * at up to max of the oldest samples in the ring and returns how many. They
+ * stay valid until they are released with sampleRingRelease.
+ */
+long sampleRingPeek(SampleRing* ring, const TruthWord** samples, uint64_t* timestamps, long max) {
+    long i, n, slot;
+
+    if(ring->consumerHead - ring->tail < max) {
+        ring->consumerHead = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    }
+    n = ring->consumerHead - ring->tail;
+    if(n > ring->maxDepth) {
+        ring->maxDepth = n;
+    }
+    if(n > max) {
+        n = max;
+    }
+    for(i = 0; i < n; i++) {
+        slot = (ring->tail + i) & (ring->nSlots - 1);
+        samples[i] = ring->samples + slot * ring->nSampleWords;
+        if(timestamps != NULL) {
+            timestamps[i] = ring->timestamps[slot];
+        }
+    }
+    return n;
+}
+
+/*
+ * Called by the consumer to hand the oldest n samples back to the producer.
+ */
+void sampleRingRelease(SampleRing* ring, long n) {
+    __atomic_store_n(&ring->tail, ring->tail + n, __ATOMIC_RELEASE);
+}
+
+/*
+ * Called by the consumer. Returns 1 once the ring is closed and every sample
+ * published has been released.
+ */
+int sampleRingFinished(SampleRing* ring) {
+    return __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)
+            && __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail;
+}
+
+long sampleRingOverruns(SampleRing* ring) {
+    return __atomic_load_n(&ring->nOverruns, __ATOMIC_RELAXED);
+}
+
+void freeSampleRing(SampleRing* ring) {
+    assert(ring != NULL);
+    free(ring->samples);
+    free(ring->timestamps);
+    free(ring);
+}
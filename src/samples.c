@@ -1,231 +1,625 @@
 #include <assert.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "assertions.h"
+#include "capture.h"
 #include "samples.h"
 #include "circuit.h"
 
-void skipWhiteSpace(FILE* file, int* nextChar) {
-    for(;;) {
-        if(!isblank(*nextChar)) {
-            break;
-        }
-        *nextChar = fgetc(file);
+#ifndef SAMPLES_WINDOW_ROWS
+#define SAMPLES_WINDOW_ROWS 16384
+#endif
+#ifndef SAMPLES_READ_BUFFER_SIZE
+#define SAMPLES_READ_BUFFER_SIZE (4 * 1024 * 1024)
+#endif
+#ifndef SAMPLES_MAX_PARSE_THREADS
+#define SAMPLES_MAX_PARSE_THREADS 4
+#endif
+#define SAMPLES_PARALLEL_MIN_ROWS 2048
+
+/*
+ * Four cells written as "b," with no blanks fill eight bytes. On a little
+ * endian machine the digits are the even bytes of the word loaded from them
+ * and multiplying their low bits by CELLS_GATHER collects the four bits
+ * into bits 48 to 51.
+ */
+#define CELLS_PER_WORD 4
+#define CELLS_COMMA_MASK 0xFF00FF00FF00FF00ULL
+#define CELLS_COMMAS 0x2C002C002C002C00ULL
+#define CELLS_DIGIT_MASK 0x00FE00FE00FE00FEULL
+#define CELLS_DIGITS 0x0030003000300030ULL
+#define CELLS_BIT_MASK 0x0001000100010001ULL
+#define CELLS_GATHER ((1ULL << 48) | (1ULL << 33) | (1ULL << 18) | (1ULL << 3))
+#define CELLS_GATHER_SHIFT 48
+
+typedef struct {
+    Samples* samples;
+    int first;
+    int last;
+    int bad;
+} SampleParseJob;
+
+const char* skipBlanks(const char* p, const char* end) {
+    while(p < end && isblank(*p)) {
+        p++;
     }
+    return p;
 }
 
-int isNewline(int c) {
-    return c == '\n' || c == '\r';
+int isNameChar(char c) {
+    return isalnum(c) || c == '_' || c == '-';
 }
 
-void readNewline(FILE* file, int* nextChar) {
-    for(;;) {
-        if(!isNewline(*nextChar)) {
-            break;
+/*
+ * Reads more of the file into the buffer after moving the unparsed bytes to
+ * its start, doubling the buffer when one line fills it. Returns 1 if there
+ * may be another line to take, 0 once the whole file has been taken.
+ */
+int refillSampleBuffer(Samples* samples) {
+    ssize_t n;
+    if(samples->eof) {
+        return 0;
+    }
+    if(samples->start > 0) {
+        memmove(samples->buffer, samples->buffer + samples->start, samples->end - samples->start);
+        samples->end -= samples->start;
+        samples->start = 0;
+    }
+    if(samples->end == samples->bufferSize) {
+        samples->bufferSize *= 2;
+        assert((samples->buffer = realloc(samples->buffer, samples->bufferSize)) != NULL);
+    }
+    n = read(samples->fd, samples->buffer + samples->end, samples->bufferSize - samples->end);
+    if(n <= 0) {
+        samples->eof = 1;
+        return samples->start < samples->end;
+    }
+    samples->end += n;
+    return 1;
+}
+
+/*
+ * Takes the next whole line already in the buffer, without its line ending.
+ * The last line of the file may have no newline. Returns 0 if the buffer
+ * holds no whole line.
+ */
+int takeBufferedLine(Samples* samples, const char** lineStart, const char** lineEnd) {
+    const char* p = samples->buffer + samples->start;
+    const char* end = samples->buffer + samples->end;
+    const char* newline;
+    if(p == end) {
+        return 0;
+    }
+    newline = memchr(p, '\n', end - p);
+    if(newline == NULL) {
+        if(!samples->eof) {
+            return 0;
         }
-        *nextChar = fgetc(file);
+        newline = end;
     }
+    samples->start = newline - samples->buffer + (newline < end);
+    while(newline > p && newline[-1] == '\r') {
+        newline--;
+    }
+    *lineStart = p;
+    *lineEnd = newline;
+    return 1;
 }
 
-char* readWord(FILE* file, int* nextChar) {
-    char* dst;
-    int i, len;
-    
-    len = 32;
-    assert((dst = malloc(sizeof(char) * len)) != NULL);
+/*
+ * Parses one line of samples into dest, packed one bit per TP. Returns 1 on
+ * success or -1 if the line is invalid, printing why if report is set.
+ */
+int parseSampleLine(Samples* samples, const char* p, const char* end, TruthWord* dest, int line, int report) {
+    const char* filename = samples->filename;
+    const int* indices = samples->indices;
+    uint64_t cells, bits;
+    int i, k;
+
+    memset(dest, 0, sizeof(TruthWord) * samples->nSampleWords);
     i = 0;
-    for(;;) {
-        if(!(isalnum(*nextChar) || *nextChar == '_' || *nextChar == '-')) {
-            *(dst + i) = '\0';
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while(i + CELLS_PER_WORD <= samples->nTp && end - p >= (long) sizeof(cells)) {
+        memcpy(&cells, p, sizeof(cells));
+        if((cells & CELLS_COMMA_MASK) != CELLS_COMMAS || (cells & CELLS_DIGIT_MASK) != CELLS_DIGITS) {
             break;
         }
-        if(i >= len - 1) {
-            len = len + 1;
-            assert((dst = realloc(dst, sizeof(char) * len)) != NULL);
+        bits = (cells & CELLS_BIT_MASK) * CELLS_GATHER >> CELLS_GATHER_SHIFT;
+        for(k = 0; k < CELLS_PER_WORD; k++) {
+            dest[indices[i + k] / TRUTH_WORD_BITS] |= (TruthWord) ((bits >> k) & 1) << (indices[i + k] % TRUTH_WORD_BITS);
+        }
+        i += CELLS_PER_WORD;
+        p += sizeof(cells);
+    }
+    if(i == samples->nTp && p != end) {
+        if(report) {
+            fprintf(stderr, "There are too many columns in file \"%s\", line %d\n", filename, line);
+        }
+        return -1;
+    }
+    if(i > 0 && i < samples->nTp && p == end) {
+        if(report) {
+            fprintf(stderr, "There are too few columns in file \"%s\", line %d\n", filename, line);
+        }
+        return -1;
+    }
+#endif
+    for(; i < samples->nTp; i++) {
+        p = skipBlanks(p, end);
+        if(p == end || (*p != '0' && *p != '1')) {
+            if(report) {
+                fprintf(stderr, "\"%c\" is not a valid bit in file \"%s\", line %d\n", p == end ? '\n' : *p, filename, line);
+            }
+            return -1;
+        }
+        dest[indices[i] / TRUTH_WORD_BITS] |= (TruthWord) (*p - '0') << (indices[i] % TRUTH_WORD_BITS);
+        p = skipBlanks(p + 1, end);
+        if(p == end || *p != ',') {
+            if(report) {
+                fprintf(stderr, "Comma missing in file \"%s\", line %d\n", filename, line);
+            }
+            return -1;
+        }
+        p++;
+        if(i + 1 == samples->nTp) {
+            if(p != end) {
+                if(report) {
+                    fprintf(stderr, "There are too many columns in file \"%s\", line %d\n", filename, line);
+                }
+                return -1;
+            }
+        } else if(p == end) {
+            if(report) {
+                fprintf(stderr, "There are too few columns in file \"%s\", line %d\n", filename, line);
+            }
+            return -1;
         }
-        *(dst + i) = *nextChar;
-        i++;
-        *nextChar = fgetc(file);
     }
-    return dst;
+    return 1;
 }
 
-int readBit(FILE* file, int* nextChar) {
-    if(*nextChar == '0' ) {
-        *nextChar = fgetc(file);
-        return 0;
-    } else if(*nextChar == '1' ) {
-        *nextChar = fgetc(file);
-        return 1;
-    } else {
-        return -1;
+void* runSampleParseJob(void* arg) {
+    SampleParseJob* job = arg;
+    Samples* samples = job->samples;
+    TruthWord* dest;
+    int k;
+    job->bad = -1;
+    for(k = job->first; k < job->last; k++) {
+        dest = samples->window + (long) (samples->nWindowRows + k) * samples->nSampleWords;
+        if(parseSampleLine(samples, samples->lineStarts[k], samples->lineEnds[k], dest, 0, 0) < 0) {
+            job->bad = k;
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the time of the next sample put in the window, from the last time
+ * record read or, until there is one, from the number of samples before it.
+ */
+uint64_t takeSampleTime(Samples* samples) {
+    uint64_t time;
+    time = samples->timed ? samples->time : (uint64_t) samples->nRead * SAMPLES_UNTIMED_PERIOD_NS;
+    samples->nRead++;
+    return time;
+}
+
+/*
+ * Parses the n lines taken into lineStarts and lineEnds onto the end of the
+ * window, splitting them between threads when there are enough of them. The
+ * lines before the first invalid one are kept, that one is reported and the
+ * samples marked failed.
+ */
+void parseSampleLines(Samples* samples, int n) {
+    SampleParseJob jobs[SAMPLES_MAX_PARSE_THREADS];
+    pthread_t threads[SAMPLES_MAX_PARSE_THREADS];
+    int started[SAMPLES_MAX_PARSE_THREADS];
+    int t, nJobs, bad;
+
+    nJobs = 1;
+    if(n >= SAMPLES_PARALLEL_MIN_ROWS) {
+        nJobs = samples->nThreads;
+    }
+    for(t = 0; t < nJobs; t++) {
+        jobs[t].samples = samples;
+        jobs[t].first = (long) n * t / nJobs;
+        jobs[t].last = (long) n * (t + 1) / nJobs;
+        started[t] = 0;
+    }
+    for(t = 1; t < nJobs; t++) {
+        started[t] = pthread_create(&threads[t], NULL, runSampleParseJob, &jobs[t]) == 0;
+        if(!started[t]) {
+            runSampleParseJob(&jobs[t]);
+        }
+    }
+    runSampleParseJob(&jobs[0]);
+    bad = -1;
+    for(t = 0; t < nJobs; t++) {
+        if(started[t]) {
+            pthread_join(threads[t], NULL);
+        }
+        if(bad < 0 && jobs[t].bad >= 0) {
+            bad = jobs[t].bad;
+        }
+    }
+
+    if(bad >= 0) {
+        parseSampleLine(samples, samples->lineStarts[bad], samples->lineEnds[bad],
+                samples->window + (long) (samples->nWindowRows + bad) * samples->nSampleWords, samples->lineNumbers[bad], 1);
+        samples->failed = 1;
+        n = bad;
+    }
+    for(t = 0; t < n; t++) {
+        samples->times[samples->nWindowRows + t] = takeSampleTime(samples);
     }
+    samples->nWindowRows += n;
 }
 
 void freeSamples(Samples* samples) {
-    int i, j;
-    
     assert(samples != NULL);
-    
-    for(i = 0; i < samples->nSamplePoints; i++) {
-        free(samples->data[i]);
-    }
-    free(samples->data);
+
+    close(samples->fd);
+    free(samples->buffer);
+    free(samples->filename);
+    free(samples->indices);
+    free(samples->window);
+    free(samples->times);
+    free(samples->lineStarts);
+    free(samples->lineEnds);
+    free(samples->lineNumbers);
+    free(samples->previous);
     free(samples);
 }
 
-Samples* createSamplesFromFile(AssertionsSet* set, const char* filename) {
-    Samples* samples = NULL;
-    FILE * file;
-    int error;
-    int i, j, c, line, index;
-    int* indices;
+/*
+ * Reads the header line naming the TP of each column. Returns 1 on success or
+ * 0 if the header is invalid.
+ */
+int readSamplesHeader(Samples* samples, AssertionsSet* set) {
+    const char* filename = samples->filename;
+    const char* p = "";
+    const char* end = p;
+    const char* word;
+    int error, i, index;
+    int* columns;
     char* name;
-    
-    assert(set != NULL);
-    
-    file = fopen(filename, "r");
-    if(file) {
-        error = 0;
-        assert((indices = malloc(sizeof(int) * set->nTp)) != NULL);
-        
-        c = fgetc(file);
-        for(i = 0; i < set->nTp; i++) {
-            skipWhiteSpace(file, &c);
-            name = readWord(file, &c);
-            skipWhiteSpace(file, &c);
-            if(strlen(name) == 0) {
-                fprintf(stderr, "Name %d is empty in file \"%s\"\n", i, filename);
-                error = 1;
-                break;
-            }
-            index = getIndexOfTPByName(set, name);
-            if(index < 0) {
-                fprintf(stderr, "Name %d (\"%s\") is not a valid test point in file \"%s\"\n", i, name, filename);
-                free(name);
-                error = 1;
-                break;
-            }
-            for(j = 0; j < i; j++) {
-                if(indices[j] == index) {
-                    fprintf(stderr, "Name %d (\"%s\") is repeated at name %d in file \"%s\"\n", j, i, name, filename);
-                    free(name);
-                    error = 1;
-                    break;
-                }
-            }
-            if(error) {
-                break;
-            }
-            indices[i] = index;
-            if(c != ',') {
-                fprintf(stderr, "Name %d (\"%s\") is not followed by a comma in file \"%s\"\n", i, name, filename);
+
+    while(!takeBufferedLine(samples, &p, &end)) {
+        if(!refillSampleBuffer(samples)) {
+            break;
+        }
+    }
+
+    error = 0;
+    assert((columns = malloc(sizeof(int) * set->nTp)) != NULL);
+    for(i = 0; i < set->nTp; i++) {
+        columns[i] = -1;
+    }
+
+    for(i = 0; i < set->nTp; i++) {
+        p = skipBlanks(p, end);
+        for(word = p; p < end && isNameChar(*p); p++);
+        assert((name = malloc(sizeof(char) * (p - word + 1))) != NULL);
+        memcpy(name, word, p - word);
+        name[p - word] = '\0';
+        p = skipBlanks(p, end);
+        if(strlen(name) == 0) {
+            fprintf(stderr, "Name %d is empty in file \"%s\"\n", i, filename);
+            free(name);
+            error = 1;
+            break;
+        }
+        index = getIndexOfTPByName(set, name);
+        if(index < 0) {
+            fprintf(stderr, "Name %d (\"%s\") is not a valid test point in file \"%s\"\n", i, name, filename);
+            free(name);
+            error = 1;
+            break;
+        }
+        if(columns[index] >= 0) {
+            fprintf(stderr, "Name %d (\"%s\") is repeated at name %d in file \"%s\"\n", columns[index], name, i, filename);
+            free(name);
+            error = 1;
+            break;
+        }
+        columns[index] = i;
+        samples->indices[i] = index;
+        if(p == end || *p != ',') {
+            fprintf(stderr, "Name %d (\"%s\") is not followed by a comma in file \"%s\"\n", i, name, filename);
+            error = 1;
+            free(name);
+            break;
+        }
+        p++;
+        if(i + 1 == set->nTp) {
+            if(p != end) {
+                fprintf(stderr, "This circuit only contains %d test points and name %d (\"%s\") is not followed by newline in file \"%s\"\n",
+                        set->nTp, i, name, filename);
                 error = 1;
                 free(name);
                 break;
             }
-            c = fgetc(file);
-            if(i + 1 == set->nTp) {
-                if(isNewline(c)) {
-                    readNewline(file, &c);
-                } else if(c != EOF) {
-                    fprintf(stderr, "This circuit only contains %d test points and name %d (\"%s\") is not followed by newline in file \"%s\"\n",
-                            set->nTp, i, name, filename);
-                    error = 1;
-                    free(name);
-                    break;
-                }
-            } else {
-                if(isNewline(c) || c == EOF) {
-                    fprintf(stderr, "This circuit contains %d test points but only %d names are specified in file \"%s\"\n",
-                            set->nTp, i + 1, filename);
-                    error = 1;
-                    free(name);
-                    break;
-                }
-            }
+        } else if(p == end) {
+            fprintf(stderr, "This circuit contains %d test points but only %d names are specified in file \"%s\"\n",
+                    set->nTp, i + 1, filename);
+            error = 1;
             free(name);
+            break;
         }
-        
-        if(!error) {
-            assert((samples = malloc(sizeof(Samples))) != NULL);
-            samples->index = 0;
-            samples->data = NULL;
-            samples->nSamplePoints = 0;
-            
-            for(line = 1; !error; line++) {
-                if(c == EOF) {
-                    break;
-                }
-                samples->nSamplePoints++;
-                assert((samples->data = realloc(samples->data, sizeof(int*) * samples->nSamplePoints)) != NULL);
-                assert((samples->data[samples->nSamplePoints - 1] = malloc(sizeof(int) * set->nTp)) != NULL);
-                for(i = 0; i < set->nTp; i++) {
-                    skipWhiteSpace(file, &c);
-                    j = readBit(file, &c);
-                    if(j < 0) {
-                        fprintf(stderr, "\"%c\" is not a valid bit in file \"%s\", line %d\n", c, filename, line);
-                        error = 1;
-                        break;
-                    }
-                    samples->data[samples->nSamplePoints - 1][indices[i]] = j;
-                    skipWhiteSpace(file, &c);
-                    if(c != ',') {
-                        fprintf(stderr, "Comma missing in file \"%s\", line %d\n", filename, line);
-                        error = 1;
-                        break;
-                    }
-                    c = fgetc(file);
-                    if(i + 1 == set->nTp) {
-                        if(isNewline(c)) {
-                            readNewline(file, &c);
-                        } else if(c != EOF) {
-                            fprintf(stderr, "There are too many columns in file \"%s\", line %d\n", filename, line);
-                            error = 1;
-                            break;
-                        }
-                    } else {
-                        if(isNewline(c) || c == EOF) {
-                            fprintf(stderr, "There are too few columns in file \"%s\", line %d\n", filename, line);
-                            error = 1;
-                            break;
-                        }
-                    }
-                }
-            }
-            if(error) {
-                for(i = 0; i < samples->nSamplePoints; i++) {
-                    free(samples->data[i]);
-                }
-                free(samples->data);
-                free(samples);
-                samples = NULL;
+        free(name);
+    }
+
+    free(columns);
+    return !error;
+}
+
+/*
+ * Reads the header of a binary capture and maps its columns to TPs. Returns 1
+ * on success or 0 if the header is invalid.
+ */
+int readCaptureSamplesHeader(Samples* samples, AssertionsSet* set) {
+    const char* filename = samples->filename;
+    char** names = NULL;
+    int* columns;
+    int error, i, index, nColumns;
+    long used;
+
+    for(;;) {
+        used = readCaptureHeader((unsigned char*) samples->buffer + samples->start, samples->end - samples->start, &names, &nColumns);
+        if(used != 0 || !refillSampleBuffer(samples)) {
+            break;
+        }
+    }
+    if(used <= 0) {
+        fprintf(stderr, "The header of file \"%s\" is truncated or from an unsupported version\n", filename);
+        return 0;
+    }
+    samples->start += used;
+
+    error = 0;
+    if(nColumns != set->nTp) {
+        fprintf(stderr, "This circuit contains %d test points but %d names are specified in file \"%s\"\n", set->nTp, nColumns, filename);
+        error = 1;
+    }
+    assert((columns = malloc(sizeof(int) * (set->nTp + 1))) != NULL);
+    for(i = 0; i < set->nTp; i++) {
+        columns[i] = -1;
+    }
+    for(i = 0; i < nColumns && !error; i++) {
+        index = getIndexOfTPByName(set, names[i]);
+        if(index < 0) {
+            fprintf(stderr, "Name %d (\"%s\") is not a valid test point in file \"%s\"\n", i, names[i], filename);
+            error = 1;
+        } else if(columns[index] >= 0) {
+            fprintf(stderr, "Name %d (\"%s\") is repeated at name %d in file \"%s\"\n", columns[index], names[i], i, filename);
+            error = 1;
+        } else {
+            columns[index] = i;
+            samples->indices[i] = index;
+        }
+    }
+
+    for(i = 0; i < nColumns; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free(columns);
+    return !error;
+}
+
+/*
+ * Replaces the window with the next SAMPLES_WINDOW_ROWS samples of a binary
+ * capture, expanding runs of repeated samples. An invalid record ends the
+ * samples and marks them failed.
+ */
+void fillSamplesWindowFromCapture(Samples* samples) {
+    size_t maxRecordSize;
+    long used, n;
+
+    maxRecordSize = captureMaxRecordSize(samples->nTp);
+    samples->index = 0;
+    samples->nWindowRows = 0;
+    while(samples->nWindowRows < SAMPLES_WINDOW_ROWS) {
+        if(samples->nRepeats > 0) {
+            memcpy(samples->window + (long) samples->nWindowRows * samples->nSampleWords, samples->previous,
+                    sizeof(TruthWord) * samples->nSampleWords);
+            samples->times[samples->nWindowRows] = takeSampleTime(samples);
+            samples->nRepeats--;
+            samples->nWindowRows++;
+            samples->line++;
+            continue;
+        }
+        if(samples->captureEnded || samples->failed) {
+            break;
+        }
+        while(samples->end - samples->start < maxRecordSize && refillSampleBuffer(samples));
+        if(samples->start == samples->end) {
+            fprintf(stderr, "File \"%s\" is truncated after sample %d\n", samples->filename, samples->line);
+            samples->failed = 1;
+            break;
+        }
+        used = decodeCaptureRecord((unsigned char*) samples->buffer + samples->start, samples->end - samples->start,
+                samples->nTp, samples->indices, samples->previous, &n, &samples->time);
+        if(used < 0) {
+            fprintf(stderr, "Invalid or truncated record in file \"%s\", sample %d\n", samples->filename, samples->line + 1);
+            samples->failed = 1;
+        } else if(used == 0) {
+            samples->captureEnded = 1;
+        } else {
+            samples->start += used;
+            samples->nRepeats = n;
+            samples->timed = samples->timed || n == 0;
+        }
+    }
+}
+
+/*
+ * Replaces the window with the next SAMPLES_WINDOW_ROWS samples of the file,
+ * skipping empty lines, which still count towards the line numbers
+ * reported. A line that fails to parse ends the samples after the lines
+ * before it and marks them failed.
+ */
+void fillSamplesWindow(Samples* samples) {
+    int n;
+    if(samples->isCapture) {
+        fillSamplesWindowFromCapture(samples);
+        return;
+    }
+    samples->index = 0;
+    samples->nWindowRows = 0;
+    while(samples->nWindowRows < SAMPLES_WINDOW_ROWS && !samples->failed) {
+        // Lines point into the buffer so they are parsed before it is refilled
+        n = 0;
+        while(samples->nWindowRows + n < SAMPLES_WINDOW_ROWS
+                && takeBufferedLine(samples, &samples->lineStarts[n], &samples->lineEnds[n])) {
+            samples->line++;
+            if(samples->lineStarts[n] != samples->lineEnds[n]) {
+                samples->lineNumbers[n] = samples->line;
+                n++;
             }
         }
-        fclose(file);
-        
-        free(indices);
-    } else {
+        if(n > 0) {
+            parseSampleLines(samples, n);
+        } else if(!refillSampleBuffer(samples)) {
+            break;
+        }
+    }
+}
+
+/*
+ * Opens a sample file for replay, either csv or a binary capture which is
+ * recognised by its magic number. Only the header is checked here, the
+ * samples are parsed as they are replayed into a window of
+ * SAMPLES_WINDOW_ROWS samples so memory use does not grow with the file.
+ */
+Samples* createSamplesFromFile(AssertionsSet* set, const char* filename) {
+    Samples* samples;
+    long nCpus;
+    int fd;
+
+    assert(set != NULL);
+
+    fd = open(filename, O_RDONLY);
+    if(fd < 0) {
         fprintf(stderr, "Could not open file \"%s\" for reading\n", filename);
+        return NULL;
     }
-    
+
+    assert((samples = malloc(sizeof(Samples))) != NULL);
+    samples->fd = fd;
+    samples->bufferSize = SAMPLES_READ_BUFFER_SIZE;
+    assert((samples->buffer = malloc(samples->bufferSize)) != NULL);
+    samples->start = 0;
+    samples->end = 0;
+    samples->eof = 0;
+    assert((samples->filename = malloc(sizeof(char) * (strlen(filename) + 1))) != NULL);
+    strcpy(samples->filename, filename);
+    samples->nTp = set->nTp;
+    samples->nSampleWords = getSampleWords(set);
+    samples->line = 0;
+    samples->failed = 0;
+    nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    samples->nThreads = nCpus < 1 ? 1 : nCpus > SAMPLES_MAX_PARSE_THREADS ? SAMPLES_MAX_PARSE_THREADS : nCpus;
+    assert((samples->indices = malloc(sizeof(int) * (set->nTp + 1))) != NULL);
+    assert((samples->window = malloc(sizeof(TruthWord) * ((long) samples->nSampleWords * SAMPLES_WINDOW_ROWS + 1))) != NULL);
+    assert((samples->times = malloc(sizeof(uint64_t) * SAMPLES_WINDOW_ROWS)) != NULL);
+    assert((samples->lineStarts = malloc(sizeof(char*) * SAMPLES_WINDOW_ROWS)) != NULL);
+    assert((samples->lineEnds = malloc(sizeof(char*) * SAMPLES_WINDOW_ROWS)) != NULL);
+    assert((samples->lineNumbers = malloc(sizeof(int) * SAMPLES_WINDOW_ROWS)) != NULL);
+    assert((samples->previous = calloc(samples->nSampleWords + 1, sizeof(TruthWord))) != NULL);
+    samples->nRepeats = 0;
+    samples->captureEnded = 0;
+    samples->time = 0;
+    samples->timed = 0;
+    samples->nRead = 0;
+
+    while(samples->end - samples->start < CAPTURE_MAGIC_LEN && refillSampleBuffer(samples));
+    samples->isCapture = samples->end - samples->start >= CAPTURE_MAGIC_LEN
+            && memcmp(samples->buffer + samples->start, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) == 0;
+    if(samples->isCapture ? !readCaptureSamplesHeader(samples, set) : !readSamplesHeader(samples, set)) {
+        freeSamples(samples);
+        return NULL;
+    }
+    fillSamplesWindow(samples);
     return samples;
 }
 
 int samplesNext(Samples* samples) {
     assert(samples != NULL);
-    
+
     samples->index++;
-    if(samples->index >= samples->nSamplePoints) {
-        return 0;
+    if(samples->index >= samples->nWindowRows) {
+        fillSamplesWindow(samples);
+        return samples->nWindowRows > 0;
     }
     return 1;
 }
 
-void samplesGetValues(Wiring* wiring, Samples* samples, int* dest) {
+/*
+ * Whether replay stopped early because a line of the file could not be
+ * parsed.
+ */
+int samplesFailed(Samples* samples) {
+    return samples->failed;
+}
+
+/*
+ * Advances through up to maxN samples as samplesNext does, storing a pointer
+ * to each sample in dest and, unless times is NULL, the time it was taken in
+ * times. The pointers stay valid until the next call, which may refill the
+ * window. Fewer than maxN samples are returned when the window runs out,
+ * zero once none remain.
+ */
+int samplesGetBatch(Samples* samples, const TruthWord** dest, uint64_t* times, int maxN) {
+    int n = 0;
+    if(samples->index + 1 >= samples->nWindowRows) {
+        if(!samplesNext(samples)) {
+            return 0;
+        }
+        if(times != NULL) {
+            times[n] = samples->times[samples->index];
+        }
+        dest[n++] = samplesGetView(samples);
+    }
+    while(n < maxN && samples->index + 1 < samples->nWindowRows) {
+        samples->index++;
+        if(times != NULL) {
+            times[n] = samples->times[samples->index];
+        }
+        dest[n++] = samplesGetView(samples);
+    }
+    return n;
+}
+
+/*
+ * Returns the current sample in place, packed with TP i in bit i, valid until
+ * the window is refilled by samplesNext or samplesGetBatch.
+ */
+const TruthWord* samplesGetView(Samples* samples) {
+    assert(samples->index < samples->nWindowRows);
+    return samples->window + (long) samples->index * samples->nSampleWords;
+}
+
+/*
+ * Copies the current sample to dest as one int per TP.
+ */
+void samplesGetValues(Samples* samples, int* dest) {
     assert(samples != NULL);
-    assert(samples->index < samples->nSamplePoints);
-    memcpy(dest, samples->data[samples->index], sizeof(int) * wiring->nWires);
-}
\ No newline at end of file
+    unpackBits(samplesGetView(samples), samples->nTp, dest);
+}
+
+/*
+ * Copies the current sample to dest packed one bit per TP, nSampleWords
+ * words.
+ */
+void samplesGetPackedValues(Samples* samples, TruthWord* dest) {
+    assert(samples != NULL);
+    memcpy(dest, samplesGetView(samples), sizeof(TruthWord) * samples->nSampleWords);
+}
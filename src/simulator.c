@@ -0,0 +1,185 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simulator.h"
+
+#define SIMULATOR_PIN_WORD(pin) ((pin) / 64)
+#define SIMULATOR_PIN_BIT(pin) ((uint64_t) 1 << ((pin) % 64))
+
+Simulator* getSimulator(SamplingBackend* backend) {
+    assert(backend != NULL && strcmp(backend->name, BACKEND_NAME_SIMULATOR) == 0);
+    return backend->state;
+}
+
+uint64_t simulatorRandom(Simulator* simulator) {
+    uint64_t x = simulator->random;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    simulator->random = x;
+    return x;
+}
+
+int simulatorPhysPinToGpio(SamplingBackend* backend, int physPin) {
+    Simulator* simulator = backend->state;
+    if(physPin < 1 || physPin > simulator->nPins) {
+        return -1;
+    }
+    return physPin;
+}
+
+int simulatorValidPin(Simulator* simulator, int pin) {
+    return pin >= 1 && pin <= simulator->nPins;
+}
+
+void simulatorSetPinMode(SamplingBackend* backend, int pin, int mode) {
+    Simulator* simulator = backend->state;
+    int i;
+    if(!simulatorValidPin(simulator, pin) || simulator->modes[pin] == mode) {
+        return;
+    }
+    if(simulator->modes[pin] == PIN_INPUT) {
+        for(i = 0; simulator->inputPins[i] != pin; i++);
+        simulator->inputPins[i] = simulator->inputPins[--simulator->nInputPins];
+    }
+    simulator->modes[pin] = mode;
+    if(mode == PIN_INPUT) {
+        simulator->inputPins[simulator->nInputPins++] = pin;
+    }
+}
+
+void setSimulatorLevel(Simulator* simulator, int pin, int value) {
+    if(!simulatorValidPin(simulator, pin)) {
+        return;
+    }
+    if(value == PIN_HIGH) {
+        simulator->levels[SIMULATOR_PIN_WORD(pin)] |= SIMULATOR_PIN_BIT(pin);
+    } else {
+        simulator->levels[SIMULATOR_PIN_WORD(pin)] &= ~SIMULATOR_PIN_BIT(pin);
+    }
+}
+
+/*
+ * Sets the level of a pin as seen when the inputs are not held.
+ */
+void simulatorSetPin(SamplingBackend* backend, int pin, int value) {
+    setSimulatorLevel(getSimulator(backend), pin, value);
+}
+
+void simulatorWritePin(SamplingBackend* backend, int pin, int value) {
+    Simulator* simulator = backend->state;
+    int input;
+
+    setSimulatorLevel(simulator, pin, value);
+    if(!simulatorValidPin(simulator, pin) || simulator->modes[pin] != PIN_OUTPUT) {
+        return;
+    }
+    if(value == PIN_LOW && !simulator->held) {
+        simulator->nHolds++;
+        if(simulator->flipPeriod > 0 && simulator->nInputPins > 0 && simulator->nHolds % simulator->flipPeriod == 0) {
+            input = simulator->inputPins[simulatorRandom(simulator) % simulator->nInputPins];
+            simulator->levels[SIMULATOR_PIN_WORD(input)] ^= SIMULATOR_PIN_BIT(input);
+        }
+        memcpy(simulator->latched, simulator->levels, sizeof(uint64_t) * (SIMULATOR_PIN_WORD(simulator->nPins) + 1));
+        simulator->held = 1;
+    } else if(value == PIN_HIGH) {
+        simulator->held = 0;
+    }
+}
+
+int simulatorReadPin(SamplingBackend* backend, int pin) {
+    Simulator* simulator = backend->state;
+    uint64_t* levels;
+    if(!simulatorValidPin(simulator, pin)) {
+        return PIN_LOW;
+    }
+    simulator->nReads++;
+    levels = simulator->held ? simulator->latched : simulator->levels;
+    return (levels[SIMULATOR_PIN_WORD(pin)] & SIMULATOR_PIN_BIT(pin)) != 0 ? PIN_HIGH : PIN_LOW;
+}
+
+/*
+ * Reads the levels as registers of 32 pins, the latched levels while the
+ * inputs are held.
+ */
+void simulatorReadLevels(SamplingBackend* backend, uint32_t* levels, int nWords) {
+    Simulator* simulator = backend->state;
+    uint64_t* words;
+    int i;
+
+    simulator->nLevelReads++;
+    words = simulator->held ? simulator->latched : simulator->levels;
+    for(i = 0; i < nWords; i++) {
+        levels[i] = (uint32_t) (words[i / 2] >> (32 * (i % 2)));
+    }
+}
+
+int simulatorSetupSPI(SamplingBackend* backend, int channel, int speed) {
+    (void) backend;
+    (void) channel;
+    (void) speed;
+    return 1;
+}
+
+int simulatorWriteSPI(SamplingBackend* backend, int channel, unsigned char* data, int n) {
+    Simulator* simulator = backend->state;
+    (void) channel;
+    (void) data;
+    simulator->nSPIWrites++;
+    simulator->nSPIBytes += n;
+    return 1;
+}
+
+void freeSimulatorBackend(SamplingBackend* backend) {
+    Simulator* simulator = backend->state;
+    free(simulator->levels);
+    free(simulator->latched);
+    free(simulator->modes);
+    free(simulator->inputPins);
+    free(simulator);
+    free(backend);
+}
+
+/*
+ * Creates a simulated header of nPins pins, all low and none configured.
+ * A flipPeriod of 0 leaves the pins as set by simulatorSetPin.
+ */
+SamplingBackend* createSimulatorBackend(int nPins, uint64_t seed, long flipPeriod) {
+    SamplingBackend* backend;
+    Simulator* simulator;
+    int nWords;
+
+    assert(nPins > 0);
+    nWords = SIMULATOR_PIN_WORD(nPins) + 1;
+    assert((simulator = malloc(sizeof(Simulator))) != NULL);
+    simulator->nPins = nPins;
+    assert((simulator->levels = calloc(nWords, sizeof(uint64_t))) != NULL);
+    assert((simulator->latched = calloc(nWords, sizeof(uint64_t))) != NULL);
+    assert((simulator->modes = malloc(sizeof(int) * (nPins + 1))) != NULL);
+    memset(simulator->modes, -1, sizeof(int) * (nPins + 1));
+    assert((simulator->inputPins = malloc(sizeof(int) * (nPins + 1))) != NULL);
+    simulator->nInputPins = 0;
+    simulator->held = 0;
+    simulator->random = seed != 0 ? seed : 1;
+    simulator->flipPeriod = flipPeriod;
+    simulator->nHolds = 0;
+    simulator->nReads = 0;
+    simulator->nLevelReads = 0;
+    simulator->nSPIWrites = 0;
+    simulator->nSPIBytes = 0;
+
+    assert((backend = malloc(sizeof(SamplingBackend))) != NULL);
+    backend->name = BACKEND_NAME_SIMULATOR;
+    backend->physPinToGpio = simulatorPhysPinToGpio;
+    backend->setPinMode = simulatorSetPinMode;
+    backend->writePin = simulatorWritePin;
+    backend->readPin = simulatorReadPin;
+    backend->nLevelWords = nPins / 32 + 1;
+    backend->readLevels = simulatorReadLevels;
+    backend->setupSPI = simulatorSetupSPI;
+    backend->writeSPI = simulatorWriteSPI;
+    backend->free = freeSimulatorBackend;
+    backend->state = simulator;
+    return backend;
+}
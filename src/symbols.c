@@ -0,0 +1,112 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "symbols.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+#define MIN_CAPACITY 16
+
+unsigned int hashName(const char* name) {
+    unsigned int hash = FNV_OFFSET_BASIS;
+    for(; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char) *name) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/*
+ * Returns the slot holding name, or the empty slot it would be inserted
+ * into. The table is never more than half full so there is always one.
+ */
+int findSymbolSlot(SymbolTable* table, const char* name, unsigned int hash) {
+    int i, mask = table->capacity - 1;
+    for(i = hash & mask; table->names[i] != NULL; i = (i + 1) & mask) {
+        if(table->hashes[i] == hash && strcmp(table->names[i], name) == 0) {
+            break;
+        }
+    }
+    return i;
+}
+
+void allocateSymbolSlots(SymbolTable* table, int capacity) {
+    table->capacity = capacity;
+    assert((table->names = calloc(capacity, sizeof(char*))) != NULL);
+    assert((table->ids = malloc(sizeof(int) * capacity)) != NULL);
+    assert((table->hashes = malloc(sizeof(unsigned int) * capacity)) != NULL);
+}
+
+void growSymbolTable(SymbolTable* table) {
+    char** names = table->names;
+    int* ids = table->ids;
+    unsigned int* hashes = table->hashes;
+    int i, j, capacity = table->capacity;
+
+    allocateSymbolSlots(table, capacity * 2);
+    for(i = 0; i < capacity; i++) {
+        if(names[i] != NULL) {
+            j = findSymbolSlot(table, names[i], hashes[i]);
+            table->names[j] = names[i];
+            table->ids[j] = ids[i];
+            table->hashes[j] = hashes[i];
+        }
+    }
+    free(names);
+    free(ids);
+    free(hashes);
+}
+
+SymbolTable* createSymbolTable(int expected) {
+    SymbolTable* table;
+    int capacity = MIN_CAPACITY;
+    while(capacity < expected * 2) {
+        capacity *= 2;
+    }
+    assert((table = malloc(sizeof(SymbolTable))) != NULL);
+    table->n = 0;
+    allocateSymbolSlots(table, capacity);
+    return table;
+}
+
+void freeSymbolTable(SymbolTable* table) {
+    int i;
+    if(table != NULL) {
+        for(i = 0; i < table->capacity; i++) {
+            free(table->names[i]);
+        }
+        free(table->names);
+        free(table->ids);
+        free(table->hashes);
+        free(table);
+    }
+}
+
+/*
+ * Adds name with the given id. If name is already in the table it is left
+ * unchanged and its existing id is returned, otherwise returns -1.
+ */
+int symbolTableInsert(SymbolTable* table, const char* name, int id) {
+    unsigned int hash = hashName(name);
+    int i = findSymbolSlot(table, name, hash);
+    if(table->names[i] != NULL) {
+        return table->ids[i];
+    }
+    assert((table->names[i] = malloc(strlen(name) + 1)) != NULL);
+    strcpy(table->names[i], name);
+    table->ids[i] = id;
+    table->hashes[i] = hash;
+    table->n++;
+    if(table->n * 2 > table->capacity) {
+        growSymbolTable(table);
+    }
+    return -1;
+}
+
+int symbolTableFind(SymbolTable* table, const char* name) {
+    unsigned int hash = hashName(name);
+    int i = findSymbolSlot(table, name, hash);
+    if(table->names[i] == NULL) {
+        return -1;
+    }
+    return table->ids[i];
+}
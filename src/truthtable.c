@@ -0,0 +1,308 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "truthtable.h"
+
+/*
+ * Tables with fewer than 64 rows still give each column a whole word and the
+ * unused high bits are never read.
+ */
+static const TruthWord inputPatterns[6] = {
+    0xAAAAAAAAAAAAAAAAULL,
+    0xCCCCCCCCCCCCCCCCULL,
+    0xF0F0F0F0F0F0F0F0ULL,
+    0xFF00FF00FF00FF00ULL,
+    0xFFFF0000FFFF0000ULL,
+    0xFFFFFFFF00000000ULL
+};
+
+/*
+ * Packs n values one bit each, value i in bit i % 64 of word i / 64, leaving
+ * the unused high bits of the last word clear.
+ */
+void packBits(const int* values, int n, TruthWord* dest) {
+    int i;
+    memset(dest, 0, sizeof(TruthWord) * TRUTH_WORDS_FOR_BITS(n));
+    for(i = 0; i < n; i++) {
+        dest[i / TRUTH_WORD_BITS] |= (TruthWord) (values[i] != 0) << (i % TRUTH_WORD_BITS);
+    }
+}
+
+void unpackBits(const TruthWord* src, int n, int* dest) {
+    int i;
+    for(i = 0; i < n; i++) {
+        dest[i] = (src[i / TRUTH_WORD_BITS] >> (i % TRUTH_WORD_BITS)) & 1;
+    }
+}
+
+/*
+ * Copies bits start to start + n - 1 of src to the bottom of dest, clearing
+ * the unused high bits of its last word.
+ */
+void extractBits(const TruthWord* src, int start, int n, TruthWord* dest) {
+    int i, bit, nWords, srcEnd;
+    nWords = TRUTH_WORDS_FOR_BITS(n);
+    srcEnd = TRUTH_WORDS_FOR_BITS(start + n);
+    for(i = 0; i < nWords; i++) {
+        bit = start + i * TRUTH_WORD_BITS;
+        dest[i] = src[bit / TRUTH_WORD_BITS] >> (bit % TRUTH_WORD_BITS);
+        if(bit % TRUTH_WORD_BITS != 0 && bit / TRUTH_WORD_BITS + 1 < srcEnd) {
+            dest[i] |= src[bit / TRUTH_WORD_BITS + 1] << (TRUTH_WORD_BITS - bit % TRUTH_WORD_BITS);
+        }
+    }
+    if(n % TRUTH_WORD_BITS != 0) {
+        dest[nWords - 1] &= ~(TruthWord) 0 >> (TRUTH_WORD_BITS - n % TRUTH_WORD_BITS);
+    }
+}
+
+/*
+ * Transposes a 64 by 64 bit matrix in place, so bit j of word i moves to bit
+ * i of word j, by swapping ever smaller blocks.
+ */
+void transposeBits64(TruthWord* block) {
+    TruthWord mask, t;
+    int j, k;
+    mask = 0x00000000FFFFFFFFULL;
+    for(j = 32; j != 0; j >>= 1, mask ^= mask << j) {
+        for(k = 0; k < TRUTH_WORD_BITS; k = (k + j + 1) & ~j) {
+            t = ((block[k] >> j) ^ block[k + j]) & mask;
+            block[k] ^= t << j;
+            block[k + j] ^= t;
+        }
+    }
+}
+
+int truthColumnWords(int nInputs) {
+    assert(nInputs >= 0 && nInputs <= TRUTH_TABLE_MAX_INPUTS);
+    return TRUTH_WORDS_FOR_BITS(1L << nInputs);
+}
+
+TruthColumn* createTruthColumn(int nWords) {
+    TruthColumn* column;
+    assert((column = malloc(sizeof(TruthColumn))) != NULL);
+    assert((column->words = malloc(sizeof(TruthWord) * nWords)) != NULL);
+    column->nWords = nWords;
+    column->refCount = 1;
+    return column;
+}
+
+TruthColumn* createInputTruthColumn(int nInputs, int inputIndex) {
+    TruthColumn* column;
+    int i;
+    assert(inputIndex >= 0 && inputIndex < nInputs);
+
+    column = createTruthColumn(truthColumnWords(nInputs));
+    for(i = 0; i < column->nWords; i++) {
+        if(inputIndex < 6) {
+            column->words[i] = inputPatterns[inputIndex];
+        } else {
+            column->words[i] = (i >> (inputIndex - 6)) & 1 ? ~(TruthWord) 0 : 0;
+        }
+    }
+    return column;
+}
+
+TruthColumn* retainTruthColumn(TruthColumn* column) {
+    column->refCount++;
+    return column;
+}
+
+void releaseTruthColumn(TruthColumn* column) {
+    if(column != NULL) {
+        assert(column->refCount > 0);
+        column->refCount--;
+        if(column->refCount == 0) {
+            free(column->words);
+            free(column);
+        }
+    }
+}
+
+/*
+ * Returns a column with the same contents that only the caller holds,
+ * copying it if it is shared. The caller's reference to column is passed on
+ * to the result.
+ */
+TruthColumn* unshareTruthColumn(TruthColumn* column) {
+    TruthColumn* copy;
+    if(column->refCount == 1) {
+        return column;
+    }
+    copy = createTruthColumn(column->nWords);
+    memcpy(copy->words, column->words, sizeof(TruthWord) * column->nWords);
+    releaseTruthColumn(column);
+    return copy;
+}
+
+void truthColumnAnd(TruthColumn* dst, const TruthColumn* src) {
+    int i;
+    assert(dst->refCount == 1);
+    for(i = 0; i < dst->nWords; i++) {
+        dst->words[i] &= src->words[i];
+    }
+}
+
+void truthColumnOr(TruthColumn* dst, const TruthColumn* src) {
+    int i;
+    assert(dst->refCount == 1);
+    for(i = 0; i < dst->nWords; i++) {
+        dst->words[i] |= src->words[i];
+    }
+}
+
+void truthColumnNot(TruthColumn* dst) {
+    int i;
+    assert(dst->refCount == 1);
+    for(i = 0; i < dst->nWords; i++) {
+        dst->words[i] = ~dst->words[i];
+    }
+}
+
+/*
+ * Whether a table for this many inputs and outputs stays within
+ * TRUTH_TABLE_MAX_BYTES, counting the table itself and one column per
+ * output held while it is built.
+ */
+int truthTableFits(int nInputs, int nOutputs) {
+    long nRows, bytes;
+    if(nInputs > TRUTH_TABLE_MAX_INPUTS) {
+        return 0;
+    }
+    nRows = 1L << nInputs;
+    bytes = (long) sizeof(TruthWord) * TRUTH_WORDS_FOR_BITS(nOutputs) * nRows;
+    bytes += (long) sizeof(TruthWord) * TRUTH_WORDS_FOR_BITS(nRows) * nOutputs;
+    return bytes <= TRUTH_TABLE_MAX_BYTES;
+}
+
+TruthTable* createTruthTable(int nInputs, int nOutputs) {
+    TruthTable* table;
+    assert(nInputs >= 0 && nInputs <= TRUTH_TABLE_MAX_INPUTS);
+    assert(nOutputs >= 0);
+
+    assert((table = malloc(sizeof(TruthTable))) != NULL);
+    table->nInputs = nInputs;
+    table->nOutputs = nOutputs;
+    table->nRowWords = TRUTH_WORDS_FOR_BITS(nOutputs);
+    table->rows = NULL;
+    table->mapping = NULL;
+    table->mappingSize = 0;
+    if(table->nRowWords > 0) {
+        assert((table->rows = calloc((size_t) table->nRowWords << nInputs, sizeof(TruthWord))) != NULL);
+    }
+    return table;
+}
+
+/*
+ * Wraps rows already laid out as a table inside mapping, which the table
+ * takes ownership of.
+ */
+TruthTable* createMappedTruthTable(int nInputs, int nOutputs, TruthWord* rows, void* mapping, size_t mappingSize) {
+    TruthTable* table;
+    assert(nInputs >= 0 && nInputs <= TRUTH_TABLE_MAX_INPUTS);
+    assert(nOutputs >= 0);
+
+    assert((table = malloc(sizeof(TruthTable))) != NULL);
+    table->nInputs = nInputs;
+    table->nOutputs = nOutputs;
+    table->nRowWords = TRUTH_WORDS_FOR_BITS(nOutputs);
+    table->rows = rows;
+    table->mapping = mapping;
+    table->mappingSize = mappingSize;
+    return table;
+}
+
+void freeTruthTable(TruthTable* table) {
+    if(table != NULL) {
+        if(table->mapping != NULL) {
+            munmap(table->mapping, table->mappingSize);
+        } else {
+            free(table->rows);
+        }
+        free(table);
+    }
+}
+
+void truthTableSetColumn(TruthTable* table, int output, const TruthColumn* column) {
+    long row, nRows;
+    TruthWord* rowWord;
+    TruthWord bit;
+    assert(output >= 0 && output < table->nOutputs);
+
+    nRows = 1L << table->nInputs;
+    rowWord = table->rows + output / TRUTH_WORD_BITS;
+    bit = (TruthWord) 1 << (output % TRUTH_WORD_BITS);
+    for(row = 0; row < nRows; row++) {
+        if((column->words[row / TRUTH_WORD_BITS] >> (row % TRUTH_WORD_BITS)) & 1) {
+            *rowWord |= bit;
+        } else {
+            *rowWord &= ~bit;
+        }
+        rowWord += table->nRowWords;
+    }
+}
+
+int truthTableGet(TruthTable* table, int row, int output) {
+    TruthWord word = table->rows[(long) row * table->nRowWords + output / TRUTH_WORD_BITS];
+    return (word >> (output % TRUTH_WORD_BITS)) & 1;
+}
+
+int truthTableRowForInputs(TruthTable* table, const int* inputs) {
+    int i, row = 0;
+    for(i = 0; i < table->nInputs; i++) {
+        row |= (inputs[i] != 0) << i;
+    }
+    return row;
+}
+
+/*
+ * Compares the outputs in samples, which follow the inputs, against the row
+ * selected by the inputs. Writes the sample index of each failing output to
+ * dest and returns how many there were.
+ */
+int truthTableCheck(TruthTable* table, const int* samples, int* dest) {
+    const TruthWord* expected;
+    const int* outputs;
+    TruthWord actual, diff;
+    int i, j, n, nBits;
+
+    expected = table->rows + (long) truthTableRowForInputs(table, samples) * table->nRowWords;
+    outputs = samples + table->nInputs;
+    n = 0;
+    for(i = 0; i < table->nRowWords; i++) {
+        nBits = table->nOutputs - i * TRUTH_WORD_BITS;
+        if(nBits > TRUTH_WORD_BITS) {
+            nBits = TRUTH_WORD_BITS;
+        }
+        actual = 0;
+        for(j = 0; j < nBits; j++) {
+            actual |= (TruthWord) (outputs[j] != 0) << j;
+        }
+        diff = (actual ^ expected[i]) & (~(TruthWord) 0 >> (TRUTH_WORD_BITS - nBits));
+        while(diff) {
+            dest[n++] = table->nInputs + i * TRUTH_WORD_BITS + __builtin_ctzll(diff);
+            diff &= diff - 1;
+        }
+        outputs += TRUTH_WORD_BITS;
+    }
+    return n;
+}
+
+/*
+ * Checks a packed sample, TP i in bit i, against the row selected by its
+ * input bits. The failing outputs are set in the nRowWords words of errors,
+ * output j in bit j % 64 of word j / 64.
+ */
+void truthTableCheckPacked(TruthTable* table, const TruthWord* sample, TruthWord* errors) {
+    const TruthWord* expected;
+    long row;
+    int i;
+
+    row = table->nInputs > 0 ? sample[0] & (~(TruthWord) 0 >> (TRUTH_WORD_BITS - table->nInputs)) : 0;
+    expected = table->rows + row * table->nRowWords;
+    extractBits(sample, table->nInputs, table->nOutputs, errors);
+    for(i = 0; i < table->nRowWords; i++) {
+        errors[i] ^= expected[i];
+    }
+}
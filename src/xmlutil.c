@@ -1,6 +1,8 @@
 #include <stdarg.h>
 #include <libxml/tree.h>
 #include <libxml/xmlstring.h>
+#include "symbols.h"
+#include "xmlutil.h"
 
 int strEqual(const xmlChar* str1, const char* str2) {
     return xmlStrEqual(str1, (const xmlChar*) str2);
@@ -34,12 +36,52 @@ float nodePropAsFloat(xmlNode* node, const char* propName) {
 }
 
 int nodePropEqual(xmlNode* node, const char* propName, const char* str2) {
-    xmlChar* propVal = xmlGetProp(node, propName);
-    int match = strEqual(propVal, str2);
+    const xmlChar* peekVal = nodePropPeek(node, propName);
+    xmlChar* propVal;
+    int match;
+    if(peekVal != NULL) {
+        return strEqual(peekVal, str2);
+    }
+    propVal = xmlGetProp(node, propName);
+    match = strEqual(propVal, str2);
     xmlFree(propVal);
     return match;
 }
 
+/*
+ * Returns the value of a plain text attribute without copying it. Returns
+ * NULL when the node has no such attribute or its value is not a single text
+ * node, in which case xmlGetProp must be used.
+ */
+const xmlChar* nodePropPeek(xmlNode* node, const char* propName) {
+    xmlAttr* attr = xmlHasProp(node, propName);
+    if(attr == NULL || attr->children == NULL || attr->children->next != NULL ||
+            attr->children->type != XML_TEXT_NODE) {
+        return NULL;
+    }
+    return attr->children->content;
+}
+
+/*
+ * Looks up the value of an attribute in a symbol table, returning -1 if the
+ * attribute is missing or its value isn't in the table.
+ */
+int nodePropLookup(xmlNode* node, const char* propName, SymbolTable* table) {
+    const xmlChar* peekVal = nodePropPeek(node, propName);
+    xmlChar* propVal;
+    int id;
+    if(peekVal != NULL) {
+        return symbolTableFind(table, (const char*) peekVal);
+    }
+    propVal = xmlGetProp(node, propName);
+    if(propVal == NULL) {
+        return -1;
+    }
+    id = symbolTableFind(table, (const char*) propVal);
+    xmlFree(propVal);
+    return id;
+}
+
 int nodeHasElementChildren(xmlNode* node) {
     xmlNode* child = node->children;
     while(child) {
@@ -0,0 +1,609 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include "assertions.h"
+#include "chassis.h"
+#include "circuit.h"
+#include "latency.h"
+#include "recorder.h"
+#include "samples.h"
+#include "simulator.h"
+
+#define PROGRAM_NAME "edsac_benchmark"
+#define MAX_ARG_LEN 128
+#define N_PARAMS 10
+#define BENCH_MIN_NS 200000000L
+#define BENCH_SAMPLE_CELLS 20000000L
+#define BENCH_MIN_SAMPLES 1000L
+#define BENCH_MAX_ROWS 1024
+#define BENCH_BATCH_SIZE 256
+#define BENCH_TMP_TEMPLATE "/tmp/edsac-benchmark-XXXXXX"
+
+typedef struct {
+    const char* name;
+    const char* format;
+    void* dest;
+    const char* argsName;
+    const char* description;
+} CmdLineParam;
+
+typedef struct {
+    int nTp, nInputs, depth, fanIn;
+} BenchSize;
+
+typedef struct {
+    BenchSize size;
+    long nSamples;
+    unsigned long seed;
+    char caseName[MAX_ARG_LEN + 1];
+    int verifyReads;
+    int helpMessage;
+} BenchOptions;
+
+/*
+ * The state one benchmark case runs against: the generated chassis files in
+ * directory, the chassis compiled from them, up to BENCH_MAX_ROWS of its
+ * samples, one int per TP and packed, and its wiring on a simulated backend.
+ */
+typedef struct {
+    const char* directory;
+    BenchSize size;
+    long nSamples;
+    xmlDoc* circuitDoc;
+    AssertionsSet* set;
+    int* rows;
+    TruthWord* packedRows;
+    int nRows;
+    SamplingBackend* backend;
+    Wiring* wiring;
+} BenchContext;
+
+typedef long (*BenchCase)(BenchContext* context);
+
+typedef struct {
+    const char* name;
+    BenchCase run;
+} NamedBenchCase;
+
+CmdLineParam params[N_PARAMS] = {
+    { .name="--tps", .format="%d", .dest=NULL, .argsName="<count>", .description="Benchmark a chassis of this many TPs instead of the default sizes"},
+    { .name="--inputs", .format="%d", .dest=NULL, .argsName="<count>", .description="The number of input TPs of the chassis given by --tps"},
+    { .name="--depth", .format="%d", .dest=NULL, .argsName="<levels>", .description="The number of levels of gates of the chassis given by --tps"},
+    { .name="--fan-in", .format="%d", .dest=NULL, .argsName="<count>", .description="The number of TPs each gate refers to in the chassis given by --tps"},
+    { .name="--samples", .format="%ld", .dest=NULL, .argsName="<count>", .description="The number of samples in each generated sample file"},
+    { .name="--seed", .format="%lu", .dest=NULL, .argsName="<seed>", .description="The seed of the chassis generator"},
+    { .name="--case", .format="%s", .dest=NULL, .argsName="<name>", .description="Only run the benchmark case with this name"},
+    { .name="--verify-reads", .format=NULL, .dest=NULL, .argsName=NULL, .description="Check packed reads against reads pin by pin over shuffled wiring instead of timing the cases"},
+    { .name="--help", .format=NULL, .dest=NULL, .argsName=NULL, .description="Display this help message"},
+    { .name="--list", .format=NULL, .dest=NULL, .argsName=NULL, .description="List the benchmark cases"}
+};
+
+BenchSize defaultSizes[] = {
+    { 4, 3, 1, 3 },
+    { 64, 12, 4, 3 },
+    { 512, 16, 8, 3 },
+    { 4096, 20, 16, 4 },
+    { 4096, 128, 16, 4 }
+};
+
+/*
+ * Every allocation made by the program or its libraries goes through these,
+ * so a case can count the allocations made while it is timed.
+ */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+long nAllocations;
+long nAllocatedBytes;
+
+void* malloc(size_t size) {
+    __atomic_fetch_add(&nAllocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&nAllocatedBytes, size, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    __atomic_fetch_add(&nAllocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&nAllocatedBytes, n * size, __ATOMIC_RELAXED);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* p, size_t size) {
+    __atomic_fetch_add(&nAllocations, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&nAllocatedBytes, size, __ATOMIC_RELAXED);
+    return __libc_realloc(p, size);
+}
+
+long benchParse(BenchContext* context) {
+    AssertionsSet* set;
+    set = createAssertionSetFromXMLNode(xmlDocGetRootElement(context->circuitDoc));
+    assert(set != NULL);
+    freeAssertionSet(set);
+    return context->size.nTp;
+}
+
+long benchFindRow(BenchContext* context) {
+    long i, sum = 0;
+    if(context->set->table == NULL) {
+        return -1;
+    }
+    for(i = 0; i < context->nSamples; i++) {
+        sum += findTableRowForInputs(context->set, context->rows + (i % context->nRows) * context->size.nTp);
+    }
+    // Keep the rows found so the loop is not optimised away
+    __asm__ volatile("" : : "r"(sum));
+    return context->nSamples;
+}
+
+long benchCheck(BenchContext* context) {
+    int* errors;
+    long i;
+    int n;
+    assert((errors = malloc(sizeof(int) * (context->size.nTp + 1))) != NULL);
+    for(i = 0; i < context->nSamples; i++) {
+        checkTruthTable(context->set, context->rows + (i % context->nRows) * context->size.nTp, errors, &n);
+    }
+    free(errors);
+    return context->nSamples;
+}
+
+long benchCheckBatch(BenchContext* context) {
+    const TruthWord** batch;
+    TruthWord* results;
+    long i;
+    int j, n, nSampleWords;
+
+    nSampleWords = getSampleWords(context->set);
+    assert((batch = malloc(sizeof(TruthWord*) * BENCH_BATCH_SIZE)) != NULL);
+    assert((results = malloc(sizeof(TruthWord) * (getErrorMaskWords(context->set) * BENCH_BATCH_SIZE + 1))) != NULL);
+    for(i = 0; i < context->nSamples; i += n) {
+        n = context->nSamples - i < BENCH_BATCH_SIZE ? context->nSamples - i : BENCH_BATCH_SIZE;
+        for(j = 0; j < n; j++) {
+            batch[j] = context->packedRows + ((i + j) % context->nRows) * nSampleWords;
+        }
+        checkTruthTableBatch(context->set, batch, n, results);
+    }
+    free(results);
+    free(batch);
+    return context->nSamples;
+}
+
+long benchCheckChanges(BenchContext* context) {
+    const TruthWord** batch;
+    TruthWord* results;
+    SampleChecker* checker;
+    long i;
+    int j, n, nSampleWords;
+
+    nSampleWords = getSampleWords(context->set);
+    assert((batch = malloc(sizeof(TruthWord*) * BENCH_BATCH_SIZE)) != NULL);
+    assert((results = malloc(sizeof(TruthWord) * (getErrorMaskWords(context->set) * BENCH_BATCH_SIZE + 1))) != NULL);
+    checker = createSampleChecker(context->set);
+    for(i = 0; i < context->nSamples; i += n) {
+        n = context->nSamples - i < BENCH_BATCH_SIZE ? context->nSamples - i : BENCH_BATCH_SIZE;
+        for(j = 0; j < n; j++) {
+            batch[j] = context->packedRows + ((i + j) % context->nRows) * nSampleWords;
+        }
+        checkSampleChanges(context->set, checker, batch, n, results);
+    }
+    freeSampleChecker(checker);
+    free(results);
+    free(batch);
+    return context->nSamples;
+}
+
+long benchReadSampleFile(BenchContext* context, const char* file) {
+    Samples* samples;
+    const TruthWord** batch;
+    char* filename;
+    long total = 0;
+    int n;
+
+    filename = addressOfFileInDirectory(context->directory, file);
+    assert((batch = malloc(sizeof(TruthWord*) * BENCH_BATCH_SIZE)) != NULL);
+    samples = createSamplesFromFile(context->set, filename);
+    assert(samples != NULL);
+    while((n = samplesGetBatch(samples, batch, NULL, BENCH_BATCH_SIZE)) > 0) {
+        total += n;
+    }
+    assert(!samplesFailed(samples));
+    freeSamples(samples);
+    free(batch);
+    free(filename);
+    // samplesGetBatch starts after the first sample, which was read too
+    return total + 1;
+}
+
+long benchReadCsv(BenchContext* context) {
+    return benchReadSampleFile(context, SAMPLES_CSV_FILE);
+}
+
+long benchReadCapture(BenchContext* context) {
+    return benchReadSampleFile(context, SAMPLES_CAPTURE_FILE);
+}
+
+long benchReadTPValues(BenchContext* context) {
+    int* values;
+    long i;
+    assert((values = malloc(sizeof(int) * (context->size.nTp + 1))) != NULL);
+    for(i = 0; i < context->nSamples; i++) {
+        readInTPValues(context->backend, context->wiring, values);
+    }
+    free(values);
+    return context->nSamples;
+}
+
+long benchReadTPPins(BenchContext* context) {
+    int* values;
+    long i;
+    assert((values = malloc(sizeof(int) * (context->size.nTp + 1))) != NULL);
+    for(i = 0; i < context->nSamples; i++) {
+        readInTPValuesByPin(context->backend, context->wiring, values);
+    }
+    free(values);
+    return context->nSamples;
+}
+
+long benchReadPackedTPValues(BenchContext* context) {
+    TruthWord* sample;
+    long i;
+    assert((sample = malloc(sizeof(TruthWord) * (getSampleWords(context->set) + 1))) != NULL);
+    for(i = 0; i < context->nSamples; i++) {
+        readInPackedTPValues(context->backend, context->wiring, sample);
+    }
+    free(sample);
+    return context->nSamples;
+}
+
+NamedBenchCase benchCases[] = {
+    { "parse", benchParse },
+    { "find-row", benchFindRow },
+    { "check", benchCheck },
+    { "check-batch", benchCheckBatch },
+    { "check-changes", benchCheckChanges },
+    { "read-csv", benchReadCsv },
+    { "read-capture", benchReadCapture },
+    { "read-tp-values", benchReadTPValues },
+    { "read-tp-pins", benchReadTPPins },
+    { "read-packed-tp-values", benchReadPackedTPValues }
+};
+#define N_BENCH_CASES ((int) (sizeof(benchCases) / sizeof(benchCases[0])))
+
+/*
+ * Loads the chassis, its wiring and the first BENCH_MAX_ROWS samples of the
+ * generated files in directory.
+ */
+void setupBenchContext(BenchContext* context) {
+    Samples* samples;
+    xmlDoc* doc;
+    char* filename;
+    int nSampleWords;
+
+    filename = addressOfFileInDirectory(context->directory, CHASSIS_FILE);
+    context->circuitDoc = xmlReadFile(filename, NULL, 0);
+    assert(context->circuitDoc != NULL);
+    free(filename);
+    context->set = createAssertionSetFromXMLNode(xmlDocGetRootElement(context->circuitDoc));
+    assert(context->set != NULL);
+
+    nSampleWords = getSampleWords(context->set);
+    assert((context->rows = malloc(sizeof(int) * BENCH_MAX_ROWS * context->size.nTp)) != NULL);
+    assert((context->packedRows = malloc(sizeof(TruthWord) * BENCH_MAX_ROWS * nSampleWords)) != NULL);
+    filename = addressOfFileInDirectory(context->directory, SAMPLES_CAPTURE_FILE);
+    samples = createSamplesFromFile(context->set, filename);
+    assert(samples != NULL);
+    free(filename);
+    context->nRows = 0;
+    do {
+        samplesGetPackedValues(samples, context->packedRows + context->nRows * nSampleWords);
+        unpackBits(context->packedRows + context->nRows * nSampleWords, context->size.nTp, context->rows + context->nRows * context->size.nTp);
+        context->nRows++;
+    } while(context->nRows < BENCH_MAX_ROWS && samplesNext(samples));
+    freeSamples(samples);
+
+    context->backend = createSimulatorBackend(SIMULATOR_PINS, SIMULATOR_SEED, SIMULATOR_FLIP_PERIOD);
+    filename = addressOfFileInDirectory(context->directory, WIRING_FILE);
+    doc = xmlReadFile(filename, NULL, 0);
+    assert(doc != NULL);
+    free(filename);
+    context->wiring = createWiringFromXMLNode(context->backend, context->set, xmlDocGetRootElement(doc));
+    assert(context->wiring != NULL);
+    xmlFreeDoc(doc);
+    setupWiringPins(context->backend, context->wiring);
+}
+
+void freeBenchContext(BenchContext* context) {
+    freeWiring(context->wiring);
+    context->backend->free(context->backend);
+    free(context->packedRows);
+    free(context->rows);
+    freeAssertionSet(context->set);
+    xmlFreeDoc(context->circuitDoc);
+}
+
+/*
+ * Gives the wires the same pins in a random order, so that a packed read
+ * gathers many short runs, and plans the runs again.
+ */
+void shuffleWiringPins(SamplingBackend* backend, Wiring* wiring) {
+    int i, j, pin;
+    for(i = wiring->nWires - 1; i > 0; i--) {
+        j = randomBelow(i + 1);
+        pin = wiring->wires[i]->gpioPin;
+        wiring->wires[i]->gpioPin = wiring->wires[j]->gpioPin;
+        wiring->wires[j]->gpioPin = pin;
+    }
+    planWiringRuns(backend, wiring);
+}
+
+/*
+ * Reads every sample both packed and pin by pin from the simulator over
+ * shuffled wiring and counts the samples where they differ. The simulator
+ * does not flip pins itself; the wired pins are set at random before each
+ * pair of reads so both see the same levels. Prints one csv row with the
+ * simulator's reads of its level registers and of single pins.
+ */
+int verifyPackedReads(BenchContext* context) {
+    Simulator* simulator;
+    TruthWord* sample;
+    int *values, *unpacked;
+    long i, nMismatches, nLevelReads, nPinReads;
+    int j;
+
+    setupBenchContext(context);
+    simulator = getSimulator(context->backend);
+    simulator->flipPeriod = 0;
+    shuffleWiringPins(context->backend, context->wiring);
+    assert((sample = malloc(sizeof(TruthWord) * (getSampleWords(context->set) + 1))) != NULL);
+    assert((values = malloc(sizeof(int) * (context->size.nTp + 1))) != NULL);
+    assert((unpacked = malloc(sizeof(int) * (context->size.nTp + 1))) != NULL);
+    nMismatches = 0;
+    nLevelReads = 0;
+    nPinReads = 0;
+    for(i = 0; i < context->nSamples; i++) {
+        for(j = 0; j < context->wiring->nWires; j++) {
+            simulatorSetPin(context->backend, context->wiring->wires[j]->gpioPin, randomBelow(2) ? PIN_HIGH : PIN_LOW);
+        }
+        simulator->nLevelReads = 0;
+        simulator->nReads = 0;
+        readInPackedTPValues(context->backend, context->wiring, sample);
+        nLevelReads += simulator->nLevelReads;
+        nPinReads += simulator->nReads;
+        readInTPValuesByPin(context->backend, context->wiring, values);
+        unpackBits(sample, context->size.nTp, unpacked);
+        if(memcmp(values, unpacked, sizeof(int) * context->size.nTp) != 0) {
+            nMismatches++;
+        }
+    }
+    printf("%d,%d,%d,%d,%d,%ld,%ld,%ld,%ld\n", context->size.nTp, context->size.nInputs, context->size.depth,
+            context->size.fanIn, context->wiring->nRuns, context->nSamples, nLevelReads, nPinReads, nMismatches);
+    free(unpacked);
+    free(values);
+    free(sample);
+    freeBenchContext(context);
+    if(nMismatches > 0) {
+        fprintf(stderr, "Packed reads differed from reads pin by pin in %ld of %ld samples\n", nMismatches, context->nSamples);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Runs a case in a process of its own so that its peak RSS is its own, and
+ * repeats it until it has run for at least BENCH_MIN_NS. Prints one csv row.
+ */
+void runBenchCase(NamedBenchCase* benchCase, BenchContext* context) {
+    struct rusage usage;
+    uint64_t start, elapsed;
+    long ops, total, allocations, allocatedBytes;
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+    if(pid < 0) {
+        fprintf(stderr, "Could not start a process for case %s\n", benchCase->name);
+        return;
+    }
+    if(pid > 0) {
+        waitpid(pid, &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "Case %s failed\n", benchCase->name);
+        }
+        return;
+    }
+
+    setupBenchContext(context);
+    total = 0;
+    nAllocations = 0;
+    nAllocatedBytes = 0;
+    start = monotonicNanoseconds();
+    do {
+        ops = benchCase->run(context);
+        if(ops < 0) {
+            _exit(EXIT_SUCCESS);
+        }
+        total += ops;
+        elapsed = monotonicNanoseconds() - start;
+    } while(elapsed < BENCH_MIN_NS);
+    allocations = nAllocations;
+    allocatedBytes = nAllocatedBytes;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("%s,%d,%d,%d,%d,%s,%ld,%.1f,%.0f,%.3f,%.1f,%ld\n", benchCase->name, context->size.nTp, context->size.nInputs,
+            context->size.depth, context->size.fanIn, context->set->table != NULL ? "table" : "gates", total,
+            (double) elapsed / total, total * 1e9 / elapsed, (double) allocations / total, (double) allocatedBytes / total,
+            usage.ru_maxrss);
+    fflush(stdout);
+    _exit(EXIT_SUCCESS);
+}
+
+void removeBenchFiles(const char* directory) {
+    const char* files[] = { CHASSIS_FILE, WIRING_FILE, CALLIBRATION_FILE, SAMPLES_CSV_FILE, SAMPLES_CAPTURE_FILE, FAULTS_FILE };
+    char* filename;
+    int i;
+    for(i = 0; i < (int) (sizeof(files) / sizeof(files[0])); i++) {
+        filename = addressOfFileInDirectory(directory, files[i]);
+        unlink(filename);
+        free(filename);
+    }
+    rmdir(directory);
+}
+
+/*
+ * Generates a chassis of the given size with its samples and runs every
+ * selected case against it.
+ */
+int benchmarkSize(BenchOptions* options, BenchSize* size) {
+    BenchContext context;
+    Chassis* chassis;
+    char directory[] = BENCH_TMP_TEMPLATE;
+    int i, ok;
+
+    if(mkdtemp(directory) == NULL) {
+        fprintf(stderr, "Could not create a directory for the generated files\n");
+        return 0;
+    }
+    context.directory = directory;
+    context.size = *size;
+    context.nSamples = options->nSamples;
+    if(context.nSamples <= 0) {
+        context.nSamples = BENCH_SAMPLE_CELLS / size->nTp > BENCH_MIN_SAMPLES ? BENCH_SAMPLE_CELLS / size->nTp : BENCH_MIN_SAMPLES;
+    }
+
+    seedChassisRandom(options->seed);
+    chassis = createChassis(size->nTp, size->nInputs, size->depth, size->fanIn);
+    ok = writeChassisFiles(chassis, directory) && writeChassisSamples(chassis, directory, context.nSamples, 1, 0, 1);
+    freeChassis(chassis);
+    if(ok && options->verifyReads) {
+        ok = verifyPackedReads(&context);
+    }
+    for(i = 0; i < N_BENCH_CASES && ok && !options->verifyReads; i++) {
+        if(strlen(options->caseName) == 0 || strcmp(options->caseName, benchCases[i].name) == 0) {
+            runBenchCase(&benchCases[i], &context);
+        }
+    }
+    removeBenchFiles(directory);
+    return ok;
+}
+
+void printHelp(int argc, char** argv) {
+    int maxOptionLen, len, j;
+    char optionString[MAX_ARG_LEN];
+
+    printf("Usage: %s [options]\nOptions:\n", argc > 0 ? argv[0] : PROGRAM_NAME);
+    maxOptionLen = 0;
+    for(j = 0; j < N_PARAMS; j++) {
+        len = strlen(params[j].name) + (params[j].format != NULL ? 1 + strlen(params[j].argsName) : 0);
+        if(len > maxOptionLen) {
+            maxOptionLen = len;
+        }
+    }
+    for(j = 0; j < N_PARAMS; j++) {
+        if(params[j].format != NULL) {
+            snprintf(optionString, MAX_ARG_LEN, "%s %s", params[j].name, params[j].argsName);
+        } else {
+            snprintf(optionString, MAX_ARG_LEN, "%s", params[j].name);
+        }
+        printf("  %-*s %s\n", maxOptionLen + 1, optionString, params[j].description);
+    }
+}
+
+int parseCommandLine(int argc, char** argv, BenchOptions* options, int* listCases) {
+    int i, j;
+
+    options->size.nTp = 0;
+    options->size.nInputs = 16;
+    options->size.depth = 4;
+    options->size.fanIn = 3;
+    options->nSamples = 0;
+    options->seed = 1;
+    strcpy(options->caseName, "");
+    options->verifyReads = 0;
+    options->helpMessage = 0;
+    *listCases = 0;
+
+    params[0].dest = &options->size.nTp;
+    params[1].dest = &options->size.nInputs;
+    params[2].dest = &options->size.depth;
+    params[3].dest = &options->size.fanIn;
+    params[4].dest = &options->nSamples;
+    params[5].dest = &options->seed;
+    params[6].dest = options->caseName;
+    params[7].dest = &options->verifyReads;
+    params[8].dest = &options->helpMessage;
+    params[9].dest = listCases;
+
+    for(i = 1; i < argc; i++) {
+        for(j = 0; j < N_PARAMS && strcmp(argv[i], params[j].name) != 0; j++);
+        if(j >= N_PARAMS) {
+            fprintf(stderr, "Unrecognised option, \"%s\"\n", argv[i]);
+            return 0;
+        }
+        if(params[j].format == NULL) {
+            *((int*) params[j].dest) = true;
+            continue;
+        }
+        if(++i >= argc) {
+            fprintf(stderr, "No value specified for %s option\n", params[j].name);
+            return 0;
+        }
+        if(strlen(argv[i]) > MAX_ARG_LEN || sscanf(argv[i], params[j].format, params[j].dest) != 1) {
+            fprintf(stderr, "Value specified for %s option, \"%s\", could not be parsed\n", params[j].name, argv[i]);
+            return 0;
+        }
+    }
+
+    if(options->size.nTp != 0 && (options->size.nInputs < 1 || options->size.depth < 1 || options->size.fanIn < 1
+            || options->size.nTp - options->size.nInputs < options->size.depth)) {
+        fprintf(stderr, "Need at least one input, one level and one ref per gate, and at least one gate per level\n");
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    LIBXML_TEST_VERSION
+
+    BenchOptions options;
+    int i, ok, listCases;
+
+    if(!parseCommandLine(argc, argv, &options, &listCases)) {
+        printf("Try \"%s --help\" for help on using this program\n", argc > 0 ? argv[0] : PROGRAM_NAME);
+        return EXIT_FAILURE;
+    }
+    if(options.helpMessage) {
+        printHelp(argc, argv);
+        return EXIT_SUCCESS;
+    }
+    if(listCases) {
+        for(i = 0; i < N_BENCH_CASES; i++) {
+            printf("%s\n", benchCases[i].name);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if(options.verifyReads) {
+        printf("tps,inputs,depth,fan_in,runs,samples,level_reads,pin_reads,mismatches\n");
+    } else {
+        printf("case,tps,inputs,depth,fan_in,evaluator,ops,ns_per_op,ops_per_sec,allocations_per_op,allocated_bytes_per_op,peak_rss_kb\n");
+    }
+    ok = 1;
+    if(options.size.nTp != 0) {
+        ok = benchmarkSize(&options, &options.size);
+    } else {
+        for(i = 0; i < (int) (sizeof(defaultSizes) / sizeof(defaultSizes[0])) && ok; i++) {
+            ok = benchmarkSize(&options, &defaultSizes[i]);
+        }
+    }
+    xmlCleanupParser();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
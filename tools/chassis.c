@@ -0,0 +1,329 @@
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "capture.h"
+#include "chassis.h"
+#include "truthtable.h"
+
+#define FILE_SEPARATOR '/'
+#define HOLD_PIN 1
+#define TP_MIN_VOLTS 2
+#define TP_MAX_VOLTS 5
+#define TP_THRESHOLD 3
+
+uint64_t randomState = 1;
+
+void seedChassisRandom(uint64_t seed) {
+    randomState = seed != 0 ? seed : 1;
+}
+
+uint64_t nextRandom(void) {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 7;
+    randomState ^= randomState << 17;
+    return randomState;
+}
+
+int randomBelow(int n) {
+    return nextRandom() % n;
+}
+
+double randomUnit(void) {
+    return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+char* addressOfFileInDirectory(const char* dir, const char* file) {
+    char* dst;
+    assert((dst = malloc(sizeof(char) * (strlen(dir) + 1 + strlen(file) + 1))) != NULL);
+    sprintf(dst, "%s%c%s", dir, FILE_SEPARATOR, file);
+    return dst;
+}
+
+FILE* openOutputFile(const char* dir, const char* file) {
+    FILE* out;
+    char* filename;
+    filename = addressOfFileInDirectory(dir, file);
+    out = fopen(filename, "w");
+    if(out == NULL) {
+        fprintf(stderr, "Could not open file \"%s\" for writing\n", filename);
+    }
+    free(filename);
+    return out;
+}
+
+/*
+ * Spreads the gates evenly over the levels. The first ref of every gate is
+ * a TP of the level below so the chassis has the requested depth, the rest
+ * are distinct TPs of any lower level.
+ */
+Chassis* createChassis(int nTp, int nInputs, int depth, int fanIn) {
+    Chassis* chassis;
+    int i, j, k, n, tp, level, nGates, nLevelGates, levelStart, previousStart, ref, tries;
+
+    assert((chassis = malloc(sizeof(Chassis))) != NULL);
+    n = nTp;
+    chassis->nTp = n;
+    chassis->nInputs = nInputs;
+    assert((chassis->names = malloc(sizeof(char*) * n)) != NULL);
+    assert((chassis->levels = malloc(sizeof(int) * n)) != NULL);
+    assert((chassis->gates = malloc(sizeof(int) * n)) != NULL);
+    assert((chassis->negated = malloc(sizeof(int) * n)) != NULL);
+    assert((chassis->refs = malloc(sizeof(int*) * n)) != NULL);
+    assert((chassis->nRefs = malloc(sizeof(int) * n)) != NULL);
+    assert((chassis->valveNos = malloc(sizeof(int) * n)) != NULL);
+    assert((chassis->order = malloc(sizeof(int) * n)) != NULL);
+
+    for(tp = 0; tp < chassis->nInputs; tp++) {
+        assert((chassis->names[tp] = malloc(16)) != NULL);
+        snprintf(chassis->names[tp], 16, "I%d", tp);
+        chassis->levels[tp] = 0;
+        chassis->nRefs[tp] = 0;
+        chassis->refs[tp] = NULL;
+        chassis->valveNos[tp] = 0;
+    }
+
+    nGates = n - chassis->nInputs;
+    previousStart = 0;
+    levelStart = chassis->nInputs;
+    for(level = 1; level <= depth; level++) {
+        nLevelGates = nGates / depth + (level <= nGates % depth);
+        for(i = 0; i < nLevelGates; i++, tp++) {
+            assert((chassis->names[tp] = malloc(16)) != NULL);
+            snprintf(chassis->names[tp], 16, "T%d", tp - chassis->nInputs);
+            chassis->levels[tp] = level;
+            assert((chassis->refs[tp] = malloc(sizeof(int) * fanIn)) != NULL);
+            chassis->refs[tp][0] = previousStart + randomBelow(levelStart - previousStart);
+            chassis->nRefs[tp] = 1;
+            // Give up on a distinct ref after a few tries when few TPs are below
+            for(j = 1; j < fanIn && j < levelStart; j++) {
+                for(tries = 0; tries < 8; tries++) {
+                    ref = randomBelow(levelStart);
+                    for(k = 0; k < chassis->nRefs[tp] && chassis->refs[tp][k] != ref; k++);
+                    if(k == chassis->nRefs[tp]) {
+                        chassis->refs[tp][chassis->nRefs[tp]++] = ref;
+                        break;
+                    }
+                }
+            }
+            chassis->gates[tp] = chassis->nRefs[tp] == 1 ? GATE_NOT : randomBelow(2) == 0 ? GATE_AND : GATE_OR;
+            chassis->negated[tp] = chassis->gates[tp] != GATE_NOT && randomBelow(4) == 0;
+        }
+        previousStart = levelStart;
+        levelStart = tp;
+    }
+
+    // Valves are numbered in document order, a negated gate uses two
+    for(i = 0; i < n; i++) {
+        chassis->order[i] = i;
+    }
+    for(i = n - 1; i > 0; i--) {
+        j = randomBelow(i + 1);
+        k = chassis->order[i];
+        chassis->order[i] = chassis->order[j];
+        chassis->order[j] = k;
+    }
+    k = 1;
+    for(i = 0; i < n; i++) {
+        tp = chassis->order[i];
+        if(tp >= chassis->nInputs) {
+            chassis->valveNos[tp] = k;
+            k += chassis->negated[tp] ? 2 : 1;
+        }
+    }
+    return chassis;
+}
+
+void freeChassis(Chassis* chassis) {
+    int i;
+    for(i = 0; i < chassis->nTp; i++) {
+        free(chassis->names[i]);
+        free(chassis->refs[i]);
+    }
+    free(chassis->names);
+    free(chassis->levels);
+    free(chassis->gates);
+    free(chassis->negated);
+    free(chassis->refs);
+    free(chassis->nRefs);
+    free(chassis->valveNos);
+    free(chassis->order);
+    free(chassis);
+}
+
+int writeChassisFiles(Chassis* chassis, const char* dir) {
+    FILE *circuit, *wiring, *calibration;
+    const char* gateNames[] = { "and", "or", "not" };
+    const char* indent;
+    int i, j, tp, ok;
+
+    circuit = openOutputFile(dir, CHASSIS_FILE);
+    wiring = openOutputFile(dir, WIRING_FILE);
+    calibration = openOutputFile(dir, CALLIBRATION_FILE);
+    ok = circuit != NULL && wiring != NULL && calibration != NULL;
+    if(ok) {
+        fprintf(circuit, "<?xml version=\"1.0\"?>\n<circuit>\n");
+        fprintf(wiring, "<?xml version=\"1.0\"?>\n<wiring hold-pin=\"%d\">\n", HOLD_PIN);
+        fprintf(calibration, "<?xml version=\"1.0\"?>\n<calibration>\n");
+        for(i = 0; i < chassis->nTp; i++) {
+            tp = chassis->order[i];
+            if(tp < chassis->nInputs) {
+                fprintf(circuit, "    <tp min=\"%d\" max=\"%d\" id=\"%s\"/>\n", TP_MIN_VOLTS, TP_MAX_VOLTS, chassis->names[tp]);
+            } else {
+                fprintf(circuit, "    <tp min=\"%d\" max=\"%d\" id=\"%s\">\n", TP_MIN_VOLTS, TP_MAX_VOLTS, chassis->names[tp]);
+                indent = "        ";
+                if(chassis->negated[tp]) {
+                    fprintf(circuit, "        <not valve_no=\"%d\">\n", chassis->valveNos[tp]);
+                    indent = "            ";
+                }
+                fprintf(circuit, "%s<%s valve_no=\"%d\">\n", indent, gateNames[chassis->gates[tp]], chassis->valveNos[tp] + chassis->negated[tp]);
+                for(j = 0; j < chassis->nRefs[tp]; j++) {
+                    fprintf(circuit, "%s    <ref>%s</ref>\n", indent, chassis->names[chassis->refs[tp][j]]);
+                }
+                fprintf(circuit, "%s</%s>\n", indent, gateNames[chassis->gates[tp]]);
+                if(chassis->negated[tp]) {
+                    fprintf(circuit, "        </not>\n");
+                }
+                fprintf(circuit, "    </tp>\n");
+            }
+            fprintf(wiring, "    <tp id=\"%s\" pin=\"%d\" resistor=\"%d%c\" attenuation=\"1\"/>\n", chassis->names[tp], HOLD_PIN + 1 + i, i / 2, 'A' + i % 2);
+            fprintf(calibration, "    <tp id=\"%s\" threshold=\"%d\"/>\n", chassis->names[tp], TP_THRESHOLD);
+        }
+        fprintf(circuit, "</circuit>\n");
+        fprintf(wiring, "</wiring>\n");
+        fprintf(calibration, "</calibration>\n");
+    }
+    if(circuit != NULL) {
+        ok = !ferror(circuit) && fclose(circuit) == 0 && ok;
+    }
+    if(wiring != NULL) {
+        ok = !ferror(wiring) && fclose(wiring) == 0 && ok;
+    }
+    if(calibration != NULL) {
+        ok = !ferror(calibration) && fclose(calibration) == 0 && ok;
+    }
+    return ok;
+}
+
+/*
+ * Computes every gate TP from the inputs already in values, in level order
+ * so the refs of each gate are computed before it. Faulty TPs read their
+ * stuck value and the gates after them see it.
+ */
+void evaluateChassis(Chassis* chassis, Faults* faults, int* values) {
+    int tp, j, value;
+    for(tp = chassis->nInputs; tp < chassis->nTp; tp++) {
+        if(faults->remaining[tp] > 0) {
+            values[tp] = faults->stuckAt[tp];
+            continue;
+        }
+        value = values[chassis->refs[tp][0]];
+        for(j = 1; j < chassis->nRefs[tp]; j++) {
+            if(chassis->gates[tp] == GATE_AND) {
+                value = value && values[chassis->refs[tp][j]];
+            } else {
+                value = value || values[chassis->refs[tp][j]];
+            }
+        }
+        if(chassis->gates[tp] == GATE_NOT || chassis->negated[tp]) {
+            value = !value;
+        }
+        values[tp] = value;
+    }
+}
+
+/*
+ * Writes the samples in document order as csv and as a capture, and each
+ * injected fault with the sample it starts on. The first sample is fault
+ * free, as replay only uses it as the state before the second.
+ */
+int writeChassisSamples(Chassis* chassis, const char* dir, long nSamples, int flips, double faultRate, int faultLength) {
+    FILE *csv, *faultsFile;
+    CaptureWriter* writer;
+    Faults faults;
+    TruthWord* packed;
+    char** names;
+    char* filename;
+    char* line;
+    int* values;
+    int* columns;
+    long s;
+    int i, tp, ok;
+
+    assert((values = calloc(chassis->nTp, sizeof(int))) != NULL);
+    assert((columns = malloc(sizeof(int) * chassis->nTp)) != NULL);
+    assert((packed = calloc(TRUTH_WORDS_FOR_BITS(chassis->nTp) + 1, sizeof(TruthWord))) != NULL);
+    assert((names = malloc(sizeof(char*) * chassis->nTp)) != NULL);
+    assert((line = malloc(2 * chassis->nTp + 1)) != NULL);
+    assert((faults.stuckAt = calloc(chassis->nTp, sizeof(int))) != NULL);
+    assert((faults.remaining = calloc(chassis->nTp, sizeof(int))) != NULL);
+    for(i = 0; i < chassis->nTp; i++) {
+        names[i] = chassis->names[chassis->order[i]];
+    }
+
+    csv = openOutputFile(dir, SAMPLES_CSV_FILE);
+    faultsFile = openOutputFile(dir, FAULTS_FILE);
+    filename = addressOfFileInDirectory(dir, SAMPLES_CAPTURE_FILE);
+    writer = createCaptureWriter(filename, names, chassis->nTp);
+    free(filename);
+    ok = csv != NULL && faultsFile != NULL && writer != NULL;
+
+    if(ok) {
+        for(i = 0; i < chassis->nTp; i++) {
+            fprintf(csv, "%s,", names[i]);
+        }
+        fprintf(csv, "\n");
+        fprintf(faultsFile, "sample,valve,tp,stuck_at,length\n");
+    }
+    for(s = 0; s < nSamples && ok; s++) {
+        for(tp = chassis->nInputs; tp < chassis->nTp; tp++) {
+            if(faults.remaining[tp] > 0) {
+                faults.remaining[tp]--;
+            }
+        }
+        if(s > 0) {
+            for(i = 0; i < flips; i++) {
+                tp = randomBelow(chassis->nInputs);
+                values[tp] = !values[tp];
+            }
+            if(randomUnit() < faultRate) {
+                tp = chassis->nInputs + randomBelow(chassis->nTp - chassis->nInputs);
+                if(faults.remaining[tp] == 0) {
+                    faults.stuckAt[tp] = randomBelow(2);
+                    faults.remaining[tp] = faultLength;
+                    fprintf(faultsFile, "%ld,%d,%s,%d,%d\n", s, chassis->valveNos[tp], chassis->names[tp], faults.stuckAt[tp], faultLength);
+                }
+            }
+        }
+        evaluateChassis(chassis, &faults, values);
+        for(i = 0; i < chassis->nTp; i++) {
+            columns[i] = values[chassis->order[i]];
+            line[2 * i] = '0' + columns[i];
+            line[2 * i + 1] = ',';
+        }
+        line[2 * chassis->nTp] = '\n';
+        fwrite(line, 1, 2 * chassis->nTp + 1, csv);
+        packBits(columns, chassis->nTp, packed);
+        ok = captureWriterAppend(writer, packed);
+    }
+
+    if(writer != NULL) {
+        ok = closeCaptureWriter(writer) && ok;
+    }
+    if(csv != NULL) {
+        ok = !ferror(csv) && fclose(csv) == 0 && ok;
+    }
+    if(faultsFile != NULL) {
+        ok = !ferror(faultsFile) && fclose(faultsFile) == 0 && ok;
+    }
+    free(faults.remaining);
+    free(faults.stuckAt);
+    free(line);
+    free(names);
+    free(packed);
+    free(columns);
+    free(values);
+    return ok;
+}
+
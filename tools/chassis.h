@@ -0,0 +1,62 @@
+#ifndef CHASSIS_H
+#define CHASSIS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#define CHASSIS_FILE "circuit.xml"
+#define WIRING_FILE "wiring.xml"
+#define CALLIBRATION_FILE "calibrate.xml"
+#define SAMPLES_CSV_FILE "samples.csv"
+#define SAMPLES_CAPTURE_FILE "samples.cap"
+#define FAULTS_FILE "faults.csv"
+
+#define GATE_AND 0
+#define GATE_OR 1
+#define GATE_NOT 2
+
+/*
+ * A generated chassis. TPs 0 to nInputs - 1 are inputs and the rest are
+ * gates in level order, each combining refs of TPs on earlier levels and
+ * inverted when negated. order is the order TPs are written to the chassis
+ * file.
+ */
+typedef struct {
+    int nTp;
+    int nInputs;
+    char** names;
+    int* levels;
+    int* gates;
+    int* negated;
+    int** refs;
+    int* nRefs;
+    int* valveNos;
+    int* order;
+} Chassis;
+
+/*
+ * The stuck-at faults active while generating samples. A faulty TP reads
+ * stuckAt for remaining more samples whatever its gate computes.
+ */
+typedef struct {
+    int* stuckAt;
+    int* remaining;
+} Faults;
+
+void seedChassisRandom(uint64_t seed);
+int randomBelow(int n);
+Chassis* createChassis(int nTp, int nInputs, int depth, int fanIn);
+void freeChassis(Chassis* chassis);
+char* addressOfFileInDirectory(const char* dir, const char* file);
+int writeChassisFiles(Chassis* chassis, const char* dir);
+void evaluateChassis(Chassis* chassis, Faults* faults, int* values);
+int writeChassisSamples(Chassis* chassis, const char* dir, long nSamples, int flips, double faultRate, int faultLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CHASSIS_H */
@@ -0,0 +1,151 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "chassis.h"
+
+#define PROGRAM_NAME "edsac_generate"
+#define MAX_ARG_LEN 128
+#define N_PARAMS 11
+
+typedef struct {
+    const char* name;
+    const char* format;
+    void* dest;
+    const char* argsName;
+    const char* description;
+} CmdLineParam;
+
+typedef struct {
+    char outputDirectory[MAX_ARG_LEN + 1];
+    int nTp, nInputs, depth, fanIn, flips, faultLength, helpMessage;
+    long nSamples;
+    unsigned long seed;
+    double faultRate;
+} GeneratorOptions;
+
+CmdLineParam params[N_PARAMS] = {
+    { .name="--output-dir", .format="%s", .dest=NULL, .argsName="<directory>", .description="The directory to write the configuration, sample and fault files to"},
+    { .name="--tps", .format="%d", .dest=NULL, .argsName="<count>", .description="The number of TPs in the chassis, inputs included"},
+    { .name="--inputs", .format="%d", .dest=NULL, .argsName="<count>", .description="The number of input TPs"},
+    { .name="--depth", .format="%d", .dest=NULL, .argsName="<levels>", .description="The number of levels of gates between the inputs and the last TPs"},
+    { .name="--fan-in", .format="%d", .dest=NULL, .argsName="<count>", .description="The number of TPs each gate refers to"},
+    { .name="--samples", .format="%ld", .dest=NULL, .argsName="<count>", .description="The number of samples to generate"},
+    { .name="--flips", .format="%d", .dest=NULL, .argsName="<count>", .description="The number of inputs that change between samples"},
+    { .name="--fault-rate", .format="%lf", .dest=NULL, .argsName="<probability>", .description="The chance each sample of a gate TP becoming stuck at 0 or 1"},
+    { .name="--fault-length", .format="%d", .dest=NULL, .argsName="<samples>", .description="The number of samples a stuck-at fault lasts"},
+    { .name="--seed", .format="%lu", .dest=NULL, .argsName="<seed>", .description="The seed of the random generator, the same seed gives the same files"},
+    { .name="--help", .format=NULL, .dest=NULL, .argsName=NULL, .description="Display this help message"}
+};
+
+void printHelp(int argc, char** argv) {
+    int maxOptionLen, len, j;
+    char optionString[MAX_ARG_LEN];
+
+    printf("Usage: %s [options]\nOptions:\n", argc > 0 ? argv[0] : PROGRAM_NAME);
+    maxOptionLen = 0;
+    for(j = 0; j < N_PARAMS; j++) {
+        len = strlen(params[j].name) + (params[j].format != NULL ? 1 + strlen(params[j].argsName) : 0);
+        if(len > maxOptionLen) {
+            maxOptionLen = len;
+        }
+    }
+    for(j = 0; j < N_PARAMS; j++) {
+        if(params[j].format != NULL) {
+            snprintf(optionString, MAX_ARG_LEN, "%s %s", params[j].name, params[j].argsName);
+        } else {
+            snprintf(optionString, MAX_ARG_LEN, "%s", params[j].name);
+        }
+        printf("  %-*s %s\n", maxOptionLen + 1, optionString, params[j].description);
+    }
+}
+
+int parseCommandLine(int argc, char** argv, GeneratorOptions* options) {
+    int i, j;
+
+    strcpy(options->outputDirectory, ".");
+    options->nTp = 64;
+    options->nInputs = 16;
+    options->depth = 4;
+    options->fanIn = 3;
+    options->nSamples = 10000;
+    options->flips = 1;
+    options->faultRate = 0.001;
+    options->faultLength = 100;
+    options->seed = 1;
+    options->helpMessage = 0;
+
+    params[0].dest = options->outputDirectory;
+    params[1].dest = &options->nTp;
+    params[2].dest = &options->nInputs;
+    params[3].dest = &options->depth;
+    params[4].dest = &options->fanIn;
+    params[5].dest = &options->nSamples;
+    params[6].dest = &options->flips;
+    params[7].dest = &options->faultRate;
+    params[8].dest = &options->faultLength;
+    params[9].dest = &options->seed;
+    params[10].dest = &options->helpMessage;
+
+    for(i = 1; i < argc; i++) {
+        for(j = 0; j < N_PARAMS && strcmp(argv[i], params[j].name) != 0; j++);
+        if(j >= N_PARAMS) {
+            fprintf(stderr, "Unrecognised option, \"%s\"\n", argv[i]);
+            return 0;
+        }
+        if(params[j].format == NULL) {
+            *((int*) params[j].dest) = true;
+            continue;
+        }
+        if(++i >= argc) {
+            fprintf(stderr, "No value specified for %s option\n", params[j].name);
+            return 0;
+        }
+        if(strlen(argv[i]) > MAX_ARG_LEN || sscanf(argv[i], params[j].format, params[j].dest) != 1) {
+            fprintf(stderr, "Value specified for %s option, \"%s\", could not be parsed\n", params[j].name, argv[i]);
+            return 0;
+        }
+    }
+
+    if(options->nInputs < 1 || options->depth < 1 || options->fanIn < 1 || options->nTp - options->nInputs < options->depth) {
+        fprintf(stderr, "Need at least one input, one level and one ref per gate, and at least one gate per level\n");
+        return 0;
+    }
+    if(options->nSamples < 1 || options->flips < 0 || options->faultLength < 1 || options->faultRate < 0 || options->faultRate > 1) {
+        fprintf(stderr, "Need at least one sample, a fault length of at least one and a fault rate from 0 to 1\n");
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    GeneratorOptions options;
+    Chassis* chassis;
+    int ok;
+
+    if(!parseCommandLine(argc, argv, &options)) {
+        printf("Try \"%s --help\" for help on using this program\n", argc > 0 ? argv[0] : PROGRAM_NAME);
+        return EXIT_FAILURE;
+    }
+    if(options.helpMessage) {
+        printHelp(argc, argv);
+        return EXIT_SUCCESS;
+    }
+    if(mkdir(options.outputDirectory, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Could not create directory \"%s\"\n", options.outputDirectory);
+        return EXIT_FAILURE;
+    }
+
+    seedChassisRandom(options.seed);
+    chassis = createChassis(options.nTp, options.nInputs, options.depth, options.fanIn);
+    ok = writeChassisFiles(chassis, options.outputDirectory)
+            && writeChassisSamples(chassis, options.outputDirectory, options.nSamples, options.flips, options.faultRate, options.faultLength);
+    if(!ok) {
+        fprintf(stderr, "Failed to write the generated files to \"%s\"\n", options.outputDirectory);
+    }
+    freeChassis(chassis);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}